@@ -0,0 +1,20 @@
+#ifndef USR_CLOCKS_H
+#define USR_CLOCKS_H
+
+#include <time.h>
+
+/// Must be coherent with newlib's time.h, which only defines some of them.
+#ifndef CLOCK_REALTIME
+#define CLOCK_REALTIME 	(clockid_t)1
+#endif
+
+#ifndef CLOCK_MONOTONIC
+#define CLOCK_MONOTONIC (clockid_t)4
+#endif
+
+#ifndef TIMER_ABSTIME
+#define TIMER_ABSTIME 	4
+#endif
+
+
+#endif
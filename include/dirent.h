@@ -2,6 +2,7 @@
 #define DIRENT_H
 
 #include <sys/types.h>
+#include <stdint.h>
 
 struct dirent {
 	ino_t d_ino;
@@ -11,4 +12,30 @@ struct dirent {
 	char d_name[256];
 };
 
+/** \struct dirent64
+ *  \brief Variable-length record written by getdents64. d_reclen is a multiple
+ *  of 8, and d_name is null-terminated.
+ */
+struct dirent64 {
+	uint64_t d_ino;
+	int64_t d_off; ///< Position of the next entry, for lseek.
+	unsigned short d_reclen; ///< Size of this record.
+	unsigned char d_type; ///< DT_* type of the file.
+	char d_name[];
+};
+
+#ifndef DT_UNKNOWN
+#define DT_UNKNOWN 	0
+#define DT_FIFO 	1
+#define DT_CHR 		2
+#define DT_DIR 		4
+#define DT_BLK 		6
+#define DT_REG 		8
+#define DT_LNK 		10
+#define DT_SOCK 	12
+#endif
+
+#define IFTODT(mode) 	(((mode) & 0170000) >> 12)
+#define DTTOIF(type) 	((type) << 12)
+
 #endif
@@ -0,0 +1,35 @@
+#ifndef USR_EPOLL_H
+#define USR_EPOLL_H
+
+#include <stdint.h>
+#include "poll.h"
+
+/**
+ * Scalable readiness notification. Must be coherent with the kernel
+ * (epoll.c).
+ */
+
+#define EPOLLIN 	POLLIN
+#define EPOLLPRI 	POLLPRI
+#define EPOLLOUT 	POLLOUT
+#define EPOLLERR 	POLLERR
+#define EPOLLHUP 	POLLHUP
+#define EPOLLET 	0x80000000 ///< Edge-triggered: reported once per change.
+
+#define EPOLL_CTL_ADD 1 ///< Watch a file descriptor.
+#define EPOLL_CTL_DEL 2 ///< Stop watching a file descriptor.
+#define EPOLL_CTL_MOD 3 ///< Change the events of a watched file descriptor.
+
+typedef union epoll_data {
+	void* 		ptr;
+	int 		fd;
+	uint32_t 	u32;
+	uint64_t 	u64;
+} epoll_data_t;
+
+struct epoll_event {
+	uint32_t 		events; ///< Events waited for, or that happened.
+	epoll_data_t 	data; ///< Given back by epoll_wait.
+};
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef USR_POLL_H
+#define USR_POLL_H
+
+/**
+ * Waiting for file descriptors to be ready. Must be coherent with the kernel
+ * (poll.c).
+ */
+
+#define POLLIN 		0x0001 ///< Data can be read without blocking.
+#define POLLPRI 	0x0002
+#define POLLOUT 	0x0004 ///< Data can be written without blocking.
+#define POLLERR 	0x0008
+#define POLLHUP 	0x0010
+#define POLLNVAL 	0x0020 ///< The file descriptor is not open.
+
+typedef unsigned int nfds_t;
+
+struct pollfd {
+	int 	fd; ///< Ignored if negative.
+	short 	events; ///< Events waited for.
+	short 	revents; ///< Events that happened, set by poll.
+};
+
+#endif
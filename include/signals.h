@@ -1,12 +1,47 @@
 #ifndef USR_SIGNALS_H
 #define USR_SIGNALS_H
 
+/**
+ * Real-time signals, as numbered by newlib. Any signal sent with sigqueue is
+ * queued, the others are merged with a pending signal of the same number.
+ */
+#ifndef SIGRTMIN
+#define SIGRTMIN 	27
+#define SIGRTMAX 	31
+#endif
+
+#ifndef SIG_SETMASK
+#define SIG_SETMASK 0
+#define SIG_BLOCK 	1
+#define SIG_UNBLOCK 2
+#endif
+
+/**
+ * Origin of a signal (si_code).
+ */
+#ifndef SI_USER
+#define SI_USER 	1 ///< Sent by kill.
+#define SI_QUEUE 	2 ///< Sent by sigqueue.
+#endif
+
+/// Value carried by a signal sent with sigqueue.
+typedef union {
+	int 	sival_int;
+	void* 	sival_ptr;
+} sigval_t;
 
 /// Must be coherent with process.h
 typedef struct {
 	int si_signo;
 	int si_pid;
+	int si_code;
+	sigval_t si_value;
 } siginfo_t;
 
+/*
+ * A handler is called as handler(int sig, siginfo_t* info, void* unused) on
+ * the stack of the interrupted code, with the signal blocked. Returning from
+ * it calls sigreturn, which restores the interrupted context and signal mask.
+ */
 
 #endif
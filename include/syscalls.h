@@ -4,8 +4,18 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/times.h>
+#include <sys/resource.h>
+#include <signal.h>
 #include "../include/dirent.h"
+#include "../include/uio.h"
 #include "../include/signals.h"
+#include "../include/clocks.h"
+#include "../include/threads.h"
+#include "../include/uring.h"
+#include "../include/poll.h"
+#include "../include/epoll.h"
 
 
 char* get_framebuffer(int pid);
@@ -20,6 +30,7 @@ int _openat(int dirfd, char* path, int flags);
 int _mknodat(int dirfd, char* path, mode_t mode, dev_t dev);
 int _open(char* path, int flags);
 int _getdents(int fd, struct dirent* user_dirent);
+int getdents64(int fd, struct dirent64* dirp, size_t count);
 int _execve(const char *filename, char *const argv[], char *const envp[]);
 int _chdir(char* path);
 
@@ -33,6 +44,15 @@ pid_t _wait(int *wstatus);
 off_t _lseek(int fd, off_t offset, int whence);
 int _unlinkat(int dfd, const char* name, int flag);
 ssize_t _read(int fd, void* buf, size_t count);
+ssize_t readv(int fd, const struct iovec* iov, int iovcnt);
+ssize_t writev(int fd, const struct iovec* iov, int iovcnt);
+ssize_t pread(int fd, void* buf, size_t count, off_t offset);
+ssize_t pwrite(int fd, const void* buf, size_t count, off_t offset);
+ssize_t sendfile(int out_fd, int in_fd, off_t* offset, size_t count);
+int poll(struct pollfd* fds, nfds_t nfds, int timeout);
+int epoll_create(int size);
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event* event);
+int epoll_wait(int epfd, struct epoll_event* events, int maxevents, int timeout);
 
 int dup(int oldfd);
 int dup2(int oldfd, int newfd);
@@ -40,5 +60,68 @@ int dup2(int oldfd, int newfd);
 int _kill(pid_t pid, int sig);
 int sigaction(int signum, void (*handler)(int), siginfo_t* siginfo);
 int sigreturn();
+int sigprocmask(int how, const sigset_t* set, sigset_t* oldset);
+int sigpending(sigset_t* set);
+int sigqueue(pid_t pid, int sig, const sigval_t value);
+
+int clock_gettime(clockid_t clock_id, struct timespec* tp);
+int _gettimeofday(struct timeval* tv, void* tz);
+int getrusage(int who, struct rusage* usage);
+clock_t _times(struct tms* buf);
+int nanosleep(const struct timespec* req, struct timespec* rem);
+int clock_nanosleep(clockid_t clock_id, int flags, const struct timespec* req, struct timespec* rem);
+
+pid_t gettid();
+int futex(int* uaddr, int op, int val, const struct timespec* timeout);
+int clone(int (*fn)(void*), void* stack, int flags, void* arg, pid_t* ptid, pid_t* ctid);
+
+int uring_enter(uring_t* ring, unsigned min_complete);
+int uring_init(uring_t* ring, unsigned entries);
+void uring_free(uring_t* ring);
+uring_sqe_t* uring_get_sqe(uring_t* ring);
+void uring_prep_rw(uring_sqe_t* sqe, int opcode, int fd, void* buf, unsigned len, uint32_t user_data);
+uring_cqe_t* uring_peek_cqe(uring_t* ring);
+void uring_cqe_seen(uring_t* ring);
+
+// newlib only defines these types when built with threads or for POSIX.1c.
+#if !defined(_POSIX_THREADS) && !(defined(_SYS__PTHREADTYPES_H_) && __POSIX_VISIBLE >= 199506)
+typedef uint32_t pthread_t;
+typedef struct {
+	int unused;
+} pthread_attr_t;
+typedef uint32_t pthread_mutex_t;
+typedef struct {
+	int unused;
+} pthread_mutexattr_t;
+typedef uint32_t pthread_cond_t;
+typedef struct {
+	int unused;
+} pthread_condattr_t;
+#endif
+
+#ifndef PTHREAD_MUTEX_INITIALIZER
+#define PTHREAD_MUTEX_INITIALIZER 	0
+#endif
+#ifndef PTHREAD_COND_INITIALIZER
+#define PTHREAD_COND_INITIALIZER 	0
+#endif
+
+int pthread_create(pthread_t* thread, const pthread_attr_t* attr, void* (*start_routine)(void*), void* arg);
+int pthread_join(pthread_t thread, void** retval);
+void pthread_exit(void* retval);
+pthread_t pthread_self();
+
+int pthread_mutex_init(pthread_mutex_t* mutex, const pthread_mutexattr_t* attr);
+int pthread_mutex_destroy(pthread_mutex_t* mutex);
+int pthread_mutex_lock(pthread_mutex_t* mutex);
+int pthread_mutex_trylock(pthread_mutex_t* mutex);
+int pthread_mutex_unlock(pthread_mutex_t* mutex);
+
+int pthread_cond_init(pthread_cond_t* cond, const pthread_condattr_t* attr);
+int pthread_cond_destroy(pthread_cond_t* cond);
+int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex);
+int pthread_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex, const struct timespec* abstime);
+int pthread_cond_signal(pthread_cond_t* cond);
+int pthread_cond_broadcast(pthread_cond_t* cond);
 
 #endif
@@ -0,0 +1,21 @@
+#ifndef USR_THREADS_H
+#define USR_THREADS_H
+
+/// Must be coherent with Linux' sched.h and futex.h.
+#define CLONE_VM 				0x00000100
+#define CLONE_FS 				0x00000200
+#define CLONE_FILES 			0x00000400
+#define CLONE_SIGHAND 			0x00000800
+#define CLONE_THREAD 			0x00010000
+#define CLONE_PARENT_SETTID 	0x00100000
+#define CLONE_CHILD_CLEARTID 	0x00200000
+
+/// Flags a thread is created with: everything but the stack is shared.
+#define CLONE_THREAD_FLAGS 		(CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | CLONE_THREAD)
+
+#define FUTEX_WAIT 				0
+#define FUTEX_WAKE 				1
+#define FUTEX_PRIVATE_FLAG 		128
+
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef UIO_H
+#define UIO_H
+
+#include <stddef.h>
+
+/**
+ * Buffers of readv and writev. Must be coherent with the kernel (fdsyscalls.c).
+ */
+
+#ifndef IOV_MAX
+/// Most buffers in a single readv or writev.
+#define IOV_MAX 64
+#endif
+
+struct iovec {
+	void* 	iov_base;
+	size_t 	iov_len;
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef USR_URING_H
+#define USR_URING_H
+
+#include <stdint.h>
+
+/**
+ * Submission and completion rings: a program queues requests in memory shared
+ * with the kernel, and runs a whole batch with a single uring_enter call.
+ * Must be coherent with the kernel (uring.c).
+ */
+
+#define URING_OP_NOP 		0
+#define URING_OP_READ 		1 ///< read(fd, addr, len), or pread(fd, addr, len, off)
+#define URING_OP_WRITE 		2 ///< write(fd, addr, len), or pwrite(fd, addr, len, off)
+#define URING_OP_OPENAT 	3 ///< openat(fd, (char*)addr, len)
+#define URING_OP_CLOSE 		4 ///< close(fd)
+
+/// Largest ring.
+#define URING_MAX_ENTRIES 	256
+
+/// A request.
+typedef struct {
+	uint8_t 	opcode;
+	uint8_t 	flags; ///< Must be 0.
+	uint16_t 	reserved;
+	int32_t 	fd;
+	uint32_t 	addr; ///< Buffer, or path for openat.
+	uint32_t 	len; ///< Size of the buffer, or flags for openat.
+	int32_t 	off; ///< Offset in the file, -1 to use and move the file position.
+	uint32_t 	user_data; ///< Given back in the completion.
+} uring_sqe_t;
+
+/// The result of a request.
+typedef struct {
+	uint32_t 	user_data;
+	int32_t 	res; ///< What the system call would return, -errno on failure.
+} uring_cqe_t;
+
+/**
+ * The ring itself. Indices grow forever, entry i is at i & (entries-1). The
+ * program writes the submissions and sq_tail, and reads the completions up
+ * to cq_tail; the kernel does the opposite.
+ */
+typedef struct {
+	uint32_t 			entries; ///< Size of both queues, a power of two.
+	volatile uint32_t 	sq_head;
+	volatile uint32_t 	sq_tail;
+	volatile uint32_t 	cq_head;
+	volatile uint32_t 	cq_tail;
+	uring_sqe_t* 		sqes;
+	uring_cqe_t* 		cqes;
+} uring_t;
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef USR_VDSO_H
+#define USR_VDSO_H
+
+#include <stdint.h>
+
+/// Must be coherent with src/vdso.c
+
+/** \def VDSO_ADDRESS
+ *  \brief Where the kernel data page is mapped (read-only) in every process.
+ */
+#define VDSO_ADDRESS 0x7FF00000
+
+/** \struct vdso_data_t
+ *  \brief Data the kernel publishes to the running process.
+ *
+ *  The time is read from the ARM generic timer, which user mode may read on
+ *  the RPI2: microseconds since boot are
+ *  time_base + (((CNTVCT - counter_base) * mult) >> 32).
+ *  mult is 0 when there is no such counter (RPI1): use the time service call.
+ *
+ *  The kernel makes seq odd while it updates the time fields: a reader
+ *  retries until it gets the same even value before and after its reads.
+ *  The pid is a single word, read as is.
+ */
+typedef struct {
+	volatile uint32_t seq; ///< Sequence counter of the time fields.
+	volatile int32_t pid; ///< Pid of the running process.
+	volatile uint32_t mult; ///< Microseconds per counter tick, in 32.32 fixed point.
+	uint32_t reserved;
+	volatile uint64_t counter_base; ///< Counter value at time_base.
+	volatile uint64_t time_base; ///< Microseconds since boot.
+} vdso_data_t;
+
+
+#endif
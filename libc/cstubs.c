@@ -1,5 +1,6 @@
 #include "stddef.h"
 #include "stdint.h"
+#include "stdbool.h"
 #include "sys/types.h"
 #include "sys/stat.h"
 #include <fcntl.h>
@@ -10,12 +11,83 @@
 #include "errno.h"
 #include "../include/syscalls.h"
 #include "../include/dirent.h"
+#include "../include/clocks.h"
+#include "../include/vdso.h"
 
 int argc;
 char **argv;
 char **environ;
 
+// Directory entries read ahead by _getdents, per file descriptor. Dropped
+// when the descriptor is closed, replaced or moved. The kernel offset is
+// shared by duplicates, so it is moved back to the first unread entry before
+// a dup (see dirbuf_sync).
+#define DIRBUF_FDS 	1024
+#define DIRBUF_SIZE 2048
+
+typedef struct {
+	int pos;
+	int len;
+	char data[DIRBUF_SIZE] __attribute__((aligned(8)));
+} dirbuf_t;
+
+static dirbuf_t* dirbufs[DIRBUF_FDS];
+
+static void dirbuf_drop(int fd) {
+	if (fd >= 0 && fd < DIRBUF_FDS && dirbufs[fd] != NULL) {
+		free(dirbufs[fd]);
+		dirbufs[fd] = NULL;
+	}
+}
+
+// Before the directory offset is shared with another descriptor, move it back
+// to the first entry read ahead but not returned yet, and drop the buffer.
+static void dirbuf_sync(int fd) {
+	if (fd < 0 || fd >= DIRBUF_FDS || dirbufs[fd] == NULL) {
+		return;
+	}
+	dirbuf_t* buf = dirbufs[fd];
+	if (buf->pos < buf->len) {
+		struct dirent64* entry = (struct dirent64*)(buf->data + buf->pos);
+		_lseek(fd, entry->d_off - 1, SEEK_SET); // Drops the buffer.
+	} else {
+		dirbuf_drop(fd);
+	}
+}
+
+// Kernel data page, read without any service call.
+static const vdso_data_t* vdso = (const vdso_data_t*)VDSO_ADDRESS;
+
+// Microseconds since boot, from the ARM generic timer scaled as the kernel
+// publishes it (see vdso_data_t). false if the kernel publishes no counter
+// (RPI1): then use a service call.
+static bool vdso_time(uint64_t* us) {
+	uint32_t seq;
+	uint32_t mult;
+	uint64_t counter_base;
+	uint64_t time_base;
+	do {
+		seq 			= vdso->seq;
+		mult 			= vdso->mult;
+		counter_base 	= vdso->counter_base;
+		time_base 		= vdso->time_base;
+	} while ((seq & 1) || seq != vdso->seq);
+	if (mult == 0) {
+		return false;
+	}
+	uint64_t count;
+	asm volatile("mrrc p15, 1, %Q0, %R0, c14" : "=r" (count)); // CNTVCT
+	// (delta * mult) >> 32 without overflowing 64 bits.
+	uint64_t delta = count - counter_base;
+	*us = time_base + (delta >> 32) * mult + (((delta & 0xFFFFFFFF) * mult) >> 32);
+	return true;
+}
+
 int _time() {
+	uint64_t us;
+	if (vdso_time(&us)) {
+		return (int)us; // Same clock as the service call.
+	}
 	int res;
 	asm volatile(
 				"push 	{r7}\n"
@@ -27,14 +99,7 @@ int _time() {
 }
 
 int _getpid() {
-	int res;
-	asm volatile(
-				"push 	{r7}\n"
-				"ldr 	r7, =#0x14\n"
-				"svc 	#0\n"
-				"pop	{r7}\n"
-				"mov 	%0, r0\n" : "=r" (res) : :);
-	return res;
+	return vdso->pid;
 }
 
 char* get_framebuffer(int pid) {
@@ -84,17 +149,84 @@ int sigreturn() {
 
 int sigaction(int signum, void (*handler)(int), siginfo_t* siginfo) {
 	int res;
+	void (*restorer)(void) = (void (*)(void))sigreturn;
 	asm volatile(
 					"push 	{r7}\n"
 					"ldr 	r0, %1\n"
 					"ldr 	r1, %2\n"
 					"ldr 	r2, %3\n"
+					"ldr 	r3, %4\n"
 					"ldr 	r7, =#0x43\n"
 					"svc 	#0\n"
 					"pop 	{r7}\n"
 					"mov 	%0, r0\n"
 					: "=r" (res)
-					: "m" (signum), "m" (handler), "m" (siginfo)
+					: "m" (signum), "m" (handler), "m" (siginfo), "m" (restorer)
+					:
+	);
+	if (res < 0) {
+		errno = -res;
+		return -1;
+	}
+	return res;
+}
+
+int sigprocmask(int how, const sigset_t* set, sigset_t* oldset) {
+	int res;
+	asm volatile(
+					"push 	{r7}\n"
+					"ldr 	r0, %1\n"
+					"ldr 	r1, %2\n"
+					"ldr 	r2, %3\n"
+					"ldr 	r7, =#0x7e\n"
+					"svc 	#0\n"
+					"pop 	{r7}\n"
+					"mov 	%0, r0\n"
+					: "=r" (res)
+					: "m" (how), "m" (set), "m" (oldset)
+					:
+	);
+	if (res < 0) {
+		errno = -res;
+		return -1;
+	}
+	return res;
+}
+
+int sigpending(sigset_t* set) {
+	int res;
+	asm volatile(
+					"push 	{r7}\n"
+					"ldr 	r0, %1\n"
+					"ldr 	r7, =#0x49\n"
+					"svc 	#0\n"
+					"pop 	{r7}\n"
+					"mov 	%0, r0\n"
+					: "=r" (res)
+					: "m" (set)
+					:
+	);
+	if (res < 0) {
+		errno = -res;
+		return -1;
+	}
+	return res;
+}
+
+int sigqueue(pid_t pid, int sig, const sigval_t value) {
+	int res;
+	int val = value.sival_int;
+	asm volatile(
+					"push 	{r7}\n"
+					"ldr 	r0, %1\n"
+					"ldr 	r1, %2\n"
+					"ldr 	r2, %3\n"
+					"ldr 	r7, =#0xb2\n"
+					"svc 	#0\n"
+					"pop 	{r7}\n"
+					"mov 	%0, r0\n"
+					: "=r" (res)
+					: "m" (pid), "m" (sig), "m" (val)
 					:
 	);
 	if (res < 0) {
@@ -128,6 +260,7 @@ int _kill(pid_t pid, int sig) {
 // 0x29
 int dup(int oldfd) {
 	int res;
+	dirbuf_sync(oldfd);
 	asm volatile(
 					"push 	{r7}\n"
 					"ldr 	r0, %1\n"
@@ -149,6 +282,8 @@ int dup(int oldfd) {
 // 0x3f
 int dup2(int oldfd, int newfd) {
 	int res;
+	dirbuf_sync(oldfd);
+	dirbuf_drop(newfd);
 	asm volatile(
 					"push 	{r7}\n"
 					"ldr 	r0, %1\n"
@@ -216,7 +351,7 @@ void software_init_hook() {
 // 0x01:
 void _exit(int error_code) {
     asm volatile(   "push {r7}\n"
-					"mov r7, #0x01\n"
+					"mov r7, #0xf8\n" // exit_group: every thread goes
                     "svc #0\n"
 					"pop {r7}\n");
     while(1){} // wait for your death
@@ -325,27 +460,73 @@ int _open(char* path, int flags) {
 	return _openat(AT_FDCWD, path, flags);
 }
 
-// 78
-int _getdents(int fd, struct dirent* user_dirent) {
+// 0xd9
+int getdents64(int fd, struct dirent64* dirp, size_t count) {
 	int res;
 	asm volatile(
 					"push 	{r7}\n"
 					"ldr 	r0, %1\n"
 					"ldr 	r1, %2\n"
-					"mov 	r7, #78\n"
+					"ldr 	r2, %3\n"
+					"ldr 	r7, =#0xd9\n"
 					"svc 	#0\n"
 					"pop 	{r7}\n"
 					"mov 	%0, r0\n"
 					: "=r" (res)
-					: "m" (fd), "m" (user_dirent)
+					: "m" (fd), "m" (dirp), "m" (count)
 					:
 	);
 	if (res < 0) {
 		errno = -res;
+		return -1;
 	}
 	return res;
 }
 
+// Returns 0 with the next entry, 1 at the end of the directory, -1 on error.
+// Entries are fetched with getdents64, a buffer at a time. d_type only holds
+// the file type bits of st_mode (S_IFDIR, ...), not the permissions: use stat
+// on the entry for those.
+int _getdents(int fd, struct dirent* user_dirent) {
+	if (fd < 0 || fd >= DIRBUF_FDS) {
+		errno = EBADF;
+		return -1;
+	}
+	if (dirbufs[fd] == NULL) {
+		dirbufs[fd] = malloc(sizeof(dirbuf_t));
+		if (dirbufs[fd] == NULL) {
+			errno = ENOMEM;
+			return -1;
+		}
+		dirbufs[fd]->pos = 0;
+		dirbufs[fd]->len = 0;
+	}
+
+	dirbuf_t* buf = dirbufs[fd];
+	if (buf->pos == buf->len) {
+		int n = getdents64(fd, (struct dirent64*)buf->data, DIRBUF_SIZE);
+		if (n < 0) {
+			return -1;
+		}
+		buf->pos = 0;
+		buf->len = n;
+		if (n == 0) {
+			return 1;
+		}
+	}
+
+	struct dirent64* entry = (struct dirent64*)(buf->data + buf->pos);
+	buf->pos += entry->d_reclen;
+
+	user_dirent->d_ino 		= entry->d_ino;
+	user_dirent->d_off 		= entry->d_off;
+	user_dirent->d_reclen 	= sizeof(struct dirent);
+	user_dirent->d_type 	= DTTOIF(entry->d_type);
+	strncpy(user_dirent->d_name, entry->d_name, sizeof(user_dirent->d_name) - 1);
+	user_dirent->d_name[sizeof(user_dirent->d_name) - 1] = 0;
+	return 0;
+}
+
 // 0x0b:
 int _execve(const char *filename, char *const argv[],
                   char *const envp[]) {
@@ -453,6 +634,7 @@ ssize_t _write(int fd, const void* buf, size_t count) {
 // 0x06
 int _close(int fd) {
     int res;
+	dirbuf_drop(fd);
     asm volatile(
 					"push {r7}\n"
 					"mov r0, %1\n"
@@ -528,6 +710,7 @@ pid_t _wait(int *wstatus) {
 // 0x13
 off_t _lseek(int fd, off_t offset, int whence) {
     off_t res;
+	dirbuf_drop(fd);
     asm volatile(
 					"push {r7}\n"
 					"ldr r0, %1\n"
@@ -587,3 +770,322 @@ ssize_t _read(int fd, void* buf, size_t count) {
 	}
     return res;
 }
+
+// 0x91
+ssize_t readv(int fd, const struct iovec* iov, int iovcnt) {
+	ssize_t res;
+    asm volatile(
+					"push {r7}\n"
+					"ldr r0, %1\n"
+                    "ldr r1, %2\n"
+                    "ldr r2, %3\n"
+                    "ldr r7, =#0x91\n"
+                    "svc #0\n"
+					"pop {r7}\n"
+                    "mov %0, r0\n"
+                :   "=r" (res)
+                :   "m" (fd), "m" (iov), "m" (iovcnt)
+                :);
+	if (res < 0) {
+		errno = -res;
+	}
+    return res;
+}
+
+// 0x92
+ssize_t writev(int fd, const struct iovec* iov, int iovcnt) {
+	ssize_t res;
+    asm volatile(
+					"push {r7}\n"
+					"ldr r0, %1\n"
+                    "ldr r1, %2\n"
+                    "ldr r2, %3\n"
+                    "ldr r7, =#0x92\n"
+                    "svc #0\n"
+					"pop {r7}\n"
+                    "mov %0, r0\n"
+                :   "=r" (res)
+                :   "m" (fd), "m" (iov), "m" (iovcnt)
+                :);
+	if (res < 0) {
+		errno = -res;
+	}
+    return res;
+}
+
+// 0xb4
+ssize_t pread(int fd, void* buf, size_t count, off_t offset) {
+	ssize_t res;
+    asm volatile(
+					"push {r7}\n"
+					"ldr r0, %1\n"
+                    "ldr r1, %2\n"
+                    "ldr r2, %3\n"
+                    "ldr r3, %4\n"
+                    "ldr r7, =#0xb4\n"
+                    "svc #0\n"
+					"pop {r7}\n"
+                    "mov %0, r0\n"
+                :   "=r" (res)
+                :   "m" (fd), "m" (buf), "m" (count), "m" (offset)
+                :);
+	if (res < 0) {
+		errno = -res;
+	}
+    return res;
+}
+
+// 0xb5
+ssize_t pwrite(int fd, const void* buf, size_t count, off_t offset) {
+	ssize_t res;
+    asm volatile(
+					"push {r7}\n"
+					"ldr r0, %1\n"
+                    "ldr r1, %2\n"
+                    "ldr r2, %3\n"
+                    "ldr r3, %4\n"
+                    "ldr r7, =#0xb5\n"
+                    "svc #0\n"
+					"pop {r7}\n"
+                    "mov %0, r0\n"
+                :   "=r" (res)
+                :   "m" (fd), "m" (buf), "m" (count), "m" (offset)
+                :);
+	if (res < 0) {
+		errno = -res;
+	}
+    return res;
+}
+
+// 0xbb
+ssize_t sendfile(int out_fd, int in_fd, off_t* offset, size_t count) {
+	ssize_t res;
+    asm volatile(
+					"push {r7}\n"
+					"ldr r0, %1\n"
+                    "ldr r1, %2\n"
+                    "ldr r2, %3\n"
+                    "ldr r3, %4\n"
+                    "ldr r7, =#0xbb\n"
+                    "svc #0\n"
+					"pop {r7}\n"
+                    "mov %0, r0\n"
+                :   "=r" (res)
+                :   "m" (out_fd), "m" (in_fd), "m" (offset), "m" (count)
+                :);
+	if (res < 0) {
+		errno = -res;
+	}
+    return res;
+}
+
+// 0x109
+int clock_nanosleep(clockid_t clock_id, int flags, const struct timespec* req, struct timespec* rem) {
+	int res;
+	asm volatile(
+					"push {r7}\n"
+					"ldr r0, %1\n"
+					"ldr r1, %2\n"
+					"ldr r2, %3\n"
+					"ldr r3, %4\n"
+					"ldr r7, =#0x109\n"
+					"svc #0\n"
+					"pop {r7}\n"
+					"mov %0, r0\n"
+				:   "=r" (res)
+				:   "m" (clock_id), "m" (flags), "m" (req), "m" (rem)
+				:);
+	return res; // The error number, errno is left untouched.
+}
+
+// 0xa2
+int nanosleep(const struct timespec* req, struct timespec* rem) {
+	int res;
+	asm volatile(
+					"push {r7}\n"
+					"ldr r0, %1\n"
+					"ldr r1, %2\n"
+					"ldr r7, =#0xa2\n"
+					"svc #0\n"
+					"pop {r7}\n"
+					"mov %0, r0\n"
+				:   "=r" (res)
+				:   "m" (req), "m" (rem)
+				:);
+	if (res < 0) {
+		errno = -res;
+		return -1;
+	}
+	return res;
+}
+
+int usleep(useconds_t usec) {
+	struct timespec req;
+	req.tv_sec 	= usec / 1000000;
+	req.tv_nsec = (usec % 1000000) * 1000;
+	return nanosleep(&req, NULL);
+}
+
+unsigned sleep(unsigned seconds) {
+	struct timespec req, rem;
+	req.tv_sec 	= seconds;
+	req.tv_nsec = 0;
+	if (nanosleep(&req, &rem) < 0) {
+		return rem.tv_sec + (rem.tv_nsec > 0);
+	}
+	return 0;
+}
+
+// 0x107
+int clock_gettime(clockid_t clock_id, struct timespec* tp) {
+	uint64_t us;
+	if ((clock_id == CLOCK_MONOTONIC || clock_id == CLOCK_REALTIME) && tp != NULL && vdso_time(&us)) {
+		tp->tv_sec 	= us / 1000000;
+		tp->tv_nsec = (us % 1000000) * 1000;
+		return 0;
+	}
+	int res;
+	asm volatile(
+					"push {r7}\n"
+					"ldr r0, %1\n"
+					"ldr r1, %2\n"
+					"ldr r7, =#0x107\n"
+					"svc #0\n"
+					"pop {r7}\n"
+					"mov %0, r0\n"
+				:   "=r" (res)
+				:   "m" (clock_id), "m" (tp)
+				:);
+	if (res < 0) {
+		errno = -res;
+		return -1;
+	}
+	return res;
+}
+
+int _gettimeofday(struct timeval* tv, void* tz) {
+	(void) tz;
+	struct timespec ts;
+	if (clock_gettime(CLOCK_REALTIME, &ts) < 0) {
+		return -1;
+	}
+	if (tv != NULL) {
+		tv->tv_sec 	= ts.tv_sec;
+		tv->tv_usec = ts.tv_nsec / 1000;
+	}
+	return 0;
+}
+
+// 0xe0
+pid_t gettid() {
+	pid_t res;
+	asm volatile(
+					"push {r7}\n"
+					"ldr r7, =#0xe0\n"
+					"svc #0\n"
+					"pop {r7}\n"
+					"mov %0, r0\n"
+				:   "=r" (res)
+				:
+				:);
+	return res;
+}
+
+// 0xf0
+int futex(int* uaddr, int op, int val, const struct timespec* timeout) {
+	int res;
+	asm volatile(
+					"push {r7}\n"
+					"ldr r0, %1\n"
+					"ldr r1, %2\n"
+					"ldr r2, %3\n"
+					"ldr r3, %4\n"
+					"ldr r7, =#0xf0\n"
+					"svc #0\n"
+					"pop {r7}\n"
+					"mov %0, r0\n"
+				:   "=r" (res)
+				:   "m" (uaddr), "m" (op), "m" (val), "m" (timeout)
+				:   "memory");
+	if (res < 0) {
+		errno = -res;
+		return -1;
+	}
+	return res;
+}
+
+// 0x78
+int clone(int (*fn)(void*), void* stack, int flags, void* arg, pid_t* ptid, pid_t* ctid) {
+	// The new thread finds what to run on top of its stack.
+	void** sp = (void**)stack;
+	*--sp = arg;
+	*--sp = (void*)fn;
+
+	int res;
+	asm volatile(
+					"ldr r0, %1\n"
+					"ldr r1, %2\n"
+					"ldr r2, %3\n"
+					"ldr r3, %4\n"
+					"push {r7}\n"
+					"ldr r7, =#0x78\n"
+					"svc #0\n"
+					"cmp r0, #0\n"
+					"bne 1f\n"
+					"pop {r2, r3}\n" // New thread: r2 = fn, r3 = arg.
+					"mov r0, r3\n"
+					"blx r2\n"
+					"ldr r7, =#0x01\n" // Only this thread exits.
+					"svc #0\n"
+					"1:\n"
+					"pop {r7}\n"
+					"mov %0, r0\n"
+				:   "=r" (res)
+				:   "m" (flags), "m" (sp), "m" (ptid), "m" (ctid)
+				:   "r0", "r1", "r2", "r3", "lr", "memory");
+	if (res < 0) {
+		errno = -res;
+		return -1;
+	}
+	return res;
+}
+
+// 0x4d
+int getrusage(int who, struct rusage* usage) {
+	int res;
+	asm volatile(
+					"push {r7}\n"
+					"ldr r0, %1\n"
+					"ldr r1, %2\n"
+					"ldr r7, =#0x4d\n"
+					"svc #0\n"
+					"pop {r7}\n"
+					"mov %0, r0\n"
+				:   "=r" (res)
+				:   "m" (who), "m" (usage)
+				:);
+	if (res < 0) {
+		errno = -res;
+		return -1;
+	}
+	return res;
+}
+
+static clock_t timeval_to_clock(struct timeval* tv) {
+	return tv->tv_sec * CLOCKS_PER_SEC + tv->tv_usec / (1000000 / CLOCKS_PER_SEC);
+}
+
+clock_t _times(struct tms* buf) {
+	struct rusage self, children;
+	if (getrusage(RUSAGE_SELF, &self) < 0 || getrusage(RUSAGE_CHILDREN, &children) < 0) {
+		return (clock_t)-1;
+	}
+	buf->tms_utime 	= timeval_to_clock(&self.ru_utime);
+	buf->tms_stime 	= timeval_to_clock(&self.ru_stime);
+	buf->tms_cutime = timeval_to_clock(&children.ru_utime);
+	buf->tms_cstime = timeval_to_clock(&children.ru_stime);
+
+	struct timespec now; // Elapsed time since boot.
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * CLOCKS_PER_SEC + now.tv_nsec / (1000000000 / CLOCKS_PER_SEC);
+}
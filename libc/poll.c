@@ -0,0 +1,165 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/select.h>
+#include "../include/syscalls.h"
+
+/** \file poll.c
+ *  \brief Waiting for several file descriptors at once. select is built on
+ *  top of poll. epoll keeps the watched files in the kernel.
+ */
+
+// 0xa8
+int poll(struct pollfd* fds, nfds_t nfds, int timeout) {
+	int res;
+	asm volatile(
+					"push 	{r7}\n"
+					"ldr 	r0, %1\n"
+					"ldr 	r1, %2\n"
+					"ldr 	r2, %3\n"
+					"ldr 	r7, =#0xa8\n"
+					"svc 	#0\n"
+					"pop 	{r7}\n"
+					"mov 	%0, r0\n"
+					: "=r" (res)
+					: "m" (fds), "m" (nfds), "m" (timeout)
+					:);
+	if (res < 0) {
+		errno = -res;
+		return -1;
+	}
+	return res;
+}
+
+int select(int n, fd_set* readfds, fd_set* writefds, fd_set* exceptfds, struct timeval* timeout) {
+	if (n < 0 || n > FD_SETSIZE) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	struct pollfd fds[n > 0 ? n : 1];
+	nfds_t nfds = 0;
+	for (int fd=0;fd<n;fd++) {
+		short events = 0;
+		if (readfds != NULL && FD_ISSET(fd, readfds)) {
+			events |= POLLIN;
+		}
+		if (writefds != NULL && FD_ISSET(fd, writefds)) {
+			events |= POLLOUT;
+		}
+		if (exceptfds != NULL && FD_ISSET(fd, exceptfds)) {
+			events |= POLLPRI;
+		}
+		if (events != 0) {
+			fds[nfds].fd 		= fd;
+			fds[nfds].events 	= events;
+			fds[nfds].revents 	= 0;
+			nfds++;
+		}
+	}
+
+	int ms = -1;
+	if (timeout != NULL) { // Rounded up, so that select never returns early.
+		ms = timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+	}
+
+	int res = poll(fds, nfds, ms);
+	if (res < 0) {
+		return -1;
+	}
+
+	if (readfds != NULL) {
+		FD_ZERO(readfds);
+	}
+	if (writefds != NULL) {
+		FD_ZERO(writefds);
+	}
+	if (exceptfds != NULL) {
+		FD_ZERO(exceptfds);
+	}
+	int count = 0;
+	for (nfds_t i=0;i<nfds;i++) {
+		if (fds[i].revents & POLLNVAL) {
+			errno = EBADF;
+			return -1;
+		}
+		if ((fds[i].events & POLLIN) && (fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+			FD_SET(fds[i].fd, readfds);
+			count++;
+		}
+		if ((fds[i].events & POLLOUT) && (fds[i].revents & (POLLOUT | POLLERR))) {
+			FD_SET(fds[i].fd, writefds);
+			count++;
+		}
+		if (fds[i].revents & POLLPRI) {
+			FD_SET(fds[i].fd, exceptfds);
+			count++;
+		}
+	}
+	return count;
+}
+
+// 0xfa
+int epoll_create(int size) {
+	int res;
+	asm volatile(
+					"push 	{r7}\n"
+					"ldr 	r0, %1\n"
+					"ldr 	r7, =#0xfa\n"
+					"svc 	#0\n"
+					"pop 	{r7}\n"
+					"mov 	%0, r0\n"
+					: "=r" (res)
+					: "m" (size)
+					:);
+	if (res < 0) {
+		errno = -res;
+		return -1;
+	}
+	return res;
+}
+
+// 0xfb
+int epoll_ctl(int epfd, int op, int fd, struct epoll_event* event) {
+	int res;
+	asm volatile(
+					"push 	{r7}\n"
+					"ldr 	r0, %1\n"
+					"ldr 	r1, %2\n"
+					"ldr 	r2, %3\n"
+					"ldr 	r3, %4\n"
+					"ldr 	r7, =#0xfb\n"
+					"svc 	#0\n"
+					"pop 	{r7}\n"
+					"mov 	%0, r0\n"
+					: "=r" (res)
+					: "m" (epfd), "m" (op), "m" (fd), "m" (event)
+					:);
+	if (res < 0) {
+		errno = -res;
+		return -1;
+	}
+	return res;
+}
+
+// 0xfc
+int epoll_wait(int epfd, struct epoll_event* events, int maxevents, int timeout) {
+	int res;
+	asm volatile(
+					"push 	{r7}\n"
+					"ldr 	r0, %1\n"
+					"ldr 	r1, %2\n"
+					"ldr 	r2, %3\n"
+					"ldr 	r3, %4\n"
+					"ldr 	r7, =#0xfc\n"
+					"svc 	#0\n"
+					"pop 	{r7}\n"
+					"mov 	%0, r0\n"
+					: "=r" (res)
+					: "m" (epfd), "m" (events), "m" (maxevents), "m" (timeout)
+					:);
+	if (res < 0) {
+		errno = -res;
+		return -1;
+	}
+	return res;
+}
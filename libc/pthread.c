@@ -0,0 +1,227 @@
+#include "stddef.h"
+#include "stdbool.h"
+#include "stdint.h"
+#include "stdlib.h"
+#include "malloc.h"
+#include "errno.h"
+#include "limits.h"
+#include "unistd.h"
+#include "../include/syscalls.h"
+
+/** \file pthread.c
+ *  \brief A subset of POSIX threads, on top of clone and futex.
+ *
+ *  Attributes are not supported (attr must be NULL) and threads can't be
+ *  detached: every thread has to be joined to release its stack.
+ */
+
+/** \def THREAD_STACK_SIZE
+ *  \brief Size of a thread's stack, which is also its alignment.
+ */
+#define THREAD_STACK_SIZE (64*1024)
+
+/** \struct thread_t
+ *  \brief Thread descriptor, stored at the bottom of the thread's stack.
+ */
+typedef struct {
+	volatile pid_t tid; ///< Thread ID, cleared by the kernel when the thread exits.
+	void* (*start_routine)(void*);
+	void* arg;
+	void* retval; ///< Value returned to pthread_join.
+} thread_t;
+
+static int thread_start(void* arg) {
+	thread_t* self = arg;
+	self->retval = self->start_routine(self->arg);
+	return 0;
+}
+
+int pthread_create(pthread_t* thread, const pthread_attr_t* attr, void* (*start_routine)(void*), void* arg) {
+	if (attr != NULL) {
+		return EINVAL;
+	}
+	thread_t* t = memalign(THREAD_STACK_SIZE, THREAD_STACK_SIZE);
+	if (t == NULL) {
+		return EAGAIN;
+	}
+	t->start_routine = start_routine;
+	t->arg = arg;
+	t->retval = NULL;
+
+	// The kernel sets tid before the thread runs, and clears it on exit.
+	int flags = CLONE_THREAD_FLAGS | CLONE_PARENT_SETTID | CLONE_CHILD_CLEARTID;
+	if (clone(thread_start, (char*)t + THREAD_STACK_SIZE, flags, t, (pid_t*)&t->tid, (pid_t*)&t->tid) < 0) {
+		int err = errno;
+		free(t);
+		return err;
+	}
+	*thread = (pthread_t)(uintptr_t)t;
+	return 0;
+}
+
+int pthread_join(pthread_t thread, void** retval) {
+	thread_t* t = (thread_t*)(uintptr_t)thread;
+	if (t == NULL) {
+		return EINVAL;
+	}
+	pid_t tid;
+	while ((tid = t->tid) != 0) {
+		futex((int*)&t->tid, FUTEX_WAIT | FUTEX_PRIVATE_FLAG, tid, NULL);
+	}
+	if (retval != NULL) {
+		*retval = t->retval;
+	}
+	free(t);
+	return 0;
+}
+
+pthread_t pthread_self() {
+	if (gettid() == getpid()) {
+		return 0; // The main thread has no descriptor.
+	}
+	uintptr_t sp;
+	asm volatile("mov %0, sp" : "=r" (sp));
+	return (pthread_t)(sp & ~(uintptr_t)(THREAD_STACK_SIZE-1));
+}
+
+void pthread_exit(void* retval) {
+	thread_t* self = (thread_t*)(uintptr_t)pthread_self();
+	if (self == NULL) {
+		exit(0);
+	}
+	self->retval = retval;
+	asm volatile(
+					"mov r0, #0\n"
+					"mov r7, #0x01\n" // Only this thread exits.
+					"svc #0\n"
+				:
+				:
+				:   "r0", "r7");
+	while(1) {}
+}
+
+/*
+ * Mutexes hold 0 when unlocked, 1 when locked and 2 when locked with possible
+ * waiters. Only the last state makes lock and unlock enter the kernel.
+ */
+int pthread_mutex_init(pthread_mutex_t* mutex, const pthread_mutexattr_t* attr) {
+	(void) attr;
+	*(int*)mutex = 0;
+	return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t* mutex) {
+	return *(int*)mutex == 0 ? 0 : EBUSY;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t* mutex) {
+	int* m = (int*)mutex;
+	int c = 0;
+	if (__atomic_compare_exchange_n(m, &c, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		return 0;
+	}
+	return EBUSY;
+}
+
+int pthread_mutex_lock(pthread_mutex_t* mutex) {
+	int* m = (int*)mutex;
+	int c = 0;
+	if (__atomic_compare_exchange_n(m, &c, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		return 0; // Uncontended.
+	}
+	if (c != 2) {
+		c = __atomic_exchange_n(m, 2, __ATOMIC_ACQUIRE);
+	}
+	while (c != 0) {
+		futex(m, FUTEX_WAIT | FUTEX_PRIVATE_FLAG, 2, NULL);
+		c = __atomic_exchange_n(m, 2, __ATOMIC_ACQUIRE);
+	}
+	return 0;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t* mutex) {
+	int* m = (int*)mutex;
+	if (__atomic_fetch_sub(m, 1, __ATOMIC_RELEASE) != 1) {
+		__atomic_store_n(m, 0, __ATOMIC_RELEASE);
+		futex(m, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, 1, NULL);
+	}
+	return 0;
+}
+
+/*
+ * Condition variables are a single word: the low bits count the threads
+ * waiting, the others are a sequence number incremented on each signal. With
+ * no waiter left, signaling doesn't enter the kernel. A waiter arriving or
+ * leaving also changes the word, which can at worst end another thread's wait
+ * early: callers check their predicate again anyway.
+ */
+#define COND_WAITER 	1
+#define COND_WAITERS 	0xFFF
+#define COND_SEQ 		(COND_WAITERS + 1)
+
+int pthread_cond_init(pthread_cond_t* cond, const pthread_condattr_t* attr) {
+	(void) attr;
+	*(int*)cond = 0;
+	return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t* cond) {
+	(void) cond;
+	return 0;
+}
+
+int pthread_cond_timedwait(pthread_cond_t* cond, pthread_mutex_t* mutex, const struct timespec* abstime) {
+	int* c = (int*)cond;
+	struct timespec timeout;
+	if (abstime != NULL) {
+		struct timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+		timeout.tv_sec 	= abstime->tv_sec - now.tv_sec;
+		timeout.tv_nsec = abstime->tv_nsec - now.tv_nsec;
+		if (timeout.tv_nsec < 0) {
+			timeout.tv_sec--;
+			timeout.tv_nsec += 1000000000;
+		}
+		if (timeout.tv_sec < 0) {
+			return ETIMEDOUT;
+		}
+	}
+
+	int seq = __atomic_add_fetch(c, COND_WAITER, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(mutex);
+	int res = futex(c, FUTEX_WAIT | FUTEX_PRIVATE_FLAG, seq, abstime != NULL ? &timeout : NULL);
+	int err = errno;
+	__atomic_sub_fetch(c, COND_WAITER, __ATOMIC_RELAXED);
+
+	// Other waiters may be left: take the mutex as contended, so that its
+	// release wakes them up one after the other.
+	int* m = (int*)mutex;
+	while (__atomic_exchange_n(m, 2, __ATOMIC_ACQUIRE) != 0) {
+		futex(m, FUTEX_WAIT | FUTEX_PRIVATE_FLAG, 2, NULL);
+	}
+	return (res < 0 && err == ETIMEDOUT) ? ETIMEDOUT : 0;
+}
+
+int pthread_cond_wait(pthread_cond_t* cond, pthread_mutex_t* mutex) {
+	return pthread_cond_timedwait(cond, mutex, NULL);
+}
+
+int pthread_cond_signal(pthread_cond_t* cond) {
+	int* c = (int*)cond;
+	if ((__atomic_load_n(c, __ATOMIC_RELAXED) & COND_WAITERS) == 0) {
+		return 0; // No waiter.
+	}
+	__atomic_add_fetch(c, COND_SEQ, __ATOMIC_RELEASE);
+	futex(c, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, 1, NULL);
+	return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t* cond) {
+	int* c = (int*)cond;
+	if ((__atomic_load_n(c, __ATOMIC_RELAXED) & COND_WAITERS) == 0) {
+		return 0; // No waiter.
+	}
+	__atomic_add_fetch(c, COND_SEQ, __ATOMIC_RELEASE);
+	futex(c, FUTEX_WAKE | FUTEX_PRIVATE_FLAG, INT_MAX, NULL);
+	return 0;
+}
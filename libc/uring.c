@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <errno.h>
+#include "../include/syscalls.h"
+
+/** \file uring.c
+ *  \brief Helpers to batch system calls through a ring (see include/uring.h).
+ */
+
+int uring_enter(uring_t* ring, unsigned min_complete) {
+	int res;
+	asm volatile(
+					"push 	{r7}\n"
+					"ldr 	r0, %1\n"
+					"ldr 	r1, %2\n"
+					"ldr 	r7, =#0x1aa\n"
+					"svc 	#0\n"
+					"pop 	{r7}\n"
+					"mov 	%0, r0\n"
+					: "=r" (res)
+					: "m" (ring), "m" (min_complete)
+					:
+	);
+	if (res < 0) {
+		errno = -res;
+		return -1;
+	}
+	return res;
+}
+
+/** \fn int uring_init(uring_t* ring, unsigned entries)
+ *  \brief Allocate the queues of a ring.
+ *  \param entries Size of the queues, a power of two up to URING_MAX_ENTRIES.
+ *  \return 0 on success, -1 with errno set on failure.
+ */
+int uring_init(uring_t* ring, unsigned entries) {
+	if (entries == 0 || entries > URING_MAX_ENTRIES || (entries & (entries - 1)) != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	ring->sqes = malloc(entries * sizeof(uring_sqe_t));
+	ring->cqes = malloc(entries * sizeof(uring_cqe_t));
+	if (ring->sqes == NULL || ring->cqes == NULL) {
+		free(ring->sqes);
+		free(ring->cqes);
+		errno = ENOMEM;
+		return -1;
+	}
+	ring->entries 	= entries;
+	ring->sq_head 	= 0;
+	ring->sq_tail 	= 0;
+	ring->cq_head 	= 0;
+	ring->cq_tail 	= 0;
+	return 0;
+}
+
+/** \fn void uring_free(uring_t* ring)
+ *  \brief Release the queues of a ring, which has no request in flight.
+ */
+void uring_free(uring_t* ring) {
+	free(ring->sqes);
+	free(ring->cqes);
+	ring->sqes = NULL;
+	ring->cqes = NULL;
+}
+
+/** \fn uring_sqe_t* uring_get_sqe(uring_t* ring)
+ *  \brief Reserve the next submission. It is sent by the next uring_enter.
+ *  \return The submission to fill, with off set to -1, NULL if the queue is full.
+ */
+uring_sqe_t* uring_get_sqe(uring_t* ring) {
+	if (ring->sq_tail - ring->sq_head >= ring->entries) {
+		return NULL;
+	}
+	uring_sqe_t* sqe = &ring->sqes[ring->sq_tail & (ring->entries - 1)];
+	sqe->opcode 	= URING_OP_NOP;
+	sqe->flags 		= 0;
+	sqe->reserved 	= 0;
+	sqe->fd 		= -1;
+	sqe->addr 		= 0;
+	sqe->len 		= 0;
+	sqe->off 		= -1;
+	sqe->user_data 	= 0;
+	ring->sq_tail++;
+	return sqe;
+}
+
+/** \fn void uring_prep_rw(uring_sqe_t* sqe, int opcode, int fd, void* buf, unsigned len, uint32_t user_data)
+ *  \brief Fill a read or write submission.
+ */
+void uring_prep_rw(uring_sqe_t* sqe, int opcode, int fd, void* buf, unsigned len, uint32_t user_data) {
+	sqe->opcode 	= opcode;
+	sqe->fd 		= fd;
+	sqe->addr 		= (uint32_t)buf;
+	sqe->len 		= len;
+	sqe->user_data 	= user_data;
+}
+
+/** \fn uring_cqe_t* uring_peek_cqe(uring_t* ring)
+ *  \brief Oldest completion not seen yet.
+ *  \return The completion, NULL if there is none.
+ */
+uring_cqe_t* uring_peek_cqe(uring_t* ring) {
+	if (ring->cq_head == ring->cq_tail) {
+		return NULL;
+	}
+	return &ring->cqes[ring->cq_head & (ring->entries - 1)];
+}
+
+/** \fn void uring_cqe_seen(uring_t* ring)
+ *  \brief Release the completion returned by uring_peek_cqe.
+ */
+void uring_cqe_seen(uring_t* ring) {
+	ring->cq_head++;
+}
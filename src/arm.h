@@ -69,6 +69,14 @@ inline void dsb() {
     __asm volatile ("mcr p15, 0, %0, c7, c10, 4" : : "r" (0) : "memory");
 }
 
+inline void wait_for_interrupt() {
+#ifdef RPI2
+    asm volatile ("wfi" ::: "memory");
+#else
+    mcr(p15, 0, c7, c0, 4, 0);
+#endif
+}
+
 inline void flush_prefetch_buffer() {
 #ifdef RPI2
     asm volatile("isb" ::: "memory");
@@ -89,6 +97,49 @@ inline void isb() {
 #endif
 }
 
+/*
+ * Cycle counter of the performance monitor, readable from the kernel only.
+ */
+inline static void cycle_counter_enable() {
+#ifdef RPI2
+    mcr(p15, 0, c9, c12, 0, mrc(p15, 0, c9, c12, 0) | 1); // PMCR.E
+    mcr(p15, 0, c9, c12, 1, 1u << 31); // PMCNTENSET.C
+#else
+    mcr(p15, 0, c15, c12, 0, 1); // ARM1176 PMNC.E
+#endif
+}
+
+inline static uint32_t cycle_counter() {
+#ifdef RPI2
+    return mrc(p15, 0, c9, c13, 0); // PMCCNTR
+#else
+    return mrc(p15, 0, c15, c12, 1); // ARM1176 CCNT
+#endif
+}
+
+#ifdef RPI2
+/*
+ * ARM generic timer: frequency and virtual count, which user mode may read
+ * when CNTKCTL.PL0VCTEN is set.
+ */
+#define CNTKCTL_PL0VCTEN (1 << 1)
+
+inline static uint32_t generic_timer_frequency() {
+    return mrc(p15, 0, c14, c0, 0); // CNTFRQ
+}
+
+inline static void generic_timer_user_access() {
+    mcr(p15, 0, c14, c1, 0, mrc(p15, 0, c14, c1, 0) | CNTKCTL_PL0VCTEN); // CNTKCTL
+}
+
+inline static uint64_t generic_timer_count() {
+    uint64_t r;
+    asm volatile("isb\n"
+                 "mrrc p15, 1, %Q0, %R0, c14" : "=r" (r) :: "memory"); // CNTVCT
+    return r;
+}
+#endif
+
 inline uint32_t get_cache_level_id() {
     return mrc(p15, 1, c0, c0, 1);
 }
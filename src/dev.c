@@ -1,5 +1,6 @@
 #include "dev.h"
 #include "serial.h"
+#include "poll.h"
 
 /** \file dev.c
   * \brief A mountable device pseudo-filesystem
@@ -18,8 +19,14 @@ static inode_operations_t dev_inode_operations = {
   .rm = NULL,
   .mkfile = NULL,
   .ioctl = dev_ioctl,
+  .poll = dev_poll,
 };
 
+/**	\var static int dev_id
+ *	\brief Id of the device superblock, which identifies its files for poll.
+ */
+static int dev_id;
+
 /**	\fn superblock_t* dev_initialize(int fd)
  *	\brief Builds a superblock, being the main interface object with the VFS.
  *	\param id The id of the newly created superblock.
@@ -28,6 +35,7 @@ static inode_operations_t dev_inode_operations = {
 superblock_t* dev_initialize (int id) {
     superblock_t* res = malloc(sizeof(superblock_t));
     res->id = id;
+    dev_id = id;
     res->root.st.st_ino    = DEV_ROOT;
     res->root.st.st_size   = 1024;
     res->root.st.st_mode   = S_IFDIR | S_IRWXU | S_IRWXO | S_IRWXG;
@@ -244,3 +252,31 @@ int dev_fwrite(inode_t from, char* buf, int size, int pos) {
             return -1;
     }
 }
+
+/**	\fn int dev_poll(inode_t from)
+ *	\brief Events of a device file: the serial ports are readable once a read
+ *	would return something, and the framebuffer has POLLPRI while the window of
+ *	the caller is shown.
+ *	\param from The device inode.
+ *	\return POLLIN, POLLOUT and POLLPRI flags.
+ */
+int dev_poll(inode_t from) {
+    switch (from.st.st_ino) {
+        case DEV_SERIAL:
+            return serial_readable() ? POLLIN | POLLOUT : POLLOUT;
+        case DEV_SERIAL2:
+            return serial2_readable() ? POLLIN | POLLOUT : POLLOUT;
+        case DEV_FB:
+            return fb_has_focus(get_current_process_id()) ? POLLPRI | POLLOUT : POLLOUT;
+        default:
+            return POLLIN | POLLOUT;
+    }
+}
+
+/**	\fn void dev_wake(int ino)
+ *	\brief Resume the processes polling a device file. Called by the drivers.
+ *	\param ino The device inode number.
+ */
+void dev_wake(int ino) {
+    poll_wake(dev_id, ino);
+}
@@ -19,3 +19,5 @@ int dev_fread(inode_t from, char* buf, int size, int pos);
 int dev_fwrite(inode_t from, char* buf, int size, int pos);
 
 int dev_ioctl(inode_t from, int cmd, int arg);
+int dev_poll(inode_t from);
+void dev_wake(int ino);
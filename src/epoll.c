@@ -0,0 +1,365 @@
+#include "epoll.h"
+#include <errno.h>
+#include <limits.h>
+#include "poll.h"
+#include "fdsyscalls.h"
+#include "uaccess.h"
+#include "scheduler.h"
+#include "syscalls.h"
+#include "timer.h"
+
+/** \file epoll.c
+ *  \brief Readiness notification in O(ready) instead of O(watched).
+ *
+ *  An epoll instance is an open file listing watched files. Its items are also
+ *  hashed by file key, like the poll wait queues: when a driver calls
+ *  poll_wake for a file, its items are appended to the ready list of their
+ *  instance, and the processes waiting on the instance are woken up.
+ *  epoll_wait only looks at the ready list, checking each item with the poll
+ *  operation of its file. A level-triggered item stays in the list while its
+ *  file is ready; an edge-triggered one leaves it once reported, until the next
+ *  wake up of its file.
+ */
+
+/** \var epoll_t epolls[MAX_EPOLLS]
+ *  \brief Epoll instances. The inode number of an instance is its index.
+ */
+static epoll_t epolls[MAX_EPOLLS];
+
+/** \var epoll_item_t* epoll_watches[POLL_HASH_SIZE]
+ *  \brief Items of every instance, indexed by the hash of their file key.
+ */
+static epoll_item_t* epoll_watches[POLL_HASH_SIZE];
+
+static int epoll_poll(inode_t inode);
+
+static inode_operations_t epoll_operations = {
+	.poll = epoll_poll,
+};
+
+/** \fn bool is_epoll(inode_t* inode)
+ *  \brief Tell whether an inode is an epoll instance.
+ */
+bool is_epoll(inode_t* inode) {
+	return inode->op == &epoll_operations;
+}
+
+/** \fn static void epoll_queue(epoll_t* ep, epoll_item_t* item)
+ *  \brief Append an item to the ready list of its instance, if it is not
+ *  already there.
+ */
+static void epoll_queue(epoll_t* ep, epoll_item_t* item) {
+	if (item->ready) {
+		return;
+	}
+	item->ready = true;
+	item->ready_next = NULL;
+	*ep->ready_tail = item;
+	ep->ready_tail = &item->ready_next;
+}
+
+/** \fn static epoll_item_t* epoll_pop(epoll_t* ep)
+ *  \brief Take the first item out of the ready list of an instance.
+ */
+static epoll_item_t* epoll_pop(epoll_t* ep) {
+	epoll_item_t* item = ep->ready;
+	ep->ready = item->ready_next;
+	if (ep->ready == NULL) {
+		ep->ready_tail = &ep->ready;
+	}
+	item->ready = false;
+	return item;
+}
+
+/** \fn static int epoll_events(epoll_item_t* item)
+ *  \brief Events of a watched file, among the ones asked for.
+ */
+static int epoll_events(epoll_item_t* item) {
+	int ready = POLLIN | POLLOUT; // Regular files never block.
+	if (item->inode->op->poll != NULL) {
+		ready = item->inode->op->poll(*item->inode);
+	}
+	return ready & (item->event.events | POLLERR | POLLHUP);
+}
+
+/** \fn static int epoll_poll(inode_t inode)
+ *  \brief An instance can be read, with epoll_wait, when an item may be ready.
+ */
+static int epoll_poll(inode_t inode) {
+	return epolls[inode.st.st_ino].ready != NULL ? POLLIN : 0;
+}
+
+/** \fn static epoll_t* epoll_get(process* p, int epfd, int* err)
+ *  \brief Instance of a file descriptor.
+ *  \return NULL with -errno in err if it is not an open epoll instance.
+ */
+static epoll_t* epoll_get(process* p, int epfd, int* err) {
+	fd_t* file = fd_get(p, epfd);
+	if (file == NULL) {
+		*err = -EBADF;
+		return NULL;
+	}
+	if (!is_epoll(file->inode)) {
+		*err = -EINVAL;
+		return NULL;
+	}
+	return &epolls[file->inode->st.st_ino];
+}
+
+/** \fn static void epoll_remove(epoll_t* ep, epoll_item_t* item)
+ *  \brief Unlink an item from its instance and from the watches, and release
+ *  its file.
+ */
+static void epoll_remove(epoll_t* ep, epoll_item_t* item) {
+	epoll_item_t** link = &ep->items;
+	while (*link != item) {
+		link = &(*link)->next;
+	}
+	*link = item->next;
+
+	link = &epoll_watches[poll_hash(item->key)];
+	while (*link != item) {
+		link = &(*link)->watch_next;
+	}
+	*link = item->watch_next;
+
+	if (item->ready) {
+		link = &ep->ready;
+		while (*link != item) {
+			link = &(*link)->ready_next;
+		}
+		*link = item->ready_next;
+		if (*link == NULL) {
+			ep->ready_tail = link;
+		}
+	}
+
+	unload_inode(item->inode);
+	free(item);
+}
+
+/** \fn void epoll_notify(uint32_t key)
+ *  \brief Mark the items watching a file as ready, and wake up their
+ *  instances. Called by poll_wake.
+ *  \param key Poll key of the file.
+ */
+void epoll_notify(uint32_t key) {
+	bool woken[MAX_EPOLLS] = {false};
+	for (epoll_item_t* item = epoll_watches[poll_hash(key)];item != NULL;item = item->watch_next) {
+		if (item->key == key) {
+			epoll_queue(&epolls[item->instance], item);
+			woken[item->instance] = true;
+		}
+	}
+	// Instances never watch instances, so this does not come back here.
+	for (int i=0;i<MAX_EPOLLS;i++) {
+		if (woken[i]) {
+			poll_wake(EPOLL_DEV, i);
+		}
+	}
+}
+
+/** \fn void epoll_free(int index)
+ *  \brief Free an instance and its items. Called when its inode is unloaded.
+ */
+void epoll_free(int index) {
+	epoll_t* ep = &epolls[index];
+	while (ep->items != NULL) {
+		epoll_remove(ep, ep->items);
+	}
+	ep->used = false;
+}
+
+/** \fn int svc_epoll_create(int size)
+ *  \brief Create an epoll instance.
+ *  \param size Ignored, but must be positive.
+ *  \return A file descriptor to the instance, -errno on error.
+ */
+int svc_epoll_create(int size) {
+	process* p = get_current_process();
+	if (size <= 0) {
+		return -EINVAL;
+	}
+
+	int i=0;
+	for (;i<MAX_EPOLLS && epolls[i].used;i++);
+	if (i == MAX_EPOLLS) {
+		return -ENFILE;
+	}
+
+	inode_t* ino = malloc(sizeof(inode_t));
+	if (ino == NULL) {
+		return -ENOMEM;
+	}
+	ino->sb 		= NULL;
+	ino->op 		= &epoll_operations;
+	ino->ref_count 	= 1;
+	memset(&ino->st, 0, sizeof(struct stat));
+	ino->st.st_ino 	= i;
+	ino->st.st_dev 	= EPOLL_DEV;
+
+	fd_t* file = fd_alloc(ino, O_RDONLY);
+	if (file == NULL) {
+		free(ino);
+		return -ENOMEM;
+	}
+	int fd = fd_install(p, file);
+	if (fd < 0) {
+		free(ino);
+		free(file);
+		return fd;
+	}
+
+	epolls[i].used 			= true;
+	epolls[i].items 		= NULL;
+	epolls[i].ready 		= NULL;
+	epolls[i].ready_tail 	= &epolls[i].ready;
+	return fd;
+}
+
+/** \fn int svc_epoll_ctl(int epfd, int op, int fd, struct epoll_event* event)
+ *  \brief Add, change or remove a watched file of an epoll instance.
+ *  \param op EPOLL_CTL_ADD, EPOLL_CTL_MOD or EPOLL_CTL_DEL.
+ *  \param event Events and user data, ignored by EPOLL_CTL_DEL.
+ *  \return 0 on success, -errno on error.
+ *
+ *  The item keeps a reference to the file, so it must be removed before the
+ *  file is closed for the file to be released.
+ */
+int svc_epoll_ctl(int epfd, int op, int fd, struct epoll_event* event) {
+	process* p = get_current_process();
+	int err;
+	epoll_t* ep = epoll_get(p, epfd, &err);
+	if (ep == NULL) {
+		return err;
+	}
+	fd_t* file = fd_get(p, fd);
+	if (file == NULL) {
+		return -EBADF;
+	}
+	inode_t* inode = file->inode;
+	if (is_epoll(inode)) { // Nested instances are not supported.
+		return -EINVAL;
+	}
+	struct epoll_event ev;
+	if (op != EPOLL_CTL_DEL && copy_from_user(&ev, event, sizeof(struct epoll_event)) < 0) {
+		return -EFAULT;
+	}
+
+	epoll_item_t* item = ep->items;
+	while (item != NULL && (item->fd != fd || item->inode != inode)) {
+		item = item->next;
+	}
+
+	switch (op) {
+		case EPOLL_CTL_ADD:
+			if (item != NULL) {
+				return -EEXIST;
+			}
+			item = malloc(sizeof(epoll_item_t));
+			if (item == NULL) {
+				return -ENOMEM;
+			}
+			inode->ref_count++;
+			item->fd 		= fd;
+			item->inode 	= inode;
+			item->key 		= poll_inode_key(inode);
+			item->event 	= ev;
+			item->instance 	= ep - epolls;
+			item->ready 	= false;
+			item->next 		= ep->items;
+			ep->items 		= item;
+			item->watch_next = epoll_watches[poll_hash(item->key)];
+			epoll_watches[poll_hash(item->key)] = item;
+			break;
+		case EPOLL_CTL_MOD:
+			if (item == NULL) {
+				return -ENOENT;
+			}
+			item->event = ev;
+			break;
+		case EPOLL_CTL_DEL:
+			if (item == NULL) {
+				return -ENOENT;
+			}
+			epoll_remove(ep, item);
+			return 0;
+		default:
+			return -EINVAL;
+	}
+
+	// The file may be ready already: it is checked at the next epoll_wait.
+	epoll_queue(ep, item);
+	poll_wake(EPOLL_DEV, item->instance);
+	return 0;
+}
+
+/** \fn int svc_epoll_wait(int epfd, struct epoll_event* events, int maxevents, int timeout)
+ *  \brief Wait until a watched file is ready.
+ *  \param events Where the ready files are written.
+ *  \param maxevents Size of events.
+ *  \param timeout Most milliseconds to wait, -1 to wait forever.
+ *  \return The number of ready files, 0 on timeout, -errno on error.
+ *
+ *  Like poll, the caller is woken up blocked in the active list, and this is
+ *  called again to collect the events.
+ */
+int svc_epoll_wait(int epfd, struct epoll_event* events, int maxevents, int timeout) {
+	process* p = get_current_process();
+	bool retry = poll_enter(p, timeout);
+	int err;
+	epoll_t* ep = epoll_get(p, epfd, &err);
+	if (ep == NULL) {
+		return err;
+	}
+	if (maxevents <= 0 || (size_t)maxevents > INT_MAX / sizeof(struct epoll_event)) {
+		return -EINVAL;
+	}
+	if (!access_ok(p, events, maxevents * sizeof(struct epoll_event))) {
+		return -EFAULT;
+	}
+
+	// Level-triggered items go back to the list, after the ones not reported.
+	epoll_item_t* again = NULL;
+	epoll_item_t** again_tail = &again;
+	int n = 0;
+	err = 0;
+	while (ep->ready != NULL && n < maxevents) {
+		epoll_item_t* item = epoll_pop(ep);
+		int ready = epoll_events(item); // May wake the item up again.
+		if (ready == 0) {
+			continue;
+		}
+		struct epoll_event ev;
+		ev.events 	= ready;
+		ev.data 	= item->event.data;
+		if (copy_to_user(&events[n], &ev, sizeof(struct epoll_event)) < 0) {
+			epoll_queue(ep, item); // Not reported: checked again next time.
+			err = -EFAULT;
+			break;
+		}
+		n++;
+		if (!(item->event.events & EPOLLET) && !item->ready) {
+			item->ready 		= true;
+			item->ready_next 	= NULL;
+			*again_tail 		= item;
+			again_tail 			= &item->ready_next;
+		}
+	}
+	if (again != NULL) {
+		*ep->ready_tail = again;
+		ep->ready_tail 	= again_tail;
+	}
+
+	if (n > 0 || err < 0 || poll_expired(p, timeout)) {
+		Timer_cancelHandler(&p->sleep_timer);
+		return n > 0 ? n : err;
+	}
+
+	if (!poll_register_inode(p, fd_get(p, epfd)->inode)) {
+		Timer_cancelHandler(&p->sleep_timer);
+		return -ENOMEM;
+	}
+	poll_suspend(p, retry);
+	return 0;
+}
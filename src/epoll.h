@@ -0,0 +1,52 @@
+#ifndef EPOLL_H
+#define EPOLL_H
+
+#include <stdint.h>
+#include "process.h"
+#include "../include/epoll.h"
+
+/** \def MAX_EPOLLS
+ *  \brief Number of epoll instances limit.
+ */
+#define MAX_EPOLLS 32
+
+/** \def EPOLL_DEV
+ *  \brief Device number of the epoll instance inodes. Pipes use -1.
+ */
+#define EPOLL_DEV -2
+
+typedef struct epoll_item_t epoll_item_t;
+/** \struct epoll_item_t
+ *  \brief A file watched by an epoll instance.
+ */
+struct epoll_item_t {
+	int fd; ///< File descriptor given to epoll_ctl.
+	inode_t* inode; ///< Watched file, referenced until the item is removed.
+	uint32_t key; ///< Poll key of the file.
+	struct epoll_event event; ///< Events waited for, and user data.
+	int instance; ///< Owner instance.
+	bool ready; ///< In the ready list of the instance.
+	epoll_item_t* next; ///< Next item of the instance.
+	epoll_item_t* ready_next; ///< Next item of the ready list.
+	epoll_item_t* watch_next; ///< Next item watching a file of the same hash.
+};
+
+/** \struct epoll_t
+ *  \brief An epoll instance.
+ */
+typedef struct {
+	bool used;
+	epoll_item_t* items; ///< Watched files.
+	epoll_item_t* ready; ///< Items which may be ready, oldest first.
+	epoll_item_t** ready_tail; ///< End of the ready list.
+} epoll_t;
+
+bool is_epoll(inode_t* inode);
+void epoll_notify(uint32_t key);
+void epoll_free(int index);
+
+int svc_epoll_create(int size);
+int svc_epoll_ctl(int epfd, int op, int fd, struct epoll_event* event);
+int svc_epoll_wait(int epfd, struct epoll_event* events, int maxevents, int timeout);
+
+#endif //EPOLL_H
@@ -15,6 +15,7 @@ static inode_operations_t ext2_inode_operations = {
   .rm = ext2_rm,
   .mkfile = ext2_mkfile,
   .resize = ext2_resize,
+  .map = ext2_fmap,
 };
 
 /*
@@ -245,6 +246,10 @@ void ext2_inode_read_block(
 
 	int block_size = 1024 << sb->log_block_size;
 	uintptr_t base_address = ext2_get_block_address(fs, inode, block);
+	if (base_address == 0) { // Hole in a sparse file.
+		memset(buffer, 0, size);
+		return;
+	}
 	disk->read(
 		base_address*block_size+offset,
 		buffer,
@@ -301,6 +306,55 @@ int ext2_fread(
 	return size;
 }
 
+/** \fn int ext2_fmap(inode_t vfs_inode, int position, int size, char** data)
+ *	\brief Point to the content of a file on a disk which lies in memory.
+ *	Blocks which follow each other on the disk are returned at once.
+ *	\return Number of bytes at *data, 0 at the end of the file, -1 if the disk
+ *	cannot be mapped (ENOSYS) or the position is in a hole of a sparse file,
+ *	which has no block to point to (EINVAL).
+ */
+int ext2_fmap(
+		inode_t vfs_inode, int position, int size, char** data)
+{
+	superblock_t* fs = vfs_inode.sb;
+	storage_driver* disk = devices[fs->id].disk;
+	if (disk->map == NULL) {
+		errno = ENOSYS;
+		return -1;
+	}
+
+	ext2_superblock_t* sb = devices[fs->id].sb;
+	ext2_inode_t info = ext2_get_inode_descriptor(fs, vfs_inode.st.st_ino);
+	if (!(info.type_permissions & EXT2_INODE_FILE) || (uint32_t)position >= info.size) {
+		return 0;
+	}
+	if ((uint32_t)(position + size) > info.size) {
+		size = info.size - position;
+	}
+
+	int block_size = 1024 << sb->log_block_size;
+	int block = position / block_size;
+	int offset = position % block_size;
+	uintptr_t first = ext2_get_block_address(fs, info, block);
+	if (first == 0) {
+		errno = EINVAL; // Hole: read it, as zeros.
+		return -1;
+	}
+	uintptr_t last = first;
+	int length = min(size, block_size - offset);
+	while (length < size) {
+		uintptr_t next = ext2_get_block_address(fs, info, ++block);
+		if (next != last + 1) {
+			break;
+		}
+		last = next;
+		length = min(size, length + block_size);
+	}
+
+	*data = disk->map(first*block_size + offset);
+	return length;
+}
+
 
  // |inode(4)|size(2)|length(1)|type(1)|name(N)
  // TODO: update last modification time
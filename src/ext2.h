@@ -129,6 +129,8 @@ int ext2_fwrite(
 	inode_t inode, char* buf, int len, int ofs);
 int ext2_fread(
 	inode_t inode, char* buffer, int len, int ofs);
+int ext2_fmap(
+	inode_t inode, int position, int size, char** data);
 vfs_dir_list_t* ext2_lsdir(
 	inode_t inode_p);
 int ext2_mkdir (
@@ -1,5 +1,6 @@
 #include "fb.h"
 #include "framebuffer.h"
+#include "dev.h"
 #include <string.h>
 
 
@@ -10,16 +11,16 @@
  *  dev pseudo-filesystem.
  */
 
-/** \var bool buffered[MAX_PROCESSES]
- *  \brief A bit table to save if the current process wants to be buffered, or
- *  to be directly displayed on the framebuffer.
+/** \var bool buffered[MAX_WINDOWS]
+ *  \brief A bit table to save if the process owning a window wants to be
+ *  buffered, or to be directly displayed on the framebuffer.
  */
-bool buffered[MAX_PROCESSES];
+bool buffered[MAX_WINDOWS];
 
-/** \var int pid_to_window[MAX_PROCESSES]
- *  \brief Maps process id to displayed window.
+/** \var int window_to_pid[MAX_WINDOWS]
+ *  \brief Maps displayed window to process id (-1 if the window is free).
  */
-int pid_to_window[MAX_PROCESSES];
+int window_to_pid[MAX_WINDOWS];
 
 int n_windows = 0;
 int shown_pid = 0;
@@ -36,24 +37,31 @@ extern frameBuffer* kernel_framebuffer;
  *  \brief Initialize data structures of the framebuffer system.
  */
 void fb_init() {
-	for (int i=0;i<MAX_PROCESSES;i++) {
-		pid_to_window[i] = -1;
-		buffered[i] = true;
-	}
 	for (int i=0;i<MAX_WINDOWS;i++) {
+		window_to_pid[i] = -1;
+		buffered[i] = true;
 		win_list[i] = -1;
 	}
 	top_win = -1;
 }
 
 /** \fn int fb_win_to_pid(int w)
- *  \brief Reverse the pid_to_window table.
+ *  \brief Owner of a window.
  *  \param w The looked up window.
  *  \return The pid associated to this window if found. Else -1.
  */
 int fb_win_to_pid(int w) {
-	for (int i=0;i<MAX_PROCESSES;i++) {
-		if (pid_to_window[i] == w) {
+	return (w >= 0 && w < MAX_WINDOWS) ? window_to_pid[w] : -1;
+}
+
+/** \fn static int pid_to_window(int pid)
+ *  \brief Reverse the window_to_pid table.
+ *  \param pid The process identifier.
+ *  \return The window of this process if found. Else -1.
+ */
+static int pid_to_window(int pid) {
+	for (int i=0;i<n_windows;i++) {
+		if (window_to_pid[i] == pid) {
 			return i;
 		}
 	}
@@ -66,7 +74,7 @@ int fb_win_to_pid(int w) {
  *  \return -1
  */
 int fb_show(int pid) {
-	int w = pid_to_window[pid];
+	int w = pid_to_window(pid);
 	if (w != -1) {
 		shown_pid = pid;
 		fb_flush(pid);
@@ -82,6 +90,7 @@ int fb_show(int pid) {
 		}
 		win_list[w] = top_win;
 		top_win = w;
+		dev_wake(DEV_FB); // The focus moved.
 	}
 	return -1;
 }
@@ -94,9 +103,10 @@ int fb_show(int pid) {
  *  available window.
  */
 int fb_open(int pid) {
-	int w = pid_to_window[pid];
+	int w = pid_to_window(pid);
 	if (w == -1 && n_windows != MAX_WINDOWS) {
-		pid_to_window[pid] = n_windows;
+		window_to_pid[n_windows] = pid;
+		buffered[n_windows] = true;
 		n_windows++;
 	}
 	return -1;
@@ -110,14 +120,12 @@ int fb_open(int pid) {
  *  When closing a window, brings the ancestor window to the front.
  */
 int fb_close(int pid) {
-	int w = pid_to_window[pid];
+	int w = pid_to_window(pid);
 	if (w != -1) {
-		pid_to_window[pid] = -1;
-		for (int i=0;i<MAX_PROCESSES;i++) {
-			if (pid_to_window[i] == n_windows-1) {
-				pid_to_window[i] = w;
-			}
-		}
+		// The last window takes the number of the closed one.
+		window_to_pid[w] = window_to_pid[n_windows-1];
+		buffered[w] = buffered[n_windows-1];
+		window_to_pid[n_windows-1] = -1;
 		n_windows--;
 
 		if (win_list[w] != -1) {
@@ -125,6 +133,7 @@ int fb_close(int pid) {
 			win_list[w] = -1;
 			shown_pid = fb_win_to_pid(top_win);
 			fb_flush(shown_pid);
+			dev_wake(DEV_FB); // The focus moved.
 		}
 	}
 	return -1;
@@ -134,14 +143,19 @@ int fb_close(int pid) {
  *  \brief Updates the buffering mode of a process.
  *  \param pid The process to update.
  *  \param arg If arg == 0, unbuffered. If arg != 0, buffered mode.
+ *  \return 0 on success, -1 if the process has no window.
  */
 int fb_buffered(int pid, int arg) {
-	buffered[pid] = !(arg == 0);
+	int w = pid_to_window(pid);
+	if (w == -1) {
+		return -1;
+	}
+	buffered[w] = !(arg == 0);
 	return 0;
 }
 
 bool fb_has_window(int pid) {
-	return pid_to_window[pid] != -1;
+	return pid_to_window(pid) != -1;
 }
 
 bool fb_has_focus(int pid) {
@@ -149,14 +163,15 @@ bool fb_has_focus(int pid) {
 }
 
 bool fb_is_buffered(int pid) {
-	return buffered[pid];
+	int w = pid_to_window(pid);
+	return w == -1 || buffered[w];
 }
 
 /** \fn int fb_flush(int pid)
  *  \brief Flush a process' buffer to the displayed framebuffer.
  */
 int fb_flush(int pid) {
-	int w = pid_to_window[pid];
+	int w = pid_to_window(pid);
 	if (w != -1) {
 		memcpy(kernel_framebuffer->bufferPtr, kernel_framebuffer->bufferPtr+(w+1)*kernel_framebuffer->bufferSize, kernel_framebuffer->bufferSize);
 		return 0;
@@ -171,6 +186,6 @@ int fb_flush(int pid) {
  *  \warning The process should have an allocated window. 
  */
 int fb_offset(int pid) {
-	int w = pid_to_window[pid];
+	int w = pid_to_window(pid);
 	return (w+1)*kernel_framebuffer->bufferSize;
 }
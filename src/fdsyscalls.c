@@ -3,43 +3,127 @@
 #include <errno.h>
 #include "syscalls.h"
 #include "../include/termfeatures.h"
+#include "epoll.h"
+#include "uaccess.h"
 
-inode_t fd_open_inodes[1024];
-bool used[1024];
+/** \struct open_inode_t
+ *	\brief Entry of the open inode table. The inode comes first: the pointer
+ *	given by load_inode is the entry.
+ */
+typedef struct open_inode_t open_inode_t;
+struct open_inode_t {
+	inode_t inode; ///< The loaded inode.
+	open_inode_t* next; ///< Next entry of the bucket, or of the free list.
+	open_inode_t** pprev; ///< Link to this entry in its bucket.
+};
+
+/** \def OPEN_INODES_BITS
+ *	\brief Initial number of buckets of the open inode table, as a power of two.
+ */
+#define OPEN_INODES_BITS 6
+
+/** \var open_inode_t** open_inodes
+ *	\brief Open inodes, hashed by device and inode number. The number of
+ *	buckets doubles when it gets below the number of open inodes.
+ */
+static open_inode_t** open_inodes;
+static int open_inodes_bits;
+static int open_inodes_count;
+
+/** \var open_inode_t* open_inodes_free
+ *	\brief Entries of unloaded inodes, reused by the next loads.
+ */
+static open_inode_t* open_inodes_free;
+
+/** \fn static open_inode_t** open_inode_bucket(inode_t* inode)
+ *	\brief Bucket of an inode, by its device and inode number.
+ */
+static open_inode_t** open_inode_bucket(inode_t* inode) {
+	uint32_t key = ((uint32_t)inode->sb->id << 16) ^ (uint32_t)inode->st.st_ino;
+	return &open_inodes[(key * 2654435761u) >> (32 - open_inodes_bits)];
+}
+
+/** \fn static void open_inode_link(open_inode_t* entry)
+ *	\brief Add an entry to its bucket.
+ */
+static void open_inode_link(open_inode_t* entry) {
+	open_inode_t** bucket = open_inode_bucket(&entry->inode);
+	entry->next = *bucket;
+	if (entry->next != NULL) {
+		entry->next->pprev = &entry->next;
+	}
+	entry->pprev = bucket;
+	*bucket = entry;
+}
+
+/** \fn static bool open_inodes_resize(int bits)
+ *	\brief Move the open inodes to a table of 2^bits buckets.
+ *	\return false if there is no memory, the table is then unchanged.
+ */
+static bool open_inodes_resize(int bits) {
+	open_inode_t** table = malloc(sizeof(open_inode_t*) << bits);
+	if (table == NULL) {
+		return false;
+	}
+	memset(table, 0, sizeof(open_inode_t*) << bits);
+
+	open_inode_t** old = open_inodes;
+	int old_size = old == NULL ? 0 : 1 << open_inodes_bits;
+	open_inodes = table;
+	open_inodes_bits = bits;
+	for (int i=0;i<old_size;i++) {
+		open_inode_t* entry = old[i];
+		while (entry != NULL) {
+			open_inode_t* next = entry->next;
+			open_inode_link(entry);
+			entry = next;
+		}
+	}
+	free(old);
+	return true;
+}
 
 /** \fn inode_t* load_inode(inode_t val)
  *	\brief Load an inode in the file descriptor system.
  *	\param val The loaded inode.
- *	\return An unique pointer to this inode.
+ *	\return An unique pointer to this inode, NULL if there is no memory.
  * 	The goal is that every open inode should have only one representation in memory.
  *	This is in order to have it synchronized at all time.
  */
 inode_t* load_inode(inode_t val) {
-	int f = -1;
-	for (int i=0;i<1024;i++) {
-		if (used[i] && fd_open_inodes[i].st.st_ino == val.st.st_ino && fd_open_inodes[i].sb->id == val.sb->id) {
-			fd_open_inodes[i].ref_count++;
-			return &fd_open_inodes[i];
-		} else if (!used[i]) {
-			f = i;
+	if (open_inodes == NULL && !open_inodes_resize(OPEN_INODES_BITS)) {
+		return NULL;
+	}
+	for (open_inode_t* entry = *open_inode_bucket(&val);entry != NULL;entry = entry->next) {
+		if (entry->inode.st.st_ino == val.st.st_ino && entry->inode.sb->id == val.sb->id) {
+			entry->inode.ref_count++;
+			return &entry->inode;
 		}
 	}
 
-	if (f == -1) {
+	if (open_inodes_count >= 1 << open_inodes_bits) {
+		// Without memory for a bigger table, the buckets only get longer.
+		open_inodes_resize(open_inodes_bits + 1);
+	}
+	open_inode_t* entry = open_inodes_free;
+	if (entry != NULL) {
+		open_inodes_free = entry->next;
+	} else if ((entry = malloc(sizeof(open_inode_t))) == NULL) {
 		return NULL;
-	} else {
-		val.ref_count = 1;
-		fd_open_inodes[f] = val;
-		used[f] = true;
-		return &fd_open_inodes[f];
 	}
+	val.ref_count = 1;
+	entry->inode = val;
+	open_inode_link(entry);
+	open_inodes_count++;
+	return &entry->inode;
 }
 
 /** \fn bool unload_inode(inode_t val)
  *	\brief Unload an inode for the file descriptor system.
  *	\param val A pointer to the unloaded inode.
- *	\warning This pointer should be an address to a fd_open_inodes entry.
- *	\return true on success. false if this inode is not found.
+ *	\warning This pointer should be given by load_inode, or be a pipe or an
+ *	epoll instance.
+ *	\return true.
  */
 bool unload_inode(inode_t* val) {
 	// Virtual pipe
@@ -51,36 +135,250 @@ bool unload_inode(inode_t* val) {
 		}
 		return true;
 	}
+	// Epoll instance
+	if (is_epoll(val)) {
+		val->ref_count--;
+		if (val->ref_count == 0) {
+			epoll_free(val->st.st_ino);
+			free(val);
+		}
+		return true;
+	}
+
+	open_inode_t* entry = (open_inode_t*)val;
+	entry->inode.ref_count--;
+	if (entry->inode.ref_count == 0) {
+		*entry->pprev = entry->next;
+		if (entry->next != NULL) {
+			entry->next->pprev = entry->pprev;
+		}
+		entry->next = open_inodes_free;
+		open_inodes_free = entry;
+		open_inodes_count--;
+	}
+	return true;
+}
+
+/** \fn fd_t* fd_alloc(inode_t* inode, int flags)
+ *	\brief Create an open file description, referenced once.
+ *	\param inode A loaded inode, whose reference goes to the description.
+ *	\return The description, NULL if there is no memory.
+ */
+fd_t* fd_alloc(inode_t* inode, int flags) {
+	fd_t* file = malloc(sizeof(fd_t));
+	if (file == NULL) {
+		return NULL;
+	}
+	file->inode 		= inode;
+	file->position 		= 0;
+	file->dir_entry 	= NULL;
+	file->dir_cursor 	= NULL;
+	file->dir_position 	= 0;
+	file->flags 		= flags;
+	file->read_blocking = false;
+	file->ref_count 	= 1;
+	return file;
+}
+
+/** \fn void fd_release(fd_t* file)
+ *	\brief Drop a reference to an open file description. The last one frees it
+ *	and unloads its inode.
+ */
+void fd_release(fd_t* file) {
+	if (--file->ref_count == 0) {
+		free_vfs_dir_list(file->dir_entry);
+		unload_inode(file->inode);
+		free(file);
+	}
+}
+
+/** \fn fd_t* fd_get(process* p, int fd)
+ *	\brief Open file description of a file descriptor.
+ *	\return NULL if the descriptor is not open.
+ */
+fd_t* fd_get(process* p, int fd) {
+	if (fd < 0 || fd >= p->group->fd_size) {
+		return NULL;
+	}
+	return p->group->fd[fd];
+}
+
+/** \fn static int fd_table_grow(process_group_t* g, int size)
+ *	\brief Make a file descriptor table hold at least size descriptors.
+ *	\return 0 on success, -EMFILE past MAX_OPEN_FILES, -ENOMEM.
+ */
+static int fd_table_grow(process_group_t* g, int size) {
+	if (size <= g->fd_size) {
+		return 0;
+	}
+	if (size > MAX_OPEN_FILES) {
+		return -EMFILE;
+	}
+	int new_size = g->fd_size;
+	while (new_size < size) {
+		new_size *= 2;
+	}
+	new_size = min(new_size, MAX_OPEN_FILES);
+
+	fd_t** fd = realloc(g->fd, new_size * sizeof(fd_t*));
+	if (fd == NULL) {
+		return -ENOMEM;
+	}
+	g->fd = fd;
+	uint32_t* map = realloc(g->fd_map, new_size / 32 * sizeof(uint32_t));
+	if (map == NULL) {
+		return -ENOMEM;
+	}
+	g->fd_map = map;
+	memset(g->fd + g->fd_size, 0, (new_size - g->fd_size) * sizeof(fd_t*));
+	memset(g->fd_map + g->fd_size / 32, 0, (new_size - g->fd_size) / 32 * sizeof(uint32_t));
+	g->fd_size = new_size;
+	return 0;
+}
 
-	int i = ((intptr_t)val - (intptr_t)fd_open_inodes)/sizeof(inode_t);
+/** \fn static void fd_assign(process_group_t* g, int fd, fd_t* file)
+ *	\brief Point a closed file descriptor to an open file description.
+ */
+static void fd_assign(process_group_t* g, int fd, fd_t* file) {
+	g->fd[fd] = file;
+	g->fd_map[fd / 32] |= 1u << (fd % 32);
+}
 
-	if (used[i]) {
-		fd_open_inodes[i].ref_count--;
-		if (fd_open_inodes[i].ref_count == 0) {
-			used[i] = false;
+/** \fn int fd_install(process* p, fd_t* file)
+ *	\brief Give the lowest free file descriptor to an open file description.
+ *	\return The file descriptor, -errno on error.
+ */
+int fd_install(process* p, fd_t* file) {
+	process_group_t* g = p->group;
+	for (int w=0;w<g->fd_size/32;w++) {
+		uint32_t free_fds = ~g->fd_map[w];
+		if (free_fds != 0) {
+			int fd = w*32 + __builtin_ctz(free_fds);
+			fd_assign(g, fd, file);
+			return fd;
+		}
+	}
+
+	int fd = g->fd_size; // Full table.
+	int err = fd_table_grow(g, fd + 1);
+	if (err < 0) {
+		return err;
+	}
+	fd_assign(g, fd, file);
+	return fd;
+}
+
+/** \fn int fd_install_at(process* p, int fd, fd_t* file)
+ *	\brief Give a chosen file descriptor to an open file description, closing
+ *	it first if it is open.
+ *	\return The file descriptor, -errno on error.
+ */
+int fd_install_at(process* p, int fd, fd_t* file) {
+	if (fd < 0) {
+		return -EBADF;
+	}
+	int err = fd_table_grow(p->group, fd + 1);
+	if (err < 0) {
+		return err == -EMFILE ? -EBADF : err;
+	}
+	fd_close(p, fd);
+	fd_assign(p->group, fd, file);
+	return fd;
+}
+
+/** \fn int fd_close(process* p, int fd)
+ *	\brief Close a file descriptor.
+ *	\return 0 on success, -EBADF if it is not open.
+ */
+int fd_close(process* p, int fd) {
+	fd_t* file = fd_get(p, fd);
+	if (file == NULL) {
+		return -EBADF;
+	}
+	p->group->fd[fd] = NULL;
+	p->group->fd_map[fd / 32] &= ~(1u << (fd % 32));
+	fd_release(file);
+	return 0;
+}
+
+/** \fn bool fd_table_init(process_group_t* g)
+ *	\brief Allocate an empty file descriptor table.
+ *	\return false if there is no memory.
+ */
+bool fd_table_init(process_group_t* g) {
+	g->fd_size 	= FD_TABLE_SIZE;
+	g->fd 		= malloc(FD_TABLE_SIZE * sizeof(fd_t*));
+	g->fd_map 	= malloc(FD_TABLE_SIZE / 32 * sizeof(uint32_t));
+	if (g->fd == NULL || g->fd_map == NULL) {
+		free(g->fd);
+		free(g->fd_map);
+		return false;
+	}
+	memset(g->fd, 0, FD_TABLE_SIZE * sizeof(fd_t*));
+	memset(g->fd_map, 0, FD_TABLE_SIZE / 32 * sizeof(uint32_t));
+	return true;
+}
+
+/** \fn bool fd_table_copy(process_group_t* dest, process_group_t* src)
+ *	\brief Allocate a table sharing the open file descriptions of another one,
+ *	as fork does. Only the open descriptors are visited.
+ *	\return false if there is no memory, dest being then an empty table.
+ */
+bool fd_table_copy(process_group_t* dest, process_group_t* src) {
+	dest->fd_size 	= src->fd_size;
+	dest->fd 		= malloc(src->fd_size * sizeof(fd_t*));
+	dest->fd_map 	= malloc(src->fd_size / 32 * sizeof(uint32_t));
+	if (dest->fd == NULL || dest->fd_map == NULL) {
+		free(dest->fd);
+		free(dest->fd_map);
+		dest->fd 		= NULL; // Left empty, for fd_table_free.
+		dest->fd_map 	= NULL;
+		dest->fd_size 	= 0;
+		return false;
+	}
+	memset(dest->fd, 0, src->fd_size * sizeof(fd_t*));
+	memcpy(dest->fd_map, src->fd_map, src->fd_size / 32 * sizeof(uint32_t));
+	for (int w=0;w<src->fd_size/32;w++) {
+		for (uint32_t open = src->fd_map[w];open != 0;open &= open - 1) {
+			int fd = w*32 + __builtin_ctz(open);
+			dest->fd[fd] = src->fd[fd];
+			dest->fd[fd]->ref_count++;
 		}
-		return true;
 	}
-	return false;
+	return true;
+}
+
+/** \fn void fd_table_free(process_group_t* g)
+ *	\brief Close the open file descriptors of a table, and free it.
+ */
+void fd_table_free(process_group_t* g) {
+	for (int w=0;w<g->fd_size/32;w++) {
+		for (uint32_t open = g->fd_map[w];open != 0;open &= open - 1) {
+			fd_release(g->fd[w*32 + __builtin_ctz(open)]);
+		}
+	}
+	free(g->fd);
+	free(g->fd_map);
+	g->fd = NULL;
+	g->fd_map = NULL;
+	g->fd_size = 0;
 }
 
 int svc_ioctl(int fd, int cmd, int arg) {
 	kdebug(D_IRQ, 2, "IOCTL %d %d %d \n", fd, cmd, arg);
-	process* p = get_current_process();
-	if (fd >= MAX_OPEN_FILES
-	|| p->fd[fd].position < 0)
-	{
+	fd_t* file = fd_get(get_current_process(), fd);
+	if (file == NULL) {
 		return -EBADF;
 	}
 
 	if (cmd == IOCTL_BLOCKING) {
-		p->fd[fd].read_blocking = arg;
+		file->read_blocking = arg;
 		return 0;
 	} else {
-		if (p->fd[fd].inode->op->ioctl == NULL) {
+		if (file->inode->op->ioctl == NULL) {
 			return -1;
 		}
-        return p->fd[fd].inode->op->ioctl(*p->fd[fd].inode, cmd, arg);
+        return file->inode->op->ioctl(*file->inode, cmd, arg);
 	}
 }
 
@@ -88,14 +386,11 @@ off_t svc_lseek(int fd_i, off_t offset, int whence) {
 	process* p = get_current_process();
 	kdebug(D_IRQ, 2, "LSEEK %d %d %d\n", fd_i, offset, whence);
 
-	if (fd_i >= MAX_OPEN_FILES
-	|| p->fd[fd_i].position < 0)
-	{
-		kernel_printf("K%d\n",fd_i);
+	fd_t* fd = fd_get(p, fd_i);
+	if (fd == NULL) {
 		return -EBADF;
 	}
 
-	fd_t* fd = &p->fd[fd_i];
 	switch (whence) {
 		case SEEK_SET:
 			fd->position = offset;
@@ -121,13 +416,12 @@ off_t svc_lseek(int fd_i, off_t offset, int whence) {
 uint32_t svc_write(uint32_t fd, char* buf, size_t cnt) {
 	//kernel_printf("SVC Write %d %d\n", fd, cnt);
 	//int fd = r[0];
-	if (fd >= MAX_OPEN_FILES
-        || get_current_process()->fd[fd].position < 0)
-	{
+	fd_t* fd_ = fd_get(get_current_process(), fd);
+	if (fd_ == NULL) {
 		return -EBADF;
 	}
 
-	if (!his_own(get_current_process(), buf)) {
+	if (!access_ok(get_current_process(), buf, cnt)) {
 		return -EFAULT;
 	}
 
@@ -136,9 +430,7 @@ uint32_t svc_write(uint32_t fd, char* buf, size_t cnt) {
 		return 0;
 	}
 
-	fd_t* fd_ = &(get_current_process()->fd[fd]);
-
-	if (fd_->position >= 0 && (fd_->flags | O_WRONLY)) {
+	if (fd_->flags | O_WRONLY) {
 		int n = vfs_fwrite(*fd_->inode, buf, cnt, fd_->position);
 		if (S_ISREG(fd_->inode->st.st_mode)) {
 			fd_->position += n;
@@ -155,49 +447,32 @@ uint32_t svc_write(uint32_t fd, char* buf, size_t cnt) {
 }
 
 uint32_t svc_close(uint32_t fd) {
-	process* p = get_current_process();
-	if (fd >= MAX_OPEN_FILES
-	|| p->fd[fd].position < 0) {
-		return -EBADF;
-	}
-	kdebug(D_SYSCALL, 2, "CLOSE %d %d\n", fd, p->fd[fd].inode->ref_count);
-
-
-
-	free_vfs_dir_list(p->fd[fd].dir_entry);
-	unload_inode(p->fd[fd].inode);
-	p->fd[fd].dir_entry = NULL;
-	p->fd[fd].inode = NULL;
-	p->fd[fd].position = -1;
-	return 0;
+	kdebug(D_SYSCALL, 2, "CLOSE %d\n", fd);
+	return fd_close(get_current_process(), fd);
 }
 
 uint32_t svc_fstat(uint32_t fd, struct stat* dest) {
 	kdebug(D_SYSCALL, 2, "FSTAT %d %#010x\n", fd, dest);
 	process* p = get_current_process();
-	if (fd >= MAX_OPEN_FILES
-	|| p->fd[fd].position < 0) {
+	fd_t* file = fd_get(p, fd);
+	if (file == NULL) {
 		return -EBADF;
 	}
 
-	if (!his_own(p, dest)) {
-		return -EFAULT;
-	}
-
-	*dest = p->fd[fd].inode->st;
-	kdebug(D_SYSCALL, 2, "FSTAT OK\n");
-	return 0;
+	int err = copy_to_user(dest, &file->inode->st, sizeof(struct stat));
+	kdebug(D_SYSCALL, 2, "FSTAT %d\n", err);
+	return err;
 }
 
 uint32_t svc_read(uint32_t fd, char* buf, size_t cnt) {
 
 	process* p = get_current_process();
-	if (fd >= MAX_OPEN_FILES
-	|| p->fd[fd].position < 0) {
+	fd_t* file = fd_get(p, fd);
+	if (file == NULL) {
 		return -EBADF;
 	}
 
-	if (!his_own(p, buf)) {
+	if (!access_ok(p, buf, cnt)) {
 		return -EFAULT;
 	}
 
@@ -205,105 +480,420 @@ uint32_t svc_read(uint32_t fd, char* buf, size_t cnt) {
 		return 0;
 	}
 
-	if (p->fd[fd].flags == O_WRONLY) {
+	if (file->flags == O_WRONLY) {
 		return -EBADF;
 	}
 
 
-	int n = vfs_fread(*p->fd[fd].inode, buf, cnt, p->fd[fd].position);
-	kdebug(D_SYSCALL, 1, "READ %d %d\n", n, p->fd[fd].read_blocking);
+	int n = vfs_fread(*file->inode, buf, cnt, file->position);
+	kdebug(D_SYSCALL, 1, "READ %d %d\n", n, file->read_blocking);
 
-	if (n == 0 && (p->fd[fd].read_blocking != 0)) {
+	if (n == 0 && (file->read_blocking != 0)) {
 		kdebug(D_SYSCALL, 1, "blocked");
 		// block the call.
 		p->status = status_blocked_svc;
 		return 0;
 	}
 	p->status = status_active;
-	p->fd[fd].position += n;
+	file->position += n;
 	return n;
 }
 
+/** \fn static int iov_check(process* p, const struct iovec* iov, int iovcnt)
+ *	\brief Check the buffers given to readv or writev.
+ *	\return Their total size, -errno if they are not valid.
+ */
+static int iov_check(process* p, const struct iovec* iov, int iovcnt) {
+	if (iovcnt < 0 || iovcnt > IOV_MAX) {
+		return -EINVAL;
+	}
+	if (iovcnt == 0) {
+		return 0;
+	}
+	if (!access_ok(p, iov, iovcnt * sizeof(struct iovec))) {
+		return -EFAULT;
+	}
 
-/** \fn uint32_t svc_getdents(uint32_t fd, struct dirent* user_entry)
- * 	\brief Explore the directory described by fd.
- *	\param fd A directory file descriptor.
- *	\param user_entry Where the entry should be written to.
- *	\return Zero on success, 1 when listing ended, -errno on error.
+	int total = 0;
+	for (int i=0;i<iovcnt;i++) {
+		if (iov[i].iov_len > (size_t)(INT32_MAX - total)) {
+			return -EINVAL;
+		}
+		if (iov[i].iov_len > 0 && !access_ok(p, iov[i].iov_base, iov[i].iov_len)) {
+			return -EFAULT;
+		}
+		total += iov[i].iov_len;
+	}
+	return total;
+}
+
+/** \fn static int fd_preadv(process* p, uint32_t fd, const struct iovec* iov, int iovcnt, off_t offset)
+ *	\brief Read a file into checked buffers.
+ *	\param offset Where to read, -1 to read at the file position and move it.
+ *	Only a read at the file position may block.
+ *	\return Number of bytes read, -errno on error.
  */
-uint32_t svc_getdents(uint32_t fd, struct dirent* user_entry) {
+static int fd_preadv(process* p, uint32_t fd, const struct iovec* iov, int iovcnt, off_t offset) {
+	fd_t* r_fd = fd_get(p, fd);
+	if (r_fd == NULL || r_fd->flags == O_WRONLY) {
+		return -EBADF;
+	}
+
+	if (offset != -1
+	&& (S_ISCHR(r_fd->inode->st.st_mode) || S_ISFIFO(r_fd->inode->st.st_mode))) {
+		return -ESPIPE;
+	}
+
+	int n = vfs_freadv(*r_fd->inode, iov, iovcnt, offset == -1 ? r_fd->position : offset);
+	if (n < 0) {
+		return -errno;
+	}
+	if (offset == -1) {
+		if (n == 0 && r_fd->read_blocking != 0) {
+			p->status = status_blocked_svc;
+			return 0;
+		}
+		p->status = status_active;
+		r_fd->position += n;
+	}
+	return n;
+}
+
+/** \fn static int fd_pwritev(process* p, uint32_t fd, const struct iovec* iov, int iovcnt, off_t offset)
+ *	\brief Write checked buffers to a file.
+ *	\param offset Where to write, -1 to write at the file position and move it.
+ *	An offset past the end of the file writes at its end, as there are no holes.
+ *	\return Number of bytes written, -errno on error.
+ */
+static int fd_pwritev(process* p, uint32_t fd, const struct iovec* iov, int iovcnt, off_t offset) {
+	fd_t* w_fd = fd_get(p, fd);
+	if (w_fd == NULL) {
+		return -EBADF;
+	}
+	if (offset != -1
+	&& (S_ISCHR(w_fd->inode->st.st_mode) || S_ISFIFO(w_fd->inode->st.st_mode))) {
+		return -ESPIPE;
+	}
+
+	int n = vfs_fwritev(*w_fd->inode, iov, iovcnt, offset == -1 ? w_fd->position : offset);
+	if (n < 0) {
+		return -errno;
+	}
+	if (S_ISREG(w_fd->inode->st.st_mode)) {
+		if (offset == -1) {
+			w_fd->position += n;
+			offset = w_fd->position;
+		} else {
+			offset = min(offset, w_fd->inode->st.st_size) + n;
+		}
+		w_fd->inode->st.st_size = max(w_fd->inode->st.st_size, offset);
+	}
+	return n;
+}
+
+/** \fn int svc_readv(uint32_t fd, const struct iovec* iov, int iovcnt)
+ *	\brief Read at the file position into several buffers, in one call.
+ *	\return Number of bytes read, -errno on error.
+ */
+int svc_readv(uint32_t fd, const struct iovec* iov, int iovcnt) {
+	process* p = get_current_process();
+	int total = iov_check(p, iov, iovcnt);
+	if (total <= 0) {
+		return total;
+	}
+	return fd_preadv(p, fd, iov, iovcnt, -1);
+}
+
+/** \fn int svc_writev(uint32_t fd, const struct iovec* iov, int iovcnt)
+ *	\brief Write several buffers at the file position, in one call.
+ *	\return Number of bytes written, -errno on error.
+ */
+int svc_writev(uint32_t fd, const struct iovec* iov, int iovcnt) {
 	process* p = get_current_process();
-	if (!his_own(p, user_entry)) {
+	int total = iov_check(p, iov, iovcnt);
+	if (total <= 0) {
+		return total;
+	}
+	return fd_pwritev(p, fd, iov, iovcnt, -1);
+}
+
+/** \fn int svc_pread(uint32_t fd, char* buf, size_t cnt, off_t offset)
+ *	\brief Read at a given offset, leaving the file position as it is.
+ *	\return Number of bytes read, -errno on error.
+ */
+int svc_pread(uint32_t fd, char* buf, size_t cnt, off_t offset) {
+	process* p = get_current_process();
+	if (offset < 0) {
+		return -EINVAL;
+	}
+	if (!access_ok(p, buf, cnt)) {
 		return -EFAULT;
 	}
+	if (cnt == 0) {
+		return 0;
+	}
+	struct iovec iov = {buf, cnt};
+	return fd_preadv(p, fd, &iov, 1, offset);
+}
+
+/** \fn int svc_pwrite(uint32_t fd, char* buf, size_t cnt, off_t offset)
+ *	\brief Write at a given offset, leaving the file position as it is.
+ *	\return Number of bytes written, -errno on error.
+ */
+int svc_pwrite(uint32_t fd, char* buf, size_t cnt, off_t offset) {
+	process* p = get_current_process();
+	if (offset < 0) {
+		return -EINVAL;
+	}
+	if (!access_ok(p, buf, cnt)) {
+		return -EFAULT;
+	}
+	if (cnt == 0) {
+		return 0;
+	}
+	struct iovec iov = {buf, cnt};
+	return fd_pwritev(p, fd, &iov, 1, offset);
+}
+
+/** \def SENDFILE_MAX
+ *	\brief Most bytes moved by a single sendfile, so that a large copy does not
+ *	hold the kernel for long. Callers loop like on a short write.
+ */
+#define SENDFILE_MAX 	0x10000
 
-	if (fd >= MAX_OPEN_FILES
-	|| p->fd[fd].position < 0) {
+/** \def SENDFILE_CHUNK
+ *	\brief Size of the buffer used when the source cannot be mapped.
+ */
+#define SENDFILE_CHUNK 	0x1000
+
+/** \fn int svc_sendfile(uint32_t out_fd, uint32_t in_fd, off_t* offset, size_t count)
+ *	\brief Copy data between two files inside the kernel.
+ *	\param out_fd Destination, written at its file position.
+ *	\param in_fd Source.
+ *	\param offset Where to read the source, updated after the copy. If NULL,
+ *	the source is read at its file position, which moves.
+ *	\param count Most bytes to copy.
+ *	\return Number of bytes copied, 0 at the end of the source, -errno on error.
+ *
+ *	When the source can be mapped (ext2 on the memory disk), its blocks are
+ *	given in place to the write operation of the destination, in runs of
+ *	contiguous blocks. Otherwise, they go through a kernel buffer. The call
+ *	never blocks: when a source which is not a regular file (pipe, FIFO,
+ *	serial line) has no data yet, it returns -EAGAIN, and the caller falls
+ *	back to read, which waits. Only a regular source has a position that moves.
+ */
+int svc_sendfile(uint32_t out_fd, uint32_t in_fd, off_t* offset, size_t count) {
+	process* p = get_current_process();
+	fd_t* in 	= fd_get(p, in_fd);
+	fd_t* out 	= fd_get(p, out_fd);
+	if (in == NULL || out == NULL || in->flags == O_WRONLY) {
 		return -EBADF;
 	}
+	bool seekable = S_ISREG(in->inode->st.st_mode);
+	if (offset != NULL && !seekable) {
+		return -ESPIPE;
+	}
+	off_t position = in->position;
+	if (offset != NULL && copy_from_user(&position, offset, sizeof(off_t)) < 0) {
+		return -EFAULT;
+	}
+	if (position < 0
+	|| S_ISDIR(in->inode->st.st_mode) || S_ISDIR(out->inode->st.st_mode)) {
+		return -EINVAL;
+	}
+	if (count > SENDFILE_MAX) {
+		count = SENDFILE_MAX;
+	}
 
+	char* buffer 	= NULL;
+	int total 		= 0;
+	int res 		= 0;
+	while ((size_t)total < count) {
+		char* data;
+		int n = vfs_fmap(*in->inode, position, count - total, &data);
+		if (n < 0) {
+			if (buffer == NULL && (buffer = malloc(SENDFILE_CHUNK)) == NULL) {
+				res = -ENOMEM;
+				break;
+			}
+			n = vfs_fread(*in->inode, buffer, min(count - total, SENDFILE_CHUNK), position);
+			data = buffer;
+		}
+		if (n <= 0) {
+			res = n < 0 ? -errno : (seekable ? 0 : -EAGAIN);
+			break;
+		}
+
+		int w = vfs_fwrite(*out->inode, data, n, out->position);
+		if (w < 0) {
+			res = -errno;
+			break;
+		}
+		if (S_ISREG(out->inode->st.st_mode)) {
+			out->position += w;
+			out->inode->st.st_size = max(out->inode->st.st_size, out->position);
+		}
+		position 	+= w;
+		total 		+= w;
+		if (w < n) {
+			break;
+		}
+	}
+	free(buffer);
 
+	if (offset != NULL) {
+		copy_to_user(offset, &position, sizeof(off_t));
+	} else if (seekable) {
+		in->position = position;
+	}
+	kdebug(D_SYSCALL, 2, "SENDFILE %d -> %d: %d\n", in_fd, out_fd, total);
+	return total > 0 ? total : res;
+}
 
-	fd_t* w_fd = &p->fd[fd];
-	kdebug(D_SYSCALL, 2, "GETDENTS => %d: %d\n", fd, w_fd->inode->st.st_ino);
+/** \fn static fd_t* fd_dir_seek(process* p, uint32_t fd, int* err)
+ * 	\brief Move the directory cursor of fd to its position, which counts
+ *	entries. The directory is listed again when the position is zero, so that a
+ *	rewind sees new entries.
+ *	\return The open directory, NULL with -errno in err if fd is not one.
+ */
+static fd_t* fd_dir_seek(process* p, uint32_t fd, int* err) {
+	fd_t* w_fd = fd_get(p, fd);
+	if (w_fd == NULL) {
+		*err = -EBADF;
+		return NULL;
+	}
 	if (!S_ISDIR(w_fd->inode->st.st_mode)) {
-		return -ENOTDIR;
+		*err = -ENOTDIR;
+		return NULL;
 	}
 
-	// reload dirlist
-	if (w_fd->position == 0) {
+	if (w_fd->position == 0 || w_fd->dir_entry == NULL) {
 		free_vfs_dir_list(w_fd->dir_entry);
-		if (w_fd->inode->op == NULL) {
-			return 0;
+		w_fd->dir_entry = NULL;
+		if (w_fd->inode->op != NULL) {
+			w_fd->dir_entry = w_fd->inode->op->read_dir(*w_fd->inode);
 		}
-		w_fd->dir_entry = w_fd->inode->op->read_dir(*w_fd->inode);
+		w_fd->dir_cursor = w_fd->dir_entry;
+		w_fd->dir_position = 0;
+	} else if (w_fd->position < w_fd->dir_position) {
+		w_fd->dir_cursor = w_fd->dir_entry;
+		w_fd->dir_position = 0;
+	}
+	while (w_fd->dir_cursor != NULL && w_fd->dir_position < w_fd->position) {
+		w_fd->dir_cursor = w_fd->dir_cursor->next;
+		w_fd->dir_position++;
+	}
+	return w_fd;
+}
+
+/** \fn uint32_t svc_getdents(uint32_t fd, struct dirent* user_entry)
+ * 	\brief Explore the directory described by fd, one entry at a time.
+ *	\param fd A directory file descriptor.
+ *	\param user_entry Where the entry should be written to.
+ *	\return Zero on success, 1 when listing ended, -errno on error.
+ */
+uint32_t svc_getdents(uint32_t fd, struct dirent* user_entry) {
+	process* p = get_current_process();
+	if (!access_ok(p, user_entry, sizeof(struct dirent))) {
+		return -EFAULT;
+	}
+
+	int err;
+	fd_t* w_fd = fd_dir_seek(p, fd, &err);
+	if (w_fd == NULL) {
+		return err;
 	}
+	kdebug(D_SYSCALL, 2, "GETDENTS => %d: %d\n", fd, w_fd->inode->st.st_ino);
 
-	if (w_fd->dir_entry == NULL) {
+	if (w_fd->dir_cursor == NULL) {
 		return 1;
-	} else {
-		w_fd->position++;
-		user_entry->d_ino = w_fd->dir_entry->inode.st.st_ino;
-		user_entry->d_type = w_fd->dir_entry->inode.st.st_mode;
-
-		strcpy(user_entry->d_name, w_fd->dir_entry->name);
-		vfs_dir_list_t *prec = w_fd->dir_entry;
-		w_fd->dir_entry = w_fd->dir_entry->next;
-		free(prec->name);
-		free(prec);
-		return 0;
 	}
+	struct dirent entry;
+	memset(&entry, 0, sizeof(struct dirent));
+	entry.d_ino = w_fd->dir_cursor->inode.st.st_ino;
+	entry.d_type = w_fd->dir_cursor->inode.st.st_mode;
+	strncpy(entry.d_name, w_fd->dir_cursor->name, sizeof(entry.d_name) - 1);
+	if (copy_to_user(user_entry, &entry, sizeof(struct dirent)) < 0) {
+		return -EFAULT;
+	}
+	w_fd->position++;
+	return 0;
 }
 
-int svc_openat(int dirfd, char* path_c, int flags) {
+/** \fn int svc_getdents64(uint32_t fd, struct dirent64* dirp, size_t count)
+ * 	\brief Explore the directory described by fd, as many entries at a time as
+ *	fit in the buffer.
+ *	\param fd A directory file descriptor.
+ *	\param dirp Where the dirent64 records are written.
+ *	\param count Size of the buffer.
+ *	\return The number of bytes written, zero when listing ended, -errno on
+ *	error. EINVAL if the next entry does not fit.
+ */
+int svc_getdents64(uint32_t fd, struct dirent64* dirp, size_t count) {
 	process* p = get_current_process();
-	if (!his_own(p, path_c)) {
+	if (count == 0 || !access_ok(p, dirp, count)) {
 		return -EFAULT;
 	}
 
-	char* path = malloc(strlen(path_c)+1);
-	strcpy(path,path_c);
-	int i=0;
-	for (;(p->fd[i].position != -1) && (i<MAX_OPEN_FILES);i++);
+	int err;
+	fd_t* w_fd = fd_dir_seek(p, fd, &err);
+	if (w_fd == NULL) {
+		return err;
+	}
 
-	if (i == MAX_OPEN_FILES) { // no available fd.
-		return -ENFILE;
+	size_t written = 0;
+	err = 0;
+	while (w_fd->dir_cursor != NULL) {
+		vfs_dir_list_t* entry = w_fd->dir_cursor;
+		size_t len = strlen(entry->name);
+		size_t reclen = (offsetof(struct dirent64, d_name) + len + 1 + 7) & ~7;
+		if (written + reclen > count) {
+			break;
+		}
+		struct dirent64 record;
+		record.d_ino 		= entry->inode.st.st_ino;
+		record.d_off 		= w_fd->position + 1;
+		record.d_reclen 	= reclen;
+		record.d_type 		= IFTODT(entry->inode.st.st_mode);
+		char* dest = (char*)dirp + written;
+		if (copy_to_user(dest, &record, offsetof(struct dirent64, d_name)) < 0
+		|| copy_to_user(dest + offsetof(struct dirent64, d_name), entry->name, len + 1) < 0) {
+			err = -EFAULT;
+			break;
+		}
+		written += reclen;
+
+		w_fd->dir_cursor = entry->next;
+		w_fd->dir_position++;
+		w_fd->position++;
+	}
+	kdebug(D_SYSCALL, 2, "GETDENTS64 => %d: %d bytes\n", fd, written);
+
+	if (written == 0 && w_fd->dir_cursor != NULL) {
+		return err == -EFAULT ? err : -EINVAL;
 	}
+	return written;
+}
 
+int svc_openat(int dirfd, char* path_c, int flags) {
+	process* p = get_current_process();
+	int err;
+	char* path = strndup_from_user(path_c, USER_PATH_MAX, &err);
+	if (path == NULL) {
+		return err;
+	}
 
 	inode_t* base;
 	if (dirfd == AT_FDCWD) {
 		base = &p->cwd;
 	} else {
-		if ((dirfd >= 0 && dirfd < MAX_OPEN_FILES)
-		 	&& p->fd[dirfd].position >= 0) {
-			if (S_ISDIR(p->fd[dirfd].inode->st.st_mode)) {
-				base = p->fd[dirfd].inode;
-			} else {
-				return -ENOTDIR;
-			}
-		} else {
+		fd_t* dir = fd_get(p, dirfd);
+		if (dir == NULL) {
 			return -EBADF;
+		} else if (S_ISDIR(dir->inode->st.st_mode)) {
+			base = dir->inode;
+		} else {
+			return -ENOTDIR;
 		}
 	}
 	inode_t ino = vfs_path_to_inode(base, path);
@@ -341,57 +931,48 @@ int svc_openat(int dirfd, char* path_c, int flags) {
 		}
 	}
 
-	p->fd[i].position = 0;
-	p->fd[i].dir_entry = NULL;
-	p->fd[i].inode = load_inode(ino);
-	p->fd[i].read_blocking = 0;
 	free(path);
-
-	p->fd[i].flags = flags;
+	inode_t* inode = load_inode(ino);
+	if (inode == NULL) {
+		return -ENOMEM;
+	}
+	fd_t* file = fd_alloc(inode, flags);
+	if (file == NULL) {
+		unload_inode(inode);
+		return -ENOMEM;
+	}
 
 	if (flags & O_APPEND) {
-		p->fd[i].position = ino.st.st_size;
+		file->position = ino.st.st_size;
 	}
 
 	if ((flags & O_TRUNC) && S_ISREG(ino.st.st_mode)) {
-		if (p->fd[i].inode->op->resize != NULL) {
-			p->fd[i].inode->op->resize(*p->fd[i].inode, 0);
-			p->fd[i].inode->st.st_size = 0;
+		if (file->inode->op->resize != NULL) {
+			file->inode->op->resize(*file->inode, 0);
+			file->inode->st.st_size = 0;
 		}
 	}
 
-	if ((S_ISCHR(p->fd[i].inode->st.st_mode)) || (S_ISFIFO(p->fd[i].inode->st.st_mode))) {
-		p->fd[i].read_blocking = 1;
+	if ((S_ISCHR(file->inode->st.st_mode)) || (S_ISFIFO(file->inode->st.st_mode))) {
+		file->read_blocking = 1;
 	}
 
+	int i = fd_install(p, file);
+	if (i < 0) {
+		fd_release(file);
+		return i;
+	}
 	kdebug(D_SYSCALL,5, "OPEN => %d\n", i);
 	return i;
 }
 
 
-int svc_unlinkat(int dirfd, char* name, int flag) {
-	(void) flag;
-	inode_t* base;
-	process* p = get_current_process();
-	if (!his_own(p, (void*)name)) {
-		return -EFAULT;
-	}
-
-	if (dirfd == AT_FDCWD) {
-		base = &p->cwd;
-	} else {
-		if ((dirfd >= 0 && dirfd < MAX_OPEN_FILES)
-		 	&& p->fd[dirfd].position >= 0) {
-			if (S_ISDIR(p->fd[dirfd].inode->st.st_mode)) {
-				base = p->fd[dirfd].inode;
-			} else {
-				return -ENOTDIR;
-			}
-		} else {
-			return -EBADF;
-		}
-	}
-
+/** \fn static int fd_unlink(inode_t* base, char* name)
+ *	\brief Remove a file, its path being relative to base.
+ *	\param name The path, copied from the caller.
+ *	\return 0 on success, -errno on error.
+ */
+static int fd_unlink(inode_t* base, char* name) {
 	inode_t dir = vfs_path_to_inode(base, dirname(name));
 	if (errno > 0) {
 		return -errno;
@@ -410,30 +991,60 @@ int svc_unlinkat(int dirfd, char* name, int flag) {
 	return -errno;
 }
 
-int svc_mknodat(int dirfd, char* pathname, mode_t mode, dev_t dev) {
+int svc_unlinkat(int dirfd, char* name_c, int flag) {
+	(void) flag;
 	inode_t* base;
 	process* p = get_current_process();
-	if (!his_own(p, pathname)) {
-		return -EFAULT;
-	}
 
 	if (dirfd == AT_FDCWD) {
 		base = &p->cwd;
 	} else {
-		if ((dirfd >= 0 && dirfd < MAX_OPEN_FILES)
-		 	&& p->fd[dirfd].position >= 0) {
-			if (S_ISDIR(p->fd[dirfd].inode->st.st_mode)) {
-				base = p->fd[dirfd].inode;
-			} else {
-				return -ENOTDIR;
-			}
+		fd_t* dir = fd_get(p, dirfd);
+		if (dir == NULL) {
+			return -EBADF;
+		} else if (S_ISDIR(dir->inode->st.st_mode)) {
+			base = dir->inode;
 		} else {
+			return -ENOTDIR;
+		}
+	}
+
+	int err;
+	char* name = strndup_from_user(name_c, USER_PATH_MAX, &err);
+	if (name == NULL) {
+		return err;
+	}
+	err = fd_unlink(base, name);
+	free(name);
+	return err;
+}
+
+int svc_mknodat(int dirfd, char* pathname, mode_t mode, dev_t dev) {
+	inode_t* base;
+	process* p = get_current_process();
+
+	if (dirfd == AT_FDCWD) {
+		base = &p->cwd;
+	} else {
+		fd_t* dir = fd_get(p, dirfd);
+		if (dir == NULL) {
 			return -EBADF;
+		} else if (S_ISDIR(dir->inode->st.st_mode)) {
+			base = dir->inode;
+		} else {
+			return -ENOTDIR;
 		}
 	}
 
-	inode_t test = vfs_path_to_inode(base, pathname);
+	int err;
+	char* path = strndup_from_user(pathname, USER_PATH_MAX, &err);
+	if (path == NULL) {
+		return err;
+	}
+
+	inode_t test = vfs_path_to_inode(base, path);
 	if (errno == 0) {
+		free(path);
 		if (S_ISDIR(test.st.st_mode)) {
 			return 0;
 		} else {
@@ -441,8 +1052,6 @@ int svc_mknodat(int dirfd, char* pathname, mode_t mode, dev_t dev) {
 		}
 	}
 
-	char* path = malloc(strlen(pathname)+1);
-	strcpy(path, pathname);
 	char* last = path;
 	while (strchr(last+1, '/') != NULL) {
 		last = strchr(last+1, '/');
@@ -467,75 +1076,70 @@ int svc_mknodat(int dirfd, char* pathname, mode_t mode, dev_t dev) {
 			return -errno;
 		}
 	}
+	free(path);
 	return 0;
 }
 
 int svc_dup(int oldfd) {
 	process* p = get_current_process();
-
-	if (oldfd >= MAX_OPEN_FILES
-	|| p->fd[oldfd].position < 0) {
+	fd_t* file = fd_get(p, oldfd);
+	if (file == NULL) {
 		return -EBADF;
 	}
 
-	int i=0;
-	for (;(p->fd[i].position != -1) && (i<MAX_OPEN_FILES);i++);
-
-	if (i == MAX_OPEN_FILES) {
-		return -ENFILE;
+	int i = fd_install(p, file);
+	if (i >= 0) {
+		file->ref_count++;
 	}
-
-	p->fd[i] = p->fd[oldfd];
-	p->fd[i].inode->ref_count++;
 	return i;
 }
 
 int svc_dup2(int oldfd, int newfd) {
 	process* p = get_current_process();
-
-	if (oldfd >= MAX_OPEN_FILES
-	|| p->fd[oldfd].position < 0) {
+	fd_t* file = fd_get(p, oldfd);
+	if (file == NULL) {
 		return -EBADF;
 	}
-
-	if (newfd >= MAX_OPEN_FILES) {
-		return -EBADF;
+	if (oldfd == newfd) {
+		return newfd;
 	}
 
-	if (p->fd[newfd].position >= 0) {
-		svc_close(newfd);
+	file->ref_count++;
+	int res = fd_install_at(p, newfd, file);
+	if (res < 0) {
+		file->ref_count--;
 	}
-
-
-	p->fd[newfd] = p->fd[oldfd];
-	p->fd[newfd].inode->ref_count++;
-	return newfd;
+	return res;
 }
 
 
 int svc_pipe(int pipefd[2]) {
 	process* p = get_current_process();
 
-	int inputfd=0, outputfd=0;
-	for (;(p->fd[inputfd].position != -1) && (inputfd<MAX_OPEN_FILES);inputfd++);
-	for (;(p->fd[outputfd].position != -1 || inputfd == outputfd) && (outputfd<MAX_OPEN_FILES);outputfd++);
-
-	if (outputfd == MAX_OPEN_FILES) {
-		return -ENFILE;
-	}
-
-	p->fd[inputfd].position = 0;
 	inode_t* ino = malloc(sizeof(inode_t));
-	inode_t res = mkpipe();
-	*ino = res;
+	fd_t* input = NULL;
+	fd_t* output = NULL;
+	if (ino == NULL
+	|| (input = fd_alloc(ino, O_WRONLY)) == NULL
+	|| (output = fd_alloc(ino, O_RDONLY)) == NULL) {
+		free(ino);
+		free(input);
+		return -ENOMEM;
+	}
+	*ino = mkpipe();
 	ino->ref_count = 2;
-	p->fd[inputfd].inode = ino;
-	p->fd[inputfd].dir_entry = NULL;
-	p->fd[outputfd] = p->fd[inputfd];
 
-
-	p->fd[inputfd].flags = O_WRONLY;
-	p->fd[outputfd].flags = O_RDONLY;
+	int inputfd = fd_install(p, input);
+	int outputfd = inputfd < 0 ? inputfd : fd_install(p, output);
+	if (outputfd < 0) {
+		if (inputfd >= 0) {
+			fd_close(p, inputfd);
+		} else {
+			fd_release(input);
+		}
+		fd_release(output);
+		return outputfd;
+	}
 
 	pipefd[0] = outputfd; // Read end of the pipe.
 	pipefd[1] = inputfd; // Write end of the pipe.
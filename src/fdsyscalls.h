@@ -19,10 +19,25 @@
 inode_t* load_inode(inode_t val);
 bool unload_inode(inode_t* val);
 
+fd_t* 	 fd_alloc(inode_t* inode, int flags);
+void 	 fd_release(fd_t* file);
+fd_t* 	 fd_get(process* p, int fd);
+int 	 fd_install(process* p, fd_t* file);
+int 	 fd_install_at(process* p, int fd, fd_t* file);
+int 	 fd_close(process* p, int fd);
+bool 	 fd_table_init(process_group_t* g);
+bool 	 fd_table_copy(process_group_t* dest, process_group_t* src);
+void 	 fd_table_free(process_group_t* g);
+
 uint32_t svc_write(uint32_t fd, char* buf, size_t cnt);
 uint32_t svc_close(uint32_t fd);
 uint32_t svc_fstat(uint32_t fd, struct stat* dest);
 uint32_t svc_read(uint32_t fd, char* buf, size_t cnt);
+int 	 svc_readv(uint32_t fd, const struct iovec* iov, int iovcnt);
+int 	 svc_writev(uint32_t fd, const struct iovec* iov, int iovcnt);
+int 	 svc_pread(uint32_t fd, char* buf, size_t cnt, off_t offset);
+int 	 svc_pwrite(uint32_t fd, char* buf, size_t cnt, off_t offset);
+int 	 svc_sendfile(uint32_t out_fd, uint32_t in_fd, off_t* offset, size_t count);
 
 off_t 	 svc_lseek(int fd, off_t offset, int whence);
 int 	 svc_openat(int dirfd, char* path, int flags);
@@ -35,4 +50,5 @@ int 	 svc_dup2(int oldfd, int newfd);
 int 	 svc_pipe(int pipefd[2]);
 
 uint32_t svc_getdents(uint32_t fd, struct dirent* user_entry);
+int 	 svc_getdents64(uint32_t fd, struct dirent64* dirp, size_t count);
 #endif
@@ -0,0 +1,140 @@
+#include "futex.h"
+#include <errno.h>
+#include "scheduler.h"
+#include "timer.h"
+
+/** \file futex.c
+ *  \brief Fast userspace mutexes.
+ *
+ *  A process waiting on a futex leaves the active list until another process
+ *  wakes it up through the same word, or its timeout expires. A futex is
+ *  identified by the physical address of the word, so it works between
+ *  threads as well as between processes sharing memory.
+ */
+
+/** \var futex_bucket_t futex_buckets[FUTEX_HASH_SIZE]
+ *  \brief Wait queues, indexed by the hash of the futex key.
+ */
+static futex_bucket_t futex_buckets[FUTEX_HASH_SIZE];
+
+/** \fn static futex_bucket_t* futex_bucket(uintptr_t key)
+ *  \brief Wait queue of a futex.
+ */
+static futex_bucket_t* futex_bucket(uintptr_t key) {
+	return &futex_buckets[((key >> 2) * 2654435761u) >> (32 - FUTEX_HASH_BITS)];
+}
+
+/** \fn uintptr_t futex_key(process* p, int* uaddr)
+ *  \brief Key of a futex: the physical address of its word.
+ *  \param p A process the word belongs to.
+ *  \param uaddr Address of the word in this process.
+ */
+uintptr_t futex_key(process* p, int* uaddr) {
+	return mmu_vir2phy_ttb((uintptr_t)uaddr, p->ttb_address);
+}
+
+/** \fn static void futex_timeout(timerHandler* handler, void* param, void* context)
+ *  \brief Timer handler resuming a process whose futex wait timed out.
+ *  \param param The process.
+ */
+static void futex_timeout(timerHandler* handler, void* param, void* context) {
+	(void) handler;
+	(void) context;
+	process* p = param;
+	futex_cancel(p);
+	p->ctx.r[0] = -ETIMEDOUT;
+	resume_process(p->asid);
+}
+
+/** \fn int futex_wait(process* p, int* uaddr, int val, uint64_t deadline)
+ *  \brief Suspend a process until the futex is woken up.
+ *  \param p The calling process, whose translation table is the current one.
+ *  \param uaddr Address of the futex word.
+ *  \param val Value the word is expected to hold.
+ *  \param deadline When to give up (see Timer_GetTime64), 0 to wait forever.
+ *  \return 0 if the process was suspended, -EAGAIN if the word changed.
+ *
+ *  Checking the word and queuing the process can't be interleaved with a wake
+ *  up, as the kernel is not preemptible.
+ */
+int futex_wait(process* p, int* uaddr, int val, uint64_t deadline) {
+	if (*(volatile int*)uaddr != val) {
+		return -EAGAIN;
+	}
+	p->ctx.r[0] = 0;
+	p->futex_key = futex_key(p, uaddr);
+	p->futex_next = NULL;
+
+	futex_bucket_t* bucket = futex_bucket(p->futex_key);
+	if (bucket->tail == NULL) {
+		bucket->head = p;
+	} else {
+		bucket->tail->futex_next = p;
+	}
+	bucket->tail = p;
+
+	suspend_process(p->asid, status_futex);
+	if (deadline != 0) {
+		Timer_addHandler(&p->sleep_timer, deadline, futex_timeout, p, NULL);
+	}
+	return 0;
+}
+
+/** \fn int futex_wake(uintptr_t key, int count)
+ *  \brief Wake up processes waiting on a futex, in arrival order.
+ *  \param key Key of the futex (see futex_key).
+ *  \param count Maximum number of processes to wake up.
+ *  \return The number of processes woken up.
+ */
+int futex_wake(uintptr_t key, int count) {
+	futex_bucket_t* bucket = futex_bucket(key);
+	process* prev = NULL;
+	process* q = bucket->head;
+	int n = 0;
+	while (q != NULL && n < count) {
+		process* next = q->futex_next;
+		if (q->futex_key == key) {
+			if (prev == NULL) {
+				bucket->head = next;
+			} else {
+				prev->futex_next = next;
+			}
+			if (bucket->tail == q) {
+				bucket->tail = prev;
+			}
+			q->futex_next = NULL;
+			Timer_cancelHandler(&q->sleep_timer);
+			resume_process(q->asid);
+			n++;
+		} else {
+			prev = q;
+		}
+		q = next;
+	}
+	return n;
+}
+
+/** \fn void futex_cancel(process* p)
+ *  \brief Remove a process from its wait queue, without waking it up.
+ *  \param p A process in futex status.
+ */
+void futex_cancel(process* p) {
+	futex_bucket_t* bucket = futex_bucket(p->futex_key);
+	process* prev = NULL;
+	process* q = bucket->head;
+	while (q != NULL && q != p) {
+		prev = q;
+		q = q->futex_next;
+	}
+	if (q != NULL) {
+		if (prev == NULL) {
+			bucket->head = p->futex_next;
+		} else {
+			prev->futex_next = p->futex_next;
+		}
+		if (bucket->tail == p) {
+			bucket->tail = prev;
+		}
+	}
+	p->futex_next = NULL;
+}
@@ -0,0 +1,27 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <stdint.h>
+#include "process.h"
+#include "../include/threads.h"
+
+/** \def FUTEX_HASH_BITS
+ *  \brief log2 of the number of wait queues.
+ */
+#define FUTEX_HASH_BITS 6
+#define FUTEX_HASH_SIZE (1 << FUTEX_HASH_BITS)
+
+/** \st futex_bucket_t
+ *  \brief Wait queue of the futexes hashed to the same bucket, oldest first.
+ */
+typedef struct {
+	process* head;
+	process* tail;
+} futex_bucket_t;
+
+uintptr_t futex_key(process* p, int* uaddr);
+int futex_wait(process* p, int* uaddr, int val, uint64_t deadline);
+int futex_wake(uintptr_t key, int count);
+void futex_cancel(process* p);
+
+#endif //FUTEX_H
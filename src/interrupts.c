@@ -5,6 +5,8 @@
  */
 
 #include "interrupts.h"
+#include "svctable.h"
+#include "uaccess.h"
 
 
 /** \var volatile rpi_irq_controller_t* rpiIRQController
@@ -64,6 +66,105 @@ static bool status;
  */
 int count;
 
+/** \var uint32_t irq_count
+ *	\brief Hardware interrupts handled since boot.
+ */
+static uint32_t irq_count;
+
+/** \fn uint32_t interrupts_count()
+ *	\brief Number of hardware interrupts handled since boot.
+ */
+uint32_t interrupts_count() {
+	return irq_count;
+}
+
+
+/** \var uint32_t slice_cut
+ *	\brief Part of the current process' slice beyond the programmed timer period.
+ *
+ *	The timer is loaded with the remaining slice of the running process, cut
+ *	short when a delayed function is due earlier. When the timer fires with a
+ *	non-zero slice_cut, the process keeps the CPU for the rest of its slice.
+ */
+static uint32_t slice_cut;
+
+/** \fn void start_slice(process* p)
+ *	\brief Program the ARM timer for the time slice of the process about to run.
+ *	\param p The process.
+ *
+ *	A process that gave the CPU back before the end of its slice gets the
+ *	remaining of it, others get a new slice of their scheduling class.
+ */
+static void start_slice(process* p) {
+	if (p->slice_left == 0) {
+		p->slice_left = scheduler_get_quantum(p->sched_class);
+	}
+	uint32_t load = p->slice_left;
+	uint32_t deadline = Timer_nextHandlerDelay();
+	if (deadline < load) {
+		load = max(deadline, 1);
+	}
+	slice_cut = p->slice_left - load;
+	Timer_SetLoad(load);
+	Timer_Enable_Interrupts();
+}
+
+/** \fn void enter_idle(void* user_context)
+ *	\brief Switch to the idle context, as no process can make progress.
+ *	\param user_context The context restored on return from the exception.
+ *
+ *	The ARM timer is reprogrammed for the next delayed function, or stopped if
+ *	there is none: the CPU sleeps until a device interrupt wakes it up.
+ */
+static void enter_idle(void* user_context) {
+	uint32_t delay = Timer_nextHandlerDelay();
+	if (delay == 0xFFFFFFFF) {
+		Timer_Disable_Interrupts();
+	} else {
+		if (delay > TIMER_MAX_LOAD) {
+			delay = TIMER_MAX_LOAD;
+		} else if (delay == 0) {
+			delay = 1;
+		}
+		Timer_SetLoad(delay);
+		Timer_Enable_Interrupts();
+	}
+	kdebug(D_IRQ, 2, "Idle (next deadline in %d us).\n", delay);
+	*(user_context_t*)user_context = *scheduler_enter_idle();
+	account_trap_exit();
+}
+
+/** \fn void return_to_user(process* p, void* user_context)
+ *	\brief Last steps before the process resumes in user mode.
+ *	\param p The process.
+ *	\param user_context The context restored on return from the exception.
+ *
+ *	Pending signals are delivered here. If one kills the process, the next
+ *	process is given the CPU instead.
+ */
+static void return_to_user(process* p, void* user_context) {
+	int sig;
+	while ((sig = process_deliver_signal(p, user_context)) != 0) {
+		kdebug(D_IRQ, 2, "Process %d killed by signal %d.\n", p->asid, sig);
+		kill_process(p->asid, (sig << 8) | 1);
+		p = get_next_process();
+		if (p == NULL) {
+			enter_idle(user_context);
+			return;
+		}
+	    mmu_set_ttb_0(mmu_vir2phy(p->ttb_address), TTBCR_ALIGN);
+		*(user_context_t*)user_context = p->ctx;
+		start_slice(p);
+		if (p->status == status_blocked_svc) {
+			software_interrupt_vector(user_context); // Returns to user itself.
+			return;
+		}
+	}
+	vdso_update(p->tgid);
+	vfp_switch(p);
+	account_trap_exit();
+}
+
 
 /**	\fn void interrupt_vector(void* user_context)
  *	\brief Hardware interrupt handler.
@@ -75,17 +176,17 @@ int count;
  * 	If the interruption is triggered by the Timer, it performs a process switch.
  * 	The scheduler choses a new process and updates user_context to this new
  *	process' context. When this function returns, the context is restored.
+ *
+ *	UART interrupts only refresh the serial buffers, unless the CPU was idle:
+ *	then the received data may unblock a reader, so a process is scheduled.
  */
 void interrupt_vector(void* user_context) {
-    //callInterruptHandlers();
-	serial_irq(); // refresh serial buffer
-	serial2_irq();
-
     kdebug(D_IRQ,3,"ENTREEIRQ\n");
     kdebug(D_IRQ,3, "=> %d.\n", get_current_process_id());
+	account_trap_entry();
+	irq_count++;
 	process* p = get_current_process();
     if(p != NULL) {
-        p->ctx.pc -= 4;
         p->ctx = *(user_context_t*)user_context; // Save current program context.
         print_context(D_IRQ,5, user_context);
     }
@@ -93,16 +194,27 @@ void interrupt_vector(void* user_context) {
 	//kernel_printf("T=> %d PC: %p\n", get_current_process_id(), get_current_process()->ctx.pc);
     dmb();
 
-	uint32_t irq = RPI_GetIRQController()->IRQ_basic_pending;
+	uint32_t irq 		= RPI_GetIRQController()->IRQ_basic_pending;
+	uint32_t pending_1 	= RPI_GetIRQController()->IRQ_pending_1;
+	uint32_t pending_2 	= RPI_GetIRQController()->IRQ_pending_2;
+	bool reschedule 	= false;
+	bool handled 		= false;
+	bool retried 		= false;
+
+	if (pending_1 & (1 << RPI_IRQ_AUX)) {
+		serial_irq(); // refresh serial buffer
+		reschedule = reschedule || scheduler_is_idle();
+		handled = true;
+	}
 
-	if (irq & (1 << 8)) {
-		if (RPI_GetIRQController()->IRQ_pending_1 & (1 << 29)) {
-			kernel_printf("aux\n");
-			serial_irq();
-		} else {
-			kdebug(D_IRQ, 10, "[ERROR] Unhandled IRQ (%X)!\n",irq);
-		}
-	} else if (irq & RPI_BASIC_ARM_TIMER_IRQ) {
+	if (pending_2 & (1 << (RPI_IRQ_UART0 - 32))) {
+		serial2_irq();
+		reschedule = reschedule || scheduler_is_idle();
+		handled = true;
+	}
+
+	if (irq & RPI_BASIC_ARM_TIMER_IRQ) {
+		Timer_ClearInterrupt();
 		count++;
 		//kernel_printf("timer\n");
 		dmb();
@@ -114,19 +226,45 @@ void interrupt_vector(void* user_context) {
 		}
 		dmb();
 
+		Timer_callHandlers();
+		if (p != NULL && slice_cut > 0) {
+			// A delayed function was due, the process keeps the rest of its slice.
+			p->slice_left = slice_cut;
+			start_slice(p);
+		} else {
+			if (p != NULL) { // Preempted: the whole slice was used.
+				p->nivcsw++;
+				p->slice_left = 0;
+				p->sched_class = sched_class_batch;
+			}
+			reschedule = true;
+		}
+		handled = true;
+	}
+
+	if (!handled) {
+		kdebug(D_IRQ, 10, "[ERROR] Unhandled IRQ (%X)!\n",irq);
+	}
 
+	if (reschedule) {
 		p = get_next_process();
 		if (p == NULL) {
 		/*	kdebug(D_IRQ, 10,
 		"Every one is dead. Only the void remains. In the distance, sirens.\n");*/
-            return; //We are probably in the kernel
+			enter_idle(user_context);
+		} else {
+			start_slice(p);
+		    mmu_set_ttb_0(mmu_vir2phy(p->ttb_address), TTBCR_ALIGN);
+	        *(user_context_t*)user_context = p->ctx;
+			if (p->status == status_blocked_svc) {
+				software_interrupt_vector(user_context); // May go back to idle.
+				retried = true;
+			}
 		}
+	}
 
-	    mmu_set_ttb_0(mmu_vir2phy(p->ttb_address), TTBCR_ALIGN);
-        *(user_context_t*)user_context = p->ctx;
-		if (p->status == status_blocked_svc) {
-			software_interrupt_vector(user_context);
-		}
+	if (!retried && !scheduler_is_idle()) {
+		return_to_user(get_current_process(), user_context);
 	}
 
     kdebug(D_IRQ,3, "<= %d.\n", get_current_process_id());
@@ -134,9 +272,6 @@ void interrupt_vector(void* user_context) {
 	print_context(D_IRQ, 2, user_context);
 
 	//kernel_printf("T<= %d PC: %p\n", get_current_process_id(), get_current_process()->ctx.pc);
-
-	Timer_ClearInterrupt();
-	Timer_SetLoad(TIMER_LOAD);
 }
 
 
@@ -148,9 +283,10 @@ void interrupt_vector(void* user_context) {
  * 	It should be saved on the current process data.
  *
  * 	Here the process called for a kernel feature.
- *	This function decodes the call, and branches to the functions of syscalls.c.
- *	Some system calls can cause a process switch, these are handler the same way
- *	as in interrupt_vector().
+ *	This function looks the call up in the service call table (svctable.c),
+ *	whose entries decode the arguments and branch to the functions of
+ *	syscalls.c. An unknown call returns -ENOSYS. Some system calls can cause a
+ *	process switch, these are handler the same way as in interrupt_vector().
  */
 uint32_t software_interrupt_vector(void* user_context) {
 	//kernel_printf("S=> %d PC: %p\n", get_current_process_id(), get_current_process()->ctx.pc);
@@ -160,114 +296,62 @@ uint32_t software_interrupt_vector(void* user_context) {
 	//	while(1) {}
 	//}
 	process* p;
+	int blocked_retries = 0; // Blocked processes polled since the call.
+	account_trap_entry();
+	if (get_current_process()->status != status_blocked_svc) { // Not a retry.
+		get_current_process()->syscalls++;
+	}
 swi_beg:
 	p = get_current_process();
 	p->ctx = *ctx;
+	p->slice_left = slice_cut + Timer_GetValue();
 	uint32_t res;
 
-	int r_bef = ctx->r[7];
-
-    switch(ctx->r[7]) {
-		case SVC_IOCTL:
-			res = svc_ioctl(ctx->r[0],ctx->r[1],ctx->r[2]);
-			break;
-        case SVC_EXIT:
-			res = svc_exit(ctx->r[0]);
-			break;
-        case SVC_SBRK:
-			res = svc_sbrk(ctx->r[0]);
-			break;
-		case SVC_FORK:
-			res = svc_fork();
-			break;
-        case SVC_WRITE:
-            res = svc_write(ctx->r[0],(char*)ctx->r[1],ctx->r[2]);
-			break;
-        case SVC_CLOSE:
-            res = svc_close(ctx->r[0]);
-			break;
-		case SVC_WAITPID:
-			res = svc_waitpid(ctx->r[0],(int*) ctx->r[1], ctx->r[2]);
-			break;
-        case SVC_FSTAT:
-            res = svc_fstat(ctx->r[0],(struct stat*)ctx->r[1]);
-			break;
-        case SVC_LSEEK:
-			res = svc_lseek(ctx->r[0],ctx->r[1],ctx->r[2]);
-            break;
-        case SVC_READ:
-            res = svc_read(ctx->r[0],(char*)ctx->r[1],ctx->r[2]);
-			if (p->status == status_blocked_svc) {
-				get_next_process();
-			}
-			break;
-		case SVC_TIME:
-			res = svc_time((time_t*)ctx->r[0]);
-			break;
-		case SVC_GETPID:
-			res = get_current_process_id();
-			break;
-		case SVC_EXECVE:
-			res = svc_execve((char*)ctx->r[0],(const char**)ctx->r[1],(const char**)ctx->r[2]);
-			break;
-		case SVC_GETCWD:
-			res = (uint32_t)svc_getcwd((char*)ctx->r[0],ctx->r[1]);
-			break;
-		case SVC_CHDIR:
-			res = svc_chdir((char*)ctx->r[0]);
-			break;
-		case SVC_GETDENTS:
-			res = svc_getdents(ctx->r[0], (struct dirent *)ctx->r[1]);
-			break;
-		case SVC_OPENAT:
-			res = svc_openat(ctx->r[0], (char*) ctx->r[1], ctx->r[2]);
-			break;
-		case SVC_MKNODAT:
-			res = svc_mknodat(ctx->r[0], (char*) ctx->r[1], ctx->r[2], ctx->r[3]);
-			break;
-		case SVC_UNLINKAT:
-			res = svc_unlinkat(ctx->r[0], (char*) ctx->r[1], ctx->r[2]);
-			break;
-		case SVC_DUP:
-			res = svc_dup(ctx->r[0]);
-			break;
-		case SVC_DUP2:
-			res = svc_dup2(ctx->r[0], ctx->r[1]);
-			break;
-		case SVC_KILL:
-			res = svc_kill(ctx->r[0], ctx->r[1]);
-			break;
-		case SVC_SIGACTION:
-			res = svc_sigaction(ctx->r[0],ctx->r[1],ctx->r[2]);
-			break;
-		case SVC_SIGRETURN:
-			svc_sigreturn();
-			break;
-		case SVC_PIPE:
-			res = svc_pipe((int*)ctx->r[0]);
-			break;
-        default:
-        kdebug(D_IRQ, 10, "Undefined SWI. %#02x\n", ctx->r[7]);
-		while(1) {}
-    }
+	int tid = p->asid;
+
+	svc_entry_t* svc = svc_lookup(ctx->r[7]);
+	if (svc == NULL) {
+		kdebug(D_IRQ, 10, "Undefined SWI. %#02x\n", ctx->r[7]);
+		ctx->r[0] = -ENOSYS;
+		return_to_user(p, user_context);
+		return 0;
+	}
+	if (p->status != status_blocked_svc) { // Not a retry.
+		svc->calls++;
+	}
+	uint32_t cycles = cycle_counter();
+	res = svc->function(ctx);
+	svc->cycles += cycle_counter() - cycles;
+
+	if ((svc->flags & SVC_F_BLOCK) && p->status == status_blocked_svc) {
+		get_next_process(); // Still in the active list, retried when its turn comes.
+	}
 
-	if ((ctx->r[7] == SVC_EXIT)
-	|| 	(ctx->r[7] == SVC_EXECVE)
-	|| 	(ctx->r[7] == SVC_SIGRETURN)
-	|| 	(ctx->r[7] == SVC_KILL)
-    ||	(ctx->r[7] == SVC_WAITPID && res == (uint32_t)-1)
-	||  (p->status == status_blocked_svc)) {
+	if ((svc->flags & SVC_F_SWITCH)
+	|| 	((svc->flags & SVC_F_BLOCK) && p->status != status_active)) {
+		// The caller may have been freed (exit, execve, kill), check it first.
+		if (get_process(tid) == p && p->status != status_active) {
+			p->nvcsw++;
+			p->sched_class = sched_class_interactive; // Gave the CPU back before the end of its slice.
+		}
 		p = get_current_process();
+		if (p == NULL || blocked_retries >= get_number_active_processes()) {
+			// Every process is blocked: nothing to do until the next interrupt.
+			enter_idle(user_context);
+			return 0;
+		}
 	    mmu_set_ttb_0(mmu_vir2phy(p->ttb_address), TTBCR_ALIGN);
 		*ctx = p->ctx; // Copy next process ctx
+		start_slice(p);
 		if (p->status == status_blocked_svc) {
-			*(user_context_t*)user_context = p->ctx;
+			blocked_retries++;
 			goto swi_beg;
 		}
-	} else {
+	} else if (svc->flags & SVC_F_RESULT) {
 		ctx->r[0] = res; // let's return the result in r0
 	}
 
+	return_to_user(get_current_process(), user_context);
 	return 0;
 }
 
@@ -323,10 +407,39 @@ void kern_debug() {
 
 /** \fn void undefined_instruction_vector (void)
  * 	\brief Handler called when the instruction parsing failed.
+ *
+ *	In user mode, this is usually the first FPU instruction of a process that
+ *	doesn't own the FPU: it is given the FPU and the instruction is run again.
+ *	Otherwise the process is killed.
  */
-void __attribute__ ((interrupt("UNDEF"))) undefined_instruction_vector(void* data) {
+void undefined_instruction_vector(void* data) {
 	user_context_t* ctx = (user_context_t*) data;
 
+	if ((ctx->cpsr & 0x1F) == 0x10) {
+		account_trap_entry();
+		process* p = get_current_process();
+		if (vfp_trap(p)) {
+			ctx->pc -= (ctx->cpsr & CPSR_THUMB) ? 2 : 4; // Back to the instruction (Thumb or ARM).
+			return_to_user(p, data);
+			return;
+		}
+
+		kdebug(D_IRQ, 10, "USER UNDEFINED instruction of process %d at %#010x.\n", get_current_process_id(), ctx->pc-4);
+		print_context(D_IRQ,10, ctx);
+		kill_process(get_current_process_id(), -1);
+		p = get_next_process();
+		if (p == NULL) {
+			enter_idle(data);
+			return;
+		}
+		p = get_current_process();
+	    mmu_set_ttb_0(mmu_vir2phy(p->ttb_address), TTBCR_ALIGN);
+		*ctx = p->ctx; // Copy next process ctx
+		start_slice(p);
+		return_to_user(p, data);
+		return;
+	}
+
 	int ttb;
 
 	asm("mrc p15, 0, %0, c2, c0, 0\n"
@@ -352,8 +465,11 @@ void __attribute__ ((interrupt("UNDEF"))) undefined_instruction_vector(void* dat
 
 /** \fn void prefetch_abort_vector(void* data)
  *	\brief Prefetch abort interrupt handler.
+ *
+ *	A process jumping to an unmapped address is killed, and the next one
+ *	resumes. In the kernel, branch into the last resort debug tool.
  */
-void __attribute__ ((interrupt("ABORT"))) prefetch_abort_vector(void* data) {
+void prefetch_abort_vector(void* data) {
 	user_context_t* ctx = (user_context_t*) data;
 
 	int ttb;
@@ -381,16 +497,21 @@ void __attribute__ ((interrupt("ABORT"))) prefetch_abort_vector(void* data) {
 
 
 	if ((ctx->cpsr & 0x1F) == 0x10) {
+		account_trap_entry();
 		kill_process(get_current_process_id(), -1); //we are sure a running process exist
 		process* p = get_next_process();
 		if (p == NULL) {
-			kdebug(D_IRQ, 10, "No process left.\n");
-			while(1) {}
+			kdebug(D_IRQ, 10, "No process left, going idle.\n");
+			enter_idle(data);
+			return;
 		}
 		kdebug(D_IRQ, 10, "Switching to %d.\n", get_current_process_id());
 		p = get_current_process();
 		mmu_set_ttb_0(mmu_vir2phy(p->ttb_address), TTBCR_ALIGN);
 		*ctx = p->ctx; // Copy next process ctx
+		start_slice(p);
+		return_to_user(p, data);
+		return;
 	}
 	kern_debug();
 
@@ -401,12 +522,21 @@ void __attribute__ ((interrupt("ABORT"))) prefetch_abort_vector(void* data) {
  *	\brief Data abort interrupt handler.
  *
  * 	When the MMU signals a data abort, check if it caused by the kernel or a
- * 	process. In case of a process, kill it. If this is the kernel, branch into
+ * 	process. In case of a process, kill it. If this is the kernel copying user
+ * 	memory, resume at the fixup of the instruction. Otherwise, branch into
  * 	the last resort debug tool.
  */
 void data_abort_vector(void* data) {
 	user_context_t* ctx = (user_context_t*) data;
 
+	if ((ctx->cpsr & 0x1F) != 0x10) { // A copy from or to user memory fails.
+		uintptr_t fixup = uaccess_fixup(ctx->pc - 8);
+		if (fixup != 0) {
+			ctx->pc = fixup;
+			return;
+		}
+	}
+
 	uint32_t ttb;
 
 	asm("mrc p15, 0, %0, c2, c0, 0\n"
@@ -423,6 +553,8 @@ void data_abort_vector(void* data) {
 	kernel_printf("TTB1: %p\n", ttb);
 
 	if ((ctx->cpsr & 0x1F) == 0x10) {
+		account_trap_entry();
+		get_current_process()->faults++;
 		kdebug(D_IRQ, 10, "USER DATA ABORT of process %d at instruction %#010x.\n", get_current_process_id(), ctx->pc-8);
 		print_context(D_IRQ,10, ctx);
 		uint32_t reg = mrc(p15, 0, c5, c0, 0);
@@ -435,13 +567,16 @@ void data_abort_vector(void* data) {
 		kill_process(get_current_process_id(), -1); //we are sure a running process exist
 		process* p = get_next_process();
 		if (p == NULL) {
-			kdebug(D_IRQ, 10, "No process left.\n");
-			while(1) {}
+			kdebug(D_IRQ, 10, "No process left, going idle.\n");
+			enter_idle(data);
+			return;
 		}
 		kdebug(D_IRQ, 10, "Switching to %d.\n", get_current_process_id());
 		p = get_current_process();
 	    mmu_set_ttb_0(mmu_vir2phy(p->ttb_address), TTBCR_ALIGN);
 		*ctx = p->ctx; // Copy next process ctx
+		start_slice(p);
+		return_to_user(p, data);
 	} else {
 		kdebug(D_IRQ, 10, "KERNEL DATA ABORT at instruction %#010x.\n", ctx->pc-8);
 		print_context(D_IRQ,10, ctx);
@@ -15,6 +15,7 @@
 #include "fdsyscalls.h"
 #include "memalloc.h"
 #include "arm.h"
+#include "vdso.h"
 
 /**
  *	List of syscall indices.
@@ -38,12 +39,34 @@
 #define 	SVC_IOCTL 		0x36
 #define 	SVC_DUP2 		0x3f
 #define 	SVC_SIGACTION 	0x43
+#define 	SVC_SIGPENDING 	0x49
 #define 	SVC_SIGRETURN 	0x77
+#define 	SVC_CLONE 		0x78
+#define 	SVC_SIGPROCMASK 0x7e
+#define 	SVC_READV 		0x91
+#define 	SVC_WRITEV 		0x92
+#define 	SVC_NANOSLEEP 	0xa2
+#define 	SVC_POLL 		0xa8
+#define 	SVC_SIGQUEUE 	0xb2
+#define 	SVC_PREAD 		0xb4
+#define 	SVC_PWRITE 		0xb5
 #define 	SVC_GETCWD 		0xb7
+#define 	SVC_SENDFILE 	0xbb
+#define 	SVC_GETDENTS64 	0xd9
+#define 	SVC_GETTID 		0xe0
+#define 	SVC_FUTEX 		0xf0
+#define 	SVC_EXIT_GROUP 	0xf8
+#define 	SVC_EPOLL_CREATE 	0xfa
+#define 	SVC_EPOLL_CTL 		0xfb
+#define 	SVC_EPOLL_WAIT 		0xfc
+#define 	SVC_GETRUSAGE 	0x4d
 #define 	SVC_GETDENTS 	0x4e
+#define 	SVC_CLOCK_GETTIME 	0x107
+#define 	SVC_CLOCK_NANOSLEEP 0x109
 #define 	SVC_OPENAT 		0x127
 #define 	SVC_MKNODAT 	0x129
 #define 	SVC_UNLINKAT	0x12d
+#define 	SVC_URING_ENTER 0x1aa
 
 /** \def RPI_INTERRUPT_CONTROLLER_BASE
  * 	The base adress of the interrupt controller.
@@ -102,6 +125,13 @@ typedef struct interruptHandler {
 #define RPI_BASIC_ACCESS_ERROR_1_IRQ    (1 << 6)
 #define RPI_BASIC_ACCESS_ERROR_0_IRQ    (1 << 7)
 
+/**
+ * General IRQ numbers used by the kernel.
+ * See the BCM2835 ARM Peripherals manual, section 7.5
+ */
+#define RPI_IRQ_AUX                     29
+#define RPI_IRQ_UART0                   57
+
 
 volatile rpi_irq_controller_t* RPI_GetIRQController(void);
 void init_irq_interruptHandlers(void);
@@ -109,5 +139,6 @@ void connectIRQInterrupt(unsigned int irqID, interruptFunction* function, void*
 void callInterruptHandlers();
 void enable_interrupts(void);
 void disable_interrupts(void);
+uint32_t interrupts_count();
 
 #endif //INTERRUPTS_H
@@ -30,6 +30,7 @@
 #include "fdsyscalls.h"
 #include "framebuffer.h"
 #include "fb.h"
+#include "vdso.h"
 
 extern void start_mmu(uint32_t ttl_address, uint32_t flags);
 
@@ -81,6 +82,15 @@ int memory_write(uint32_t address, void* buffer, uint32_t size) {
 	return 0;
 }
 
+/**	\fn void* memory_map(uint32_t address)
+ *	\brief Map driver for the in-memory filesystem: data can be used in place.
+ *	\param address Ramdisk offset.
+ *	\return Pointer to the data at this offset.
+ */
+void* memory_map(uint32_t address) {
+	return (void*) (address + (intptr_t)&__ramfs_start);
+}
+
 /** \fn void blink(int n)
  * 	\brief ACT LED blinking
  *	\param n The number of blinks.
@@ -144,6 +154,8 @@ void kernel_main(uint32_t memory) {
 	mmu_setup_ttbcr(TTBCR_ALIGN);
 
 	paging_init((__ram_size >> 20) - 1, 2+((((uintptr_t)&__kernel_phy_end) + PAGE_SECTION - 1) >> 20));
+	vdso_init();
+	vfp_init();
 
 	kernel_printf("[INFO][SERIAL] Serial output is hopefully ON.\r");
 
@@ -160,6 +172,8 @@ void kernel_main(uint32_t memory) {
 	Timer_Setup();
 	Timer_SetLoad(TIMER_LOAD);
 	Timer_Enable();
+	setup_loadavg();
+	cycle_counter_enable();
 
 
 	kernel_framebuffer = memalign(16,sizeof(frameBuffer));
@@ -240,6 +254,7 @@ void kernel_main(uint32_t memory) {
 	storage_driver memorydisk;
 	memorydisk.read    = memory_read;
 	memorydisk.write   = memory_write;
+	memorydisk.map     = memory_map;
 
 
 	superblock_t* fsroot = ext2fs_initialize(&memorydisk);
@@ -277,11 +292,9 @@ void kernel_main(uint32_t memory) {
 
 	process* p = process_load("/bin/init", vfs_path_to_inode(NULL, "/"), param, env); // init program
 
-	p->fd[0].inode 		= load_inode(vfs_path_to_inode(NULL, "/dev/serial")); // creates an unique inode for serial.
-	p->fd[0].position   = 0;
-
-	p->fd[1].inode      = load_inode(vfs_path_to_inode(NULL, "/dev/serial"));
-	p->fd[1].position   = 0;
+	// creates an unique inode for serial.
+	fd_install(p, fd_alloc(load_inode(vfs_path_to_inode(NULL, "/dev/serial")), O_RDWR));
+	fd_install(p, fd_alloc(load_inode(vfs_path_to_inode(NULL, "/dev/serial")), O_RDWR));
 
 
 	pipe_init();
@@ -300,6 +313,7 @@ void kernel_main(uint32_t memory) {
 		//kernel_printf("%p\n", p);
 		//kernel_printf("%p %p\n", p->ttb_address, mmu_vir2phy(p->ttb_address));
 	    mmu_set_ttb_0(mmu_vir2phy(p->ttb_address), TTBCR_ALIGN);
+		vdso_update(p->tgid);
 		asm volatile(
 			"mov 	r0, %0\n"
 			"ldmfd 	r0!, {r1, lr}\n"
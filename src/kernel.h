@@ -21,7 +21,9 @@
 
 
 /**	\def TIMER_LOAD
- *	\brief Period of the ARM Timer.
+ *	\brief Default time slice of the scheduling classes (in microseconds).
+ *
+ *	The slices can be changed at runtime through /proc/sys.
  */
 #define TIMER_LOAD 100
 
@@ -32,13 +34,7 @@
  */
 #define TTBCR_ALIGN 1
 
-/**	\def MAX_PROCESSES
- * 	\brief Maximum number of processes that can be handled
- */
-#define MAX_PROCESSES 500
-
 #define VFS_MAX_OPEN_FILES 1000
-#define VFS_MAX_OPEN_INODES 1000
 
 
 #endif
@@ -89,6 +89,20 @@ void paging_print_status() {
 	kernel_printf("%s\n", bitmap);
 }
 
+/**	\fn int paging_total_pages()
+ *	\brief Number of pages of the memory.
+ */
+int paging_total_pages() {
+	return tot_pages;
+}
+
+/**	\fn int paging_used_pages()
+ *	\brief Number of pages in use, kernel included.
+ */
+int paging_used_pages() {
+	return used_pages;
+}
+
 /**	\fn page_list_t* paging_allocate(int n_pages)
  *	\brief Allocates the request number of page.
  *	\param n_pages The number of pages to allocate.
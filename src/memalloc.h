@@ -22,6 +22,8 @@ struct page_list_t {
 void paging_print_status();
 void paging_free(int n_pages, int address);
 void paging_init(int n_total_pages, int n_reserved_pages);
+int paging_total_pages();
+int paging_used_pages();
 page_list_t* paging_allocate(int n_pages);
 int memalloc(uint32_t ttb_address, uintptr_t address, size_t size);
 
@@ -0,0 +1,200 @@
+#include "pidmap.h"
+#include <stdlib.h>
+#include <string.h>
+
+/** \file pidmap.c
+ *  \brief Process table, indexed by PID.
+ *
+ *  The table is a radix tree whose nodes are allocated when the first process
+ *  of their range appears and freed with the last one, so its size follows the
+ *  number of live processes. Walking it in order gives the processes sorted
+ *  by PID, and a lookup costs PIDMAP_LEVELS memory accesses.
+ *
+ *  PIDs are handed out in increasing order and wrap around at PID_MAX, so a
+ *  PID is not reused until the others have been tried.
+ */
+
+/** \var pidmap_node_t* pidmap_root
+ *  \brief Root of the radix tree, NULL when there is no process.
+ */
+static pidmap_node_t* pidmap_root;
+
+/** \var int pidmap_entries
+ *  \brief Number of processes in the table.
+ */
+static int pidmap_entries;
+
+/** \var pid_t pidmap_last
+ *  \brief Last PID handed out by pidmap_alloc, -1 at first.
+ */
+static pid_t pidmap_last = -1;
+
+/** \fn static int pidmap_slot(pid_t pid, int level)
+ *  \brief Slot of a PID in a node of a given level of the tree.
+ */
+static int pidmap_slot(pid_t pid, int level) {
+	return (pid >> ((PIDMAP_LEVELS - 1 - level) * PIDMAP_BITS)) & PIDMAP_MASK;
+}
+
+/** \fn process* pidmap_get(pid_t pid)
+ *  \brief Find a process.
+ *  \return The process with this PID, NULL if there is none.
+ */
+process* pidmap_get(pid_t pid) {
+	if (pid < 0 || pid >= PID_MAX) {
+		return NULL;
+	}
+	pidmap_node_t* node = pidmap_root;
+	for (int level = 0; level < PIDMAP_LEVELS - 1 && node != NULL; level++) {
+		node = node->slots[pidmap_slot(pid, level)];
+	}
+	return node != NULL ? node->slots[pidmap_slot(pid, PIDMAP_LEVELS - 1)] : NULL;
+}
+
+/** \fn static process* pidmap_find(pidmap_node_t* node, int level, pid_t pid)
+ *  \brief First process of a subtree whose PID is at least pid.
+ */
+static process* pidmap_find(pidmap_node_t* node, int level, pid_t pid) {
+	for (int i = pidmap_slot(pid, level); i < PIDMAP_SLOTS; i++) {
+		if (node->slots[i] != NULL) {
+			if (level == PIDMAP_LEVELS - 1) {
+				return node->slots[i];
+			}
+			process* p = pidmap_find(node->slots[i], level + 1, pid);
+			if (p != NULL) {
+				return p;
+			}
+		}
+		pid = 0; // The next subtrees only hold greater PIDs.
+	}
+	return NULL;
+}
+
+/** \fn process* pidmap_next(pid_t pid)
+ *  \brief Find the process with the lowest PID greater or equal to pid.
+ *  \return The process, NULL if there is none.
+ *
+ *  As the lookup starts over from the root, the table can be walked this way
+ *  while processes are removed from it.
+ */
+process* pidmap_next(pid_t pid) {
+	if (pid < 0) {
+		pid = 0;
+	}
+	if (pid >= PID_MAX || pidmap_root == NULL) {
+		return NULL;
+	}
+	return pidmap_find(pidmap_root, 0, pid);
+}
+
+/** \fn bool pidmap_set(pid_t pid, process* p)
+ *  \brief Insert a process in the table, or replace the one with the same PID.
+ *  \return false if a node could not be allocated.
+ *
+ *  On failure, the nodes already allocated stay in the tree, empty, and are
+ *  used by the next insertion in their range.
+ */
+bool pidmap_set(pid_t pid, process* p) {
+	if (pid < 0 || pid >= PID_MAX) {
+		return false;
+	}
+	pidmap_node_t* parent = NULL;
+	pidmap_node_t** node = &pidmap_root;
+	for (int level = 0; level < PIDMAP_LEVELS; level++) {
+		if (*node == NULL) {
+			*node = malloc(sizeof(pidmap_node_t));
+			if (*node == NULL) {
+				return false;
+			}
+			memset(*node, 0, sizeof(pidmap_node_t));
+			if (parent != NULL) {
+				parent->count++;
+			}
+		}
+		parent = *node;
+		if (level < PIDMAP_LEVELS - 1) {
+			node = (pidmap_node_t**)&parent->slots[pidmap_slot(pid, level)];
+		}
+	}
+	void** slot = &parent->slots[pidmap_slot(pid, PIDMAP_LEVELS - 1)];
+	if (*slot == NULL) {
+		parent->count++;
+		pidmap_entries++;
+	}
+	*slot = p;
+	return true;
+}
+
+/** \fn static bool pidmap_unlink(pidmap_node_t** node, int level, pid_t pid)
+ *  \brief Clear the slot of a PID in a subtree, freeing the nodes left empty.
+ *  \return true if the node was freed.
+ */
+static bool pidmap_unlink(pidmap_node_t** node, int level, pid_t pid) {
+	if (*node == NULL) {
+		return false;
+	}
+	void** slot = &(*node)->slots[pidmap_slot(pid, level)];
+	if (level < PIDMAP_LEVELS - 1) {
+		if (!pidmap_unlink((pidmap_node_t**)slot, level + 1, pid)) {
+			return false;
+		}
+	} else if (*slot == NULL) {
+		return false;
+	} else {
+		*slot = NULL;
+		pidmap_entries--;
+	}
+	if (--(*node)->count == 0) {
+		free(*node);
+		*node = NULL;
+		return true;
+	}
+	return false;
+}
+
+/** \fn void pidmap_remove(pid_t pid)
+ *  \brief Remove a process from the table.
+ */
+void pidmap_remove(pid_t pid) {
+	if (pid >= 0 && pid < PID_MAX) {
+		pidmap_unlink(&pidmap_root, 0, pid);
+	}
+}
+
+/** \fn pid_t pidmap_alloc()
+ *  \brief Choose the PID of a new process.
+ *  \return The first free PID after the last one given, -1 if there is none.
+ *
+ *  The PID is not reserved: the caller inserts the process right away. PID 0
+ *  belongs to init, so the search wraps around to 1 and PID_MAX - 1 PIDs can
+ *  be handed out.
+ */
+pid_t pidmap_alloc() {
+	int used = pidmap_entries - (pidmap_get(0) != NULL ? 1 : 0);
+	if (used >= PID_MAX - 1) {
+		return -1;
+	}
+	pid_t pid = pidmap_last;
+	do {
+		pid++;
+		if (pid >= PID_MAX) {
+			pid = 1;
+		}
+	} while (pidmap_get(pid) != NULL);
+	pidmap_last = pid;
+	return pid;
+}
+
+/** \fn pid_t pidmap_last_pid()
+ *  \brief Last PID handed out, -1 if none.
+ */
+pid_t pidmap_last_pid() {
+	return pidmap_last;
+}
+
+/** \fn int pidmap_count()
+ *  \brief Number of processes in the table.
+ */
+int pidmap_count() {
+	return pidmap_entries;
+}
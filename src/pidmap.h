@@ -0,0 +1,41 @@
+#ifndef PIDMAP_H
+#define PIDMAP_H
+
+#include <stdbool.h>
+#include "process.h"
+
+/** \def PIDMAP_BITS
+ *  \brief log2 of the number of slots of a node of the PID radix tree.
+ */
+#define PIDMAP_BITS 	5
+#define PIDMAP_SLOTS 	(1 << PIDMAP_BITS)
+#define PIDMAP_MASK 	(PIDMAP_SLOTS - 1)
+
+/** \def PIDMAP_LEVELS
+ *  \brief Depth of the PID radix tree.
+ */
+#define PIDMAP_LEVELS 	3
+
+/** \def PID_MAX
+ *  \brief PIDs are allocated below this bound, then wrap around.
+ */
+#define PID_MAX 		(1 << (PIDMAP_BITS * PIDMAP_LEVELS))
+
+/** \st pidmap_node_t
+ *  \brief Node of the PID radix tree. The slots of the last level point to
+ *  processes, the others to nodes.
+ */
+typedef struct {
+	void* slots[PIDMAP_SLOTS];
+	int count; ///< Number of used slots, the node is freed when it drops to 0.
+} pidmap_node_t;
+
+process* pidmap_get(pid_t pid);
+process* pidmap_next(pid_t pid);
+bool pidmap_set(pid_t pid, process* p);
+void pidmap_remove(pid_t pid);
+pid_t pidmap_alloc();
+pid_t pidmap_last_pid();
+int pidmap_count();
+
+#endif //PIDMAP_H
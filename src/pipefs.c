@@ -1,4 +1,5 @@
 #include "pipefs.h"
+#include "poll.h"
 #include <stdlib.h>
 
 /** \file pipefs.c
@@ -29,6 +30,7 @@ int 			buffer_end[MAX_PIPES];
 static inode_operations_t pipe_operations = {
 	.read = pipe_read,
 	.write = pipe_write,
+	.poll = pipe_poll,
 };
 
 void pipe_init() {
@@ -167,5 +169,17 @@ int pipe_write(inode_t pipe, char* buffer, int count, int ofs) {
 
 	buffer_end[i] = pos_blk;
 	//kernel_printf("write %d %d %d\n", count, buffer_begin[i], buffer_end[i]);
-	return to_write;
+	poll_wake(-1, i);
+	return count;
+}
+
+/** \fn int pipe_poll(inode_t pipe)
+ *  \brief A pipe can be read when it holds data, and always written.
+ */
+int pipe_poll(inode_t pipe) {
+	int i = pipe.st.st_ino;
+	if (pipe_buffers[i]->next != NULL || buffer_begin[i] != buffer_end[i]) {
+		return POLLIN | POLLOUT;
+	}
+	return POLLOUT;
 }
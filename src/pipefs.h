@@ -17,3 +17,4 @@ inode_t mkpipe();
 bool free_pipe(int index);
 int pipe_read(inode_t pipe, char* buffer, int count, int ofs);
 int pipe_write(inode_t pipe, char* buffer, int count, int ofs);
+int pipe_poll(inode_t pipe);
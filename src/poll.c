@@ -0,0 +1,271 @@
+#include "poll.h"
+#include "epoll.h"
+#include "fdsyscalls.h"
+#include "uaccess.h"
+#include <errno.h>
+#include "scheduler.h"
+#include "syscalls.h"
+#include "timer.h"
+
+/** \file poll.c
+ *  \brief Waiting for several files at once.
+ *
+ *  A process in poll leaves the active list, after adding itself to the wait
+ *  queue of each of its files. A file is identified by its device and inode
+ *  numbers, and its wait queue is the bucket of this key. The drivers call
+ *  poll_wake when a file becomes ready: its waiters are taken out of every
+ *  queue and put back in the active list with their poll call blocked, so
+ *  that poll runs again, with their memory mapped, when their turn comes.
+ */
+
+/** \var poll_entry_t* poll_queues[POLL_HASH_SIZE]
+ *  \brief Wait queues, indexed by the hash of the file key.
+ */
+static poll_entry_t* poll_queues[POLL_HASH_SIZE];
+
+/** \fn static uint32_t poll_key(int dev, ino_t ino)
+ *  \brief Key of a file. Pipes have no superblock, their device is -1.
+ */
+static uint32_t poll_key(int dev, ino_t ino) {
+	return ((uint32_t)dev << 16) ^ (uint32_t)ino;
+}
+
+/** \fn uint32_t poll_inode_key(inode_t* inode)
+ *  \brief Key of an open file.
+ */
+uint32_t poll_inode_key(inode_t* inode) {
+	if (S_ISFIFO(inode->st.st_mode) && inode->st.st_dev == -1) {
+		return poll_key(-1, inode->st.st_ino);
+	}
+	if (is_epoll(inode)) {
+		return poll_key(EPOLL_DEV, inode->st.st_ino);
+	}
+	return poll_key(inode->sb->id, inode->st.st_ino);
+}
+
+/** \fn uint32_t poll_hash(uint32_t key)
+ *  \brief Bucket of a file key, among POLL_HASH_SIZE.
+ */
+uint32_t poll_hash(uint32_t key) {
+	return (key * 2654435761u) >> (32 - POLL_HASH_BITS);
+}
+
+/** \fn static poll_entry_t** poll_queue(uint32_t key)
+ *  \brief Wait queue of a file.
+ */
+static poll_entry_t** poll_queue(uint32_t key) {
+	return &poll_queues[poll_hash(key)];
+}
+
+/** \fn static short poll_fd(process* p, int fd, short events)
+ *  \brief Events of a file descriptor, among the ones asked for. Errors are
+ *  always reported.
+ */
+static short poll_fd(process* p, int fd, short events) {
+	if (fd < 0) {
+		return 0;
+	}
+	fd_t* file = fd_get(p, fd);
+	if (file == NULL) {
+		return POLLNVAL;
+	}
+	inode_t* inode = file->inode;
+	int ready = POLLIN | POLLOUT; // Regular files never block.
+	if (inode->op->poll != NULL) {
+		ready = inode->op->poll(*inode);
+	}
+	return ready & (events | POLLERR | POLLHUP);
+}
+
+/** \fn static void poll_enqueue(process* p, uint32_t key)
+ *  \brief Add a process to the wait queue of a file, using its next entry.
+ */
+static void poll_enqueue(process* p, uint32_t key) {
+	poll_entry_t* entry = &p->poll_entries[p->poll_count++];
+	entry->p 	= p;
+	entry->key 	= key;
+
+	poll_entry_t** queue = poll_queue(key);
+	entry->next = *queue;
+	*queue = entry;
+}
+
+/** \fn static bool poll_register(process* p, struct pollfd* fds, nfds_t nfds)
+ *  \brief Add a process to the wait queues of its files.
+ *  \return false if there is no memory for it.
+ */
+static bool poll_register(process* p, struct pollfd* fds, nfds_t nfds) {
+	p->poll_entries = malloc(nfds * sizeof(poll_entry_t));
+	if (p->poll_entries == NULL && nfds > 0) {
+		return false;
+	}
+	p->poll_count = 0;
+	for (nfds_t i=0;i<nfds;i++) {
+		if (fds[i].fd >= 0) {
+			poll_enqueue(p, poll_inode_key(fd_get(p, fds[i].fd)->inode));
+		}
+	}
+	return true;
+}
+
+/** \fn bool poll_register_inode(process* p, inode_t* inode)
+ *  \brief Add a process to the wait queue of a single file.
+ *  \return false if there is no memory for it.
+ */
+bool poll_register_inode(process* p, inode_t* inode) {
+	p->poll_entries = malloc(sizeof(poll_entry_t));
+	if (p->poll_entries == NULL) {
+		return false;
+	}
+	p->poll_count = 0;
+	poll_enqueue(p, poll_inode_key(inode));
+	return true;
+}
+
+/** \fn void poll_release(process* p)
+ *  \brief Take a process out of the wait queues of its files.
+ */
+void poll_release(process* p) {
+	for (int i=0;i<p->poll_count;i++) {
+		poll_entry_t** link = poll_queue(p->poll_entries[i].key);
+		while (*link != NULL && *link != &p->poll_entries[i]) {
+			link = &(*link)->next;
+		}
+		if (*link != NULL) {
+			*link = (*link)->next;
+		}
+	}
+	free(p->poll_entries);
+	p->poll_entries = NULL;
+	p->poll_count = 0;
+}
+
+/** \fn static void poll_resume(process* p)
+ *  \brief Put a process in poll status back in the active list, with its
+ *  poll call to be run again.
+ */
+static void poll_resume(process* p) {
+	poll_release(p);
+	resume_process(p->asid);
+	p->status = status_blocked_svc;
+}
+
+/** \fn static void poll_timeout(timerHandler* handler, void* param, void* context)
+ *  \brief Timer handler resuming a process whose poll timed out.
+ *  \param param The process.
+ */
+static void poll_timeout(timerHandler* handler, void* param, void* context) {
+	(void) handler;
+	(void) context;
+	process* p = param;
+	if (p->status == status_poll) {
+		poll_resume(p);
+	}
+}
+
+/** \fn void poll_wake(int dev, ino_t ino)
+ *  \brief Resume the processes waiting for a file, which may be ready, and
+ *  tell the epoll instances watching it.
+ *  \param dev Device of the file, -1 for a pipe.
+ *  \param ino Inode number of the file.
+ */
+void poll_wake(int dev, ino_t ino) {
+	uint32_t key = poll_key(dev, ino);
+	epoll_notify(key);
+
+	poll_entry_t** queue = poll_queue(key);
+	poll_entry_t* entry = *queue;
+	while (entry != NULL) {
+		if (entry->key == key && entry->p->status == status_poll) {
+			poll_resume(entry->p); // Changes the queue.
+			entry = *queue;
+		} else {
+			entry = entry->next;
+		}
+	}
+}
+
+/** \fn bool poll_enter(process* p, int timeout)
+ *  \brief Start of a waiting call. The deadline is set on the first call only.
+ *  \param timeout Most milliseconds to wait, -1 to wait forever.
+ *  \return true if the call is run again after a wake up.
+ */
+bool poll_enter(process* p, int timeout) {
+	bool retry = p->status == status_blocked_svc;
+	p->status = status_active;
+	if (!retry) {
+		Timer_cancelHandler(&p->sleep_timer);
+		p->poll_deadline = timeout < 0 ? 0 : Timer_GetTime64() + (uint64_t)timeout * 1000;
+	}
+	return retry;
+}
+
+/** \fn bool poll_expired(process* p, int timeout)
+ *  \brief Tell whether a waiting call must return now, ready or not.
+ */
+bool poll_expired(process* p, int timeout) {
+	return timeout == 0 || (p->poll_deadline != 0 && Timer_GetTime64() >= p->poll_deadline);
+}
+
+/** \fn void poll_suspend(process* p, bool retry)
+ *  \brief Take a registered process out of the active list until a wake up
+ *  or its deadline, and switch to the next process.
+ */
+void poll_suspend(process* p, bool retry) {
+	suspend_process(p->asid, status_poll);
+	if (!retry && p->poll_deadline != 0) {
+		Timer_addHandler(&p->sleep_timer, p->poll_deadline, poll_timeout, p, NULL);
+	}
+	get_next_process();
+}
+
+/** \fn int svc_poll(struct pollfd* fds, nfds_t nfds, int timeout)
+ *  \brief Wait until one of the file descriptors is ready.
+ *  \param fds File descriptors, with the events waited for.
+ *  \param nfds Number of file descriptors.
+ *  \param timeout Most milliseconds to wait, -1 to wait forever.
+ *  \return The number of ready file descriptors, 0 on timeout, -errno on error.
+ *
+ *  When the caller is woken up, it is left blocked in the active list, and
+ *  this is called again to compute the events.
+ */
+int svc_poll(struct pollfd* fds, nfds_t nfds, int timeout) {
+	process* p = get_current_process();
+	bool retry = poll_enter(p, timeout);
+	if (nfds > MAX_OPEN_FILES) {
+		return -EINVAL;
+	}
+	// Worked on a copy, written back with the events.
+	struct pollfd* kfds = malloc(nfds * sizeof(struct pollfd));
+	if (kfds == NULL && nfds > 0) {
+		return -ENOMEM;
+	}
+	if (nfds > 0 && copy_from_user(kfds, fds, nfds * sizeof(struct pollfd)) < 0) {
+		free(kfds);
+		return -EFAULT;
+	}
+
+	int ready = 0;
+	for (nfds_t i=0;i<nfds;i++) {
+		kfds[i].revents = poll_fd(p, kfds[i].fd, kfds[i].events);
+		if (kfds[i].revents != 0) {
+			ready++;
+		}
+	}
+
+	if (ready > 0 || poll_expired(p, timeout)) {
+		Timer_cancelHandler(&p->sleep_timer);
+		int err = nfds > 0 ? copy_to_user(fds, kfds, nfds * sizeof(struct pollfd)) : 0;
+		free(kfds);
+		return err < 0 ? err : ready;
+	}
+
+	bool registered = poll_register(p, kfds, nfds);
+	free(kfds);
+	if (!registered) {
+		Timer_cancelHandler(&p->sleep_timer);
+		return -ENOMEM;
+	}
+	poll_suspend(p, retry);
+	return 0;
+}
@@ -0,0 +1,25 @@
+#ifndef POLL_H
+#define POLL_H
+
+#include <stdint.h>
+#include "process.h"
+#include "../include/poll.h"
+
+/** \def POLL_HASH_BITS
+ *  \brief log2 of the number of wait queues.
+ */
+#define POLL_HASH_BITS 6
+#define POLL_HASH_SIZE (1 << POLL_HASH_BITS)
+
+int svc_poll(struct pollfd* fds, nfds_t nfds, int timeout);
+void poll_wake(int dev, ino_t ino);
+void poll_release(process* p);
+
+uint32_t poll_inode_key(inode_t* inode);
+uint32_t poll_hash(uint32_t key);
+bool poll_register_inode(process* p, inode_t* inode);
+bool poll_enter(process* p, int timeout);
+bool poll_expired(process* p, int timeout);
+void poll_suspend(process* p, bool retry);
+
+#endif //POLL_H
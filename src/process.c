@@ -2,6 +2,12 @@
 #include "process.h"
 #include "malloc.h"
 #include "errno.h"
+#include "interrupts.h"
+#include "vdso.h"
+#include "futex.h"
+#include "poll.h"
+#include "fdsyscalls.h"
+#include "uaccess.h"
 
 extern unsigned int __ram_size;
 
@@ -69,6 +75,7 @@ process* process_load(char* path, inode_t cwd, const char* argv[], const char* e
     page_list_t* res = paging_allocate(1);
     if (res == NULL) {
         kdebug(D_PROCESS, 10, "Can't load %s: page allocation failed.\n", path);
+		free((void*)ttb_address);
 		errno = ENOMEM;
         return NULL;
     }
@@ -78,6 +85,7 @@ process* process_load(char* path, inode_t cwd, const char* argv[], const char* e
 
     // 1MB for the program. TODO: Make this less brutal. (not hardcoded as i could read the symbol table)
     mmu_add_section(ttb_address, 0, section_addr, ENABLE_CACHE|ENABLE_WRITE_BUFFER,0,AP_PRW_URW);
+	vdso_map(ttb_address);
     //mmu_add_section(ttb_address, __ram_size-PAGE_SECTION, section_stack, ENABLE_CACHE|ENABLE_WRITE_BUFFER,0,AP_PRW_URW);
     // Loads executable data into memory and allocates it.
     ph_entry_t ph;
@@ -140,31 +148,56 @@ process* process_load(char* path, inode_t cwd, const char* argv[], const char* e
 	}
 
     process* processus = malloc(sizeof(process));
+	process_group_t* group = malloc(sizeof(process_group_t));
+	if (processus == NULL || group == NULL || !fd_table_init(group)) {
+		kdebug(D_PROCESS, 10, "Can't load %s: process allocation failed.\n", path);
+		free(processus);
+		free(group);
+		paging_free(1, section_addr/PAGE_SECTION);
+		free((void*)ttb_address);
+		errno = ENOMEM;
+		return NULL;
+	}
     processus->asid = 1;
     processus->dummy = 0;
+	processus->sched_class = sched_class_interactive;
+	processus->slice_left = 0;
     processus->ttb_address = ttb_address;
     processus->status = status_active;
+	processus->group = group;
+	processus->group->threads = 1;
+	processus->clear_tid = NULL;
+	processus->futex_next = NULL;
+	processus->vfp = NULL;
+	processus->sig_blocked = 0;
+	processus->sig_pending = 0;
+	processus->sig_queue = NULL;
+	processus->sig_queued = 0;
+	processus->sig_frame = 0;
+	processus->uring_ops = NULL;
+	processus->poll_entries = NULL;
+	processus->poll_count = 0;
+	process_reset_stats(processus);
+	processus->group->cutime = 0;
+	processus->group->cstime = 0;
 	processus->ctx.cpsr = 0x110;
 	processus->ctx.pc = header.entry_point;
 	for (int i=0;i<15;i++) {
 		processus->ctx.r[i] = i;
 	}
 
-    processus->brk = PAGE_SECTION;
-    processus->brk_page = 0;
+    processus->group->brk = PAGE_SECTION;
+    processus->group->brk_page = 0;
 	processus->cwd = cwd;
 	processus->allocated_framebuffer = false;
+	processus->sleep_timer.pending = false;
 	for (int i=0;i<32;i++) {
-		processus->sighandlers[i].handler = SIG_DFL;
+		processus->group->sighandlers[i].handler = SIG_DFL;
 	}
 
 	kdebug(D_PROCESS, 2, "Program loaded %s. S0=%p\n ttb=%p\n", path, section_addr, ttb_address);
 
 
-    for (int i=0;i<MAX_OPEN_FILES;i++) {
-        processus->fd[i].position = -1;
-    }
-
 	char* name = basename(path);
 	processus->name = malloc(strlen(name)+1);
 	strcpy(processus->name, name);
@@ -172,30 +205,234 @@ process* process_load(char* path, inode_t cwd, const char* argv[], const char* e
     return processus;
 }
 
-/** \fn bool process_signal(process* p, siginfo_t signal)
+/** \fn static void signal_interrupt(process* p)
+ *	\brief Interrupt the blocking service call of a process, so that it can
+ *	run a signal handler. The call returns EINTR.
+ */
+static void signal_interrupt(process* p) {
+	if (p->status == status_sleep) { // The sleep is interrupted.
+		uint64_t deadline = p->sleep_timer.deadline;
+		wake_process(p->asid);
+		// clock_nanosleep returns the error number, nanosleep sets errno.
+		p->ctx.r[0] = p->ctx.r[7] == SVC_CLOCK_NANOSLEEP ? EINTR : -EINTR;
+		if (p->sleep_rem != NULL) {
+			uint64_t now  = Timer_GetTime64();
+			uint64_t left = deadline > now ? deadline - now : 0;
+			struct timespec rem;
+			rem.tv_sec  = left / 1000000;
+			rem.tv_nsec = (left % 1000000) * 1000;
+			copy_to_process(p, p->sleep_rem, &rem, sizeof(struct timespec));
+		}
+	} else if (p->status == status_futex) { // The futex wait is interrupted.
+		Timer_cancelHandler(&p->sleep_timer);
+		futex_cancel(p);
+		resume_process(p->asid);
+		p->ctx.r[0] = -EINTR;
+	} else if (p->status == status_poll) { // The poll is interrupted.
+		Timer_cancelHandler(&p->sleep_timer);
+		poll_release(p);
+		resume_process(p->asid);
+		p->ctx.r[0] = -EINTR;
+	} else if (p->status == status_wait) {
+		resume_process(p->asid);
+		p->ctx.r[0] = -EINTR;
+	} else if (p->status == status_blocked_svc) { // Still in the active list.
+		p->status = status_active;
+		p->ctx.r[0] = -EINTR;
+	}
+}
+
+/** \fn int process_signal(process* p, siginfo_t signal)
  *	\brief Send a signal to a process.
- *	\return If the process should be killed or not.
+ *	\return 1 if the process should be killed, 0 if the signal was queued or
+ *	ignored, -EAGAIN if too many signals are queued.
+ *
+ *	The signal is delivered the next time the process returns to user mode
+ *	and doesn't block it, see process_deliver_signal. Signals sent with
+ *	sigqueue (SI_QUEUE) are all queued, others are merged with a pending
+ *	signal of the same number.
  */
-bool process_signal(process* p, siginfo_t signal) {
+int process_signal(process* p, siginfo_t signal) {
 	int sig = signal.si_signo;
+	if (sig <= 0 || sig >= N_SIGNALS) {
+		return 0;
+	}
+	uint32_t bit = 1 << sig;
+	void (*handler)(int) = p->group->sighandlers[sig].handler;
+
+	if (handler == SIG_IGN || (handler == SIG_DFL && !(SIG_FATAL & bit))) {
+		return 0;
+	}
+	if (handler == SIG_DFL && !(p->sig_blocked & bit)) {
+		return 1;
+	}
 
-	if (p->sighandlers[sig].handler == SIG_DFL) {
-		switch (sig) {
-			case SIGTERM:
-			case SIGKILL:
-			case SIGSEGV:
-				return true;
-			default:
-				return false;
+	bool queued = signal.si_code == SI_QUEUE;
+	if (queued || !(p->sig_pending & bit)) {
+		if (queued && p->sig_queued >= SIGQUEUE_MAX) {
+			return -EAGAIN;
 		}
-	} else if (p->sighandlers[sig].handler == SIG_IGN) {
-		return false;
-	} else {
-		p->old_ctx = p->ctx; // Save context.
-		p->ctx.pc = (intptr_t)p->sighandlers[sig].handler; // Call handler.
-		intptr_t dest_addr = 0x80000000 + mmu_vir2phy_ttb((intptr_t)p->sighandlers[sig].user_siginfo, p->ttb_address);
-		memcpy((void*)dest_addr, &signal, sizeof(siginfo_t));
-		p->ctx.r[0] = sig;
+		sigqueue_t* entry = malloc(sizeof(sigqueue_t));
+		if (entry == NULL) {
+			return -EAGAIN;
+		}
+		entry->info = signal;
+		entry->next = NULL;
+
+		sigqueue_t** last = &p->sig_queue;
+		while (*last != NULL) {
+			last = &(*last)->next;
+		}
+		*last = entry;
+		p->sig_pending |= bit;
+		if (queued) {
+			p->sig_queued++;
+		}
+	}
+
+	if (!(p->sig_blocked & bit)) {
+		signal_interrupt(p);
+	}
+	return 0;
+}
+
+/** \fn static void signal_dequeue(process* p, int sig, siginfo_t* info)
+ *	\brief Take the oldest pending signal of a given number.
+ */
+static void signal_dequeue(process* p, int sig, siginfo_t* info) {
+	sigqueue_t** entry = &p->sig_queue;
+	while ((*entry)->info.si_signo != sig) {
+		entry = &(*entry)->next;
+	}
+	sigqueue_t* found = *entry;
+	*entry = found->next;
+	*info = found->info;
+	if (info->si_code == SI_QUEUE) {
+		p->sig_queued--;
+	}
+	free(found);
+
+	for (sigqueue_t* e = *entry; e != NULL; e = e->next) {
+		if (e->info.si_signo == sig) {
+			return; // Another one is pending.
+		}
+	}
+	p->sig_pending &= ~(1 << sig);
+}
+
+/** \fn void process_signal_discard(process* p, int sig)
+ *	\brief Forget the pending signals of a given number.
+ */
+void process_signal_discard(process* p, int sig) {
+	siginfo_t info;
+	while (p->sig_pending & (1 << sig)) {
+		signal_dequeue(p, sig, &info);
+	}
+}
+
+/** \fn void process_signal_free(process* p)
+ *	\brief Forget all the pending signals of a dying process.
+ */
+void process_signal_free(process* p) {
+	while (p->sig_queue != NULL) {
+		sigqueue_t* next = p->sig_queue->next;
+		free(p->sig_queue);
+		p->sig_queue = next;
+	}
+	p->sig_pending = 0;
+	p->sig_queued = 0;
+}
+
+/** \fn int process_deliver_signal(process* p, user_context_t* ctx)
+ *	\brief Deliver a pending signal to a process returning to user mode.
+ *	\param p The process, whose translation table is the current one.
+ *	\param ctx The context about to be restored, changed to call the handler.
+ *	\return 0, or the number of the signal killing the process.
+ *
+ *	The lowest numbered signal that isn't blocked is taken. Ignored ones are
+ *	dropped, the default action of the others is to kill the process. For a
+ *	handler, a signal_frame_t is pushed on the user stack: the handler runs on
+ *	top of it with the signal blocked, and returns to the restorer given to
+ *	sigaction, which calls sigreturn. If the frame can't be written, the
+ *	process is killed by SIGSEGV.
+ */
+int process_deliver_signal(process* p, user_context_t* ctx) {
+	uint32_t deliverable;
+	while ((deliverable = p->sig_pending & ~p->sig_blocked) != 0) {
+		int sig = __builtin_ctz(deliverable);
+		siginfo_t info;
+		signal_dequeue(p, sig, &info);
+
+		signal_handler_t* h = &p->group->sighandlers[sig];
+		if (h->handler == SIG_IGN || (h->handler == SIG_DFL && !(SIG_FATAL & (1 << sig)))) {
+			continue;
+		} else if (h->handler == SIG_DFL) {
+			return sig;
+		}
+
+		uintptr_t addr = (ctx->r[13] - sizeof(signal_frame_t)) & ~7;
+		signal_frame_t frame;
+		frame.ctx 		= *ctx;
+		frame.blocked 	= p->sig_blocked;
+		frame.prev 		= p->sig_frame;
+		frame.has_vfp 	= vfp_signal_enter(p, &frame.vfp);
+		frame.info 		= info;
+		if (copy_to_user((void*)addr, &frame, sizeof(signal_frame_t)) < 0) {
+			return SIGSEGV;
+		}
+		if (h->user_siginfo != NULL) {
+			copy_to_user(h->user_siginfo, &info, sizeof(siginfo_t));
+		}
+
+		p->sig_frame 	= addr;
+		p->sig_blocked |= 1 << sig;
+
+		uintptr_t entry = (uintptr_t)h->handler;
+		ctx->r[0] 	= sig;
+		ctx->r[1] 	= addr + offsetof(signal_frame_t, info);
+		ctx->r[2] 	= 0;
+		ctx->r[13] 	= addr;
+		ctx->r[14] 	= (uintptr_t)h->restorer;
+		ctx->pc 	= entry & ~1;
+		ctx->cpsr 	= (ctx->cpsr & ~(CPSR_THUMB | CPSR_IT)) | ((entry & 1) ? CPSR_THUMB : 0);
+		return 0;
+	}
+	return 0;
+}
+
+/** \fn bool process_signal_return(process* p)
+ *	\brief Leave a signal handler: restore the context and signal mask saved in
+ *	its frame.
+ *	\param p The process, whose translation table is the current one.
+ *	\return false if there is no valid frame.
+ *
+ *	The frame is in user memory: the restored status register is forced back
+ *	to user mode, with interrupts enabled.
+ */
+bool process_signal_return(process* p) {
+	signal_frame_t frame;
+	if (copy_from_user(&frame, (void*)p->sig_frame, sizeof(signal_frame_t)) < 0) {
 		return false;
 	}
+	p->ctx 			= frame.ctx;
+	p->ctx.cpsr 	= (frame.ctx.cpsr & ~CPSR_PRIVILEGED) | CPSR_USER_MODE;
+	p->sig_blocked 	= frame.blocked & ~SIG_UNBLOCKABLE;
+	if (frame.has_vfp) {
+		vfp_signal_return(p, &frame.vfp);
+	}
+	p->sig_frame 	= frame.prev;
+	return true;
+}
+
+/** \fn void process_reset_stats(process* p)
+ *	\brief Clear the accounting counters of a new process.
+ */
+void process_reset_stats(process* p) {
+	p->utime 	= 0;
+	p->stime 	= 0;
+	p->nvcsw 	= 0;
+	p->nivcsw 	= 0;
+	p->faults 	= 0;
+	p->syscalls = 0;
+	memset(&p->latency, 0, sizeof(sched_latency_t));
 }
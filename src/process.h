@@ -11,6 +11,10 @@
 #include <libgen.h>
 #include <signal.h>
 #include "../include/signals.h"
+#include "../include/clocks.h"
+#include "../include/uring.h"
+#include "timer.h"
+#include "vfp.h"
 
 /** \struct user_context_t
  *	\brief User process data on a context switch.
@@ -21,10 +25,24 @@ typedef struct {
 	uint32_t r[15]; ///< Process registers.
 } user_context_t;
 
+/**
+ * Fields of the status register of a user context.
+ */
+#define CPSR_USER_MODE 		0x10
+#define CPSR_THUMB 			(1 << 5)
+#define CPSR_IT 			((0x3F << 10) | (0x3 << 25)) ///< If-then state.
+#define CPSR_PRIVILEGED 	0x1DF ///< Mode and A, I, F mask bits.
+
 /** \def MAX_OPEN_FILES
  * 	\brief Number of file descriptor that a process can open.
  */
-#define MAX_OPEN_FILES 64
+#define MAX_OPEN_FILES 1024
+
+/** \def FD_TABLE_SIZE
+ * 	\brief Initial size of a file descriptor table, which grows by doubling.
+ *	A multiple of 32, like every size of the table.
+ */
+#define FD_TABLE_SIZE 32
 
 #define N_SIGNALS 	32
 
@@ -32,15 +50,35 @@ typedef struct {
 #define SIGSEGV 	11
 #define SIGTERM 	15
 
+/** \def SIG_FATAL
+ * 	\brief Signals terminating the process by default. The others are ignored
+ * 	by default.
+ */
+#define SIG_FATAL 			((1 << SIGKILL) | (1 << SIGSEGV) | (1 << SIGTERM))
+
+/** \def SIG_UNBLOCKABLE
+ * 	\brief Signals that can't be blocked.
+ */
+#define SIG_UNBLOCKABLE 	(1 << SIGKILL)
+
+/** \def SIGQUEUE_MAX
+ * 	\brief Number of signals sent with sigqueue that can wait for a process.
+ */
+#define SIGQUEUE_MAX 		32
+
 /** \struct fd_t
- * 	\brief File descriptor structure.
+ * 	\brief Open file description, shared by the file descriptors duplicated
+ *	from it, by dup or fork.
  */
 typedef struct {
     inode_t* inode; ///< Open file inode.
     int position; ///< Cursor position in the file.
 	vfs_dir_list_t* dir_entry; ///< If the inode is a directory, store it's entries.
+	vfs_dir_list_t* dir_cursor; ///< Directory entry number dir_position, NULL past the end.
+	int dir_position; ///< Entry number of dir_cursor.
 	int flags; ///< Open flags.
 	bool read_blocking;
+	int ref_count; ///< Number of file descriptors, in every process, referring to it.
 } fd_t;
 
 /** \enum status_process
@@ -50,9 +88,25 @@ typedef enum {
     status_active, ///< The process is running/runnable.
     status_wait, ///< The process is waiting for a child event.
     status_zombie, ///< Zombie mode for a killed process.
-	status_blocked_svc ///< Waiting for a service call to return.
+	status_blocked_svc, ///< Waiting for a service call to return.
+	status_sleep, ///< Sleeping until its timer expires.
+	status_futex, ///< Waiting for a futex wake up.
+	status_poll ///< Waiting for a file to be ready, or a timeout.
 } status_process;
 
+/** \def N_SCHED_CLASSES
+ * 	\brief Number of scheduling classes.
+ */
+#define N_SCHED_CLASSES 2
+
+/** \enum sched_class_t
+ * 	\brief Scheduling class of a process, which gives the length of its time slices.
+ */
+typedef enum {
+	sched_class_interactive, ///< The process blocked before the end of its last time slice.
+	sched_class_batch ///< The process used the whole of its last time slice.
+} sched_class_t;
+
 /** \struct wait_parameters_t
  * 	\brief Options when a parent waits for its children.
  */
@@ -65,28 +119,128 @@ typedef struct {
 typedef struct {
 	void     (*handler)(int);
 	siginfo_t* user_siginfo;
+	void 	 (*restorer)(void); ///< Where the handler returns, calls sigreturn.
 } signal_handler_t;
 
-/** \struct process
- *	\brief All the data representing a process.
+typedef struct sigqueue_t sigqueue_t;
+/** \struct sigqueue_t
+ *	\brief A pending signal.
+ */
+struct sigqueue_t {
+	siginfo_t info;
+	sigqueue_t* next;
+};
+
+typedef struct uring_op_t uring_op_t;
+/** \struct uring_op_t
+ *	\brief A ring request waiting for a device.
+ */
+struct uring_op_t {
+	uring_sqe_t sqe;
+	uring_t* ring; ///< Where the completion goes.
+	uring_op_t* next;
+};
+
+typedef struct poll_entry_t poll_entry_t;
+/** \struct poll_entry_t
+ *	\brief A process waiting for a file, in the wait queue of this file.
+ */
+struct poll_entry_t {
+	struct process* p;
+	uint32_t key; ///< The file (see poll.c).
+	poll_entry_t* next; ///< Next entry of the wait queue.
+};
+
+/** \struct signal_frame_t
+ *	\brief What is pushed on the user stack when a signal handler is called.
+ */
+typedef struct {
+	user_context_t ctx; ///< Interrupted context.
+	uint32_t blocked; ///< Signal mask of the interrupted context.
+	uintptr_t prev; ///< Frame of the interrupted handler, 0 if none.
+	uint32_t has_vfp; ///< The FPU registers are saved.
+	vfp_state_t vfp; ///< FPU registers of the interrupted context.
+	siginfo_t info; ///< Passed to the handler.
+} signal_frame_t;
+
+/** \def SCHED_LAT_BUCKETS
+ *	\brief Size of the scheduling latency histogram. Bucket i counts the
+ *	latencies below 16 << i microseconds, the last one the longer ones.
+ */
+#define SCHED_LAT_BUCKETS 12
+
+/** \struct sched_latency_t
+ *	\brief Time a process waited for the CPU while runnable.
+ */
+typedef struct {
+	uint64_t ready_since; ///< When it became runnable without running, 0 if it runs or waits for something else.
+	uintptr_t woken_by; ///< Code which made it runnable.
+	uint32_t count; ///< Number of latencies measured.
+	uint64_t total; ///< Sum of the latencies, in microseconds.
+	uint32_t max; ///< Longest latency, in microseconds.
+	uint32_t hist[SCHED_LAT_BUCKETS];
+} sched_latency_t;
+
+/** \struct process_group_t
+ *	\brief Resources shared by the threads of a process.
  */
 typedef struct {
+	int threads; ///< Number of threads using these resources.
+    int brk; ///< Program break.
+    int brk_page; ///< Number of pages allocated for program break
+    fd_t** fd; ///< Process' file descriptors, NULL when closed.
+	uint32_t* fd_map; ///< Bit set for each open file descriptor.
+	int fd_size; ///< Number of file descriptors in the table.
+	signal_handler_t sighandlers[N_SIGNALS];
+	uint64_t cutime; ///< User time of the reaped children, in microseconds.
+	uint64_t cstime; ///< System time of the reaped children, in microseconds.
+} process_group_t;
+
+typedef struct process process;
+/** \struct process
+ *	\brief All the data representing a process, or one of its threads.
+ *
+ *	The threads of a process share the translation table and the group, but
+ *	each of them has its own entry in the process list.
+ */
+struct process {
     status_process status; ///< Execution status.
     int dummy; ///< Number of context switch to this process.
+	sched_class_t sched_class; ///< Scheduling class.
+	uint32_t slice_left; ///< Remaining time slice in microseconds (0: a new slice is given).
     uintptr_t ttb_address; ///< Address of process' translation table.
-    pid_t asid; ///< Program ID
+    pid_t asid; ///< Program ID (thread ID for a thread).
+	pid_t tgid; ///< ID of the first thread of the process, which is the pid seen by userland.
 	pid_t parent_id; ///< Parent ID
-    int brk; ///< Program break.
-    int brk_page; ///< Number of pages allocated for program break
-    fd_t fd[MAX_OPEN_FILES]; ///< Process' file descriptors
+	process_group_t* group; ///< Resources shared with the other threads.
 	user_context_t ctx; ///< Process' execution context.
-	user_context_t old_ctx; ///< Process' execution context before a signal was caught.
 	wait_parameters_t wait; ///< When in wait status, wait parameters. When in zombie status, stores exit code.
 	inode_t cwd; ///< Current working directory.
 	char* name; ///< Process name.
-	signal_handler_t sighandlers[N_SIGNALS];
 	bool allocated_framebuffer;
-} process;
+	timerHandler sleep_timer; ///< Wakes the process up when in sleep status.
+	struct timespec* sleep_rem; ///< Where to write the time left if the sleep is interrupted.
+	int* clear_tid; ///< Cleared and futex-woken when the thread exits (NULL if none).
+	uintptr_t futex_key; ///< When in futex status, the futex waited for.
+	process* futex_next; ///< Next process waiting on a futex.
+	vfp_state_t* vfp; ///< Saved FPU registers, NULL until the FPU is used.
+	uint64_t utime; ///< Time spent in user mode, in microseconds.
+	uint64_t stime; ///< Time spent in the kernel for the process, in microseconds.
+	uint32_t nvcsw; ///< Voluntary context switches (the process blocked).
+	uint32_t nivcsw; ///< Involuntary context switches (its slice expired).
+	uint32_t faults; ///< Memory access faults.
+	uint32_t syscalls; ///< Service calls made.
+	uint32_t sig_blocked; ///< Signals whose delivery is delayed.
+	uint32_t sig_pending; ///< Signals sent but not delivered yet.
+	sigqueue_t* sig_queue; ///< Pending signals, oldest first.
+	int sig_queued; ///< Number of pending signals sent with sigqueue.
+	uintptr_t sig_frame; ///< Frame of the running signal handler on the user stack, 0 if none.
+	sched_latency_t latency; ///< Scheduling latency statistics.
+	uring_op_t* uring_ops; ///< Ring requests waiting for a device, oldest first.
+	poll_entry_t* poll_entries; ///< When in poll status, its entries in the wait queues.
+	int poll_count; ///< Number of poll_entries.
+	uint64_t poll_deadline; ///< When the running poll times out (see Timer_GetTime64), 0 if never.
+};
 
 #define ELF_ABI_SYSTEMV 0
 
@@ -159,6 +313,11 @@ typedef struct {
 } sh_entry_t;
 
 process* process_load(char* path, inode_t cwd, const char* argv[], const char *envp[]);
-bool process_signal(process* p, siginfo_t signal);
+int process_signal(process* p, siginfo_t signal);
+int process_deliver_signal(process* p, user_context_t* ctx);
+bool process_signal_return(process* p);
+void process_signal_discard(process* p, int sig);
+void process_signal_free(process* p);
+void process_reset_stats(process* p);
 
 #endif //PROCESS_H
@@ -6,6 +6,7 @@
 static inode_operations_t proc_inode_operations = {
   .read_dir = proc_lsdir,
   .read = proc_fread,
+  .write = proc_fwrite,
 };
 
 /**	\fn superblock_t* proc_initialize(int id)
@@ -15,7 +16,7 @@ static inode_operations_t proc_inode_operations = {
 superblock_t* proc_initialize(int id) {
 	superblock_t* res = malloc(sizeof(superblock_t));
     res->id = id;
-    res->root.st.st_ino    = 2;
+    res->root.st.st_ino    = PROC_ROOT;
     res->root.st.st_size   = 1024;
     res->root.st.st_mode   = S_IFDIR | S_IRWXU | S_IRWXO | S_IRWXG;
     res->root.st.st_dev    = id;
@@ -28,41 +29,333 @@ superblock_t* proc_initialize(int id) {
  *	\brief List the process directory.
  */
 vfs_dir_list_t* proc_lsdir(inode_t from) {
-    if (from.st.st_ino == 2) {
+    if (from.st.st_ino == PROC_ROOT) {
 		vfs_dir_list_t* res = NULL;
         inode_t r;
-		r.st.st_ino = 2;
+		r.st.st_ino = PROC_ROOT;
         r.st.st_mode = S_IFREG | S_IRUSR | S_IROTH | S_IRGRP;
         r.st.st_size = 69;
         r.sb = from.sb;
         r.op = &proc_inode_operations;
 
 
-		for (int i=0;i<MAX_PROCESSES;i++) {
-			process** list = get_process_list();
-			process* p = list[i];
-			if (p != NULL) {
-		        r.st.st_ino = p->asid + 3;
-				char buf[10];
-				sprintf(buf, "%d", p->asid);
-		        res = dev_append_elem(r,buf,res);
-			}
+		process* p;
+		for_each_process(p) {
+	        r.st.st_ino = PROC_PID_INODE(p->asid, PROC_PID_DIR);
+			r.st.st_mode = S_IFDIR | S_IRUSR | S_IXUSR | S_IROTH | S_IXOTH | S_IRGRP | S_IXGRP;
+			char buf[10];
+			sprintf(buf, "%d", p->asid);
+	        res = dev_append_elem(r,buf,res);
 		}
 
+		r.st.st_mode = S_IFREG | S_IRUSR | S_IROTH | S_IRGRP;
+		r.st.st_ino = PROC_STAT;
+		res = dev_append_elem(r, "stat", res);
+
+		r.st.st_ino = PROC_MEMINFO;
+		res = dev_append_elem(r, "meminfo", res);
+
+		r.st.st_ino = PROC_SCHED_LATENCY;
+		res = dev_append_elem(r, "sched_latency", res);
+
+		r.st.st_ino = PROC_LOADAVG;
+		res = dev_append_elem(r, "loadavg", res);
+
+		r.st.st_ino = PROC_SYSCALLS;
+		res = dev_append_elem(r, "syscalls", res);
+
+		r.st.st_mode = S_IFDIR | S_IRWXU | S_IRWXO | S_IRWXG;
+		r.st.st_ino = PROC_SYS;
+		res = dev_append_elem(r, "sys", res);
+
 		r.st.st_mode = S_IFDIR;
-        r.st.st_ino = 2;
+        r.st.st_ino = PROC_ROOT;
         res = dev_append_elem(r, ".", res);
 
 		r.st.st_mode = S_IFDIR;
-        r.st.st_ino = 2;
+        r.st.st_ino = PROC_ROOT;
         res = dev_append_elem(r, "..", res);
 		return res;
+	} else if (from.st.st_ino == PROC_SYS) {
+		vfs_dir_list_t* res = NULL;
+		inode_t r;
+		r.st.st_mode = S_IFREG | S_IRUSR | S_IWUSR | S_IROTH | S_IRGRP;
+		r.st.st_size = 16;
+		r.sb = from.sb;
+		r.op = &proc_inode_operations;
+
+		r.st.st_ino = PROC_SYS_QUANTUM_BATCH;
+		res = dev_append_elem(r, "sched_quantum_batch", res);
+
+		r.st.st_ino = PROC_SYS_QUANTUM_INTERACTIVE;
+		res = dev_append_elem(r, "sched_quantum_interactive", res);
+
+		r.st.st_mode = S_IFDIR;
+		r.st.st_ino = PROC_SYS;
+		res = dev_append_elem(r, ".", res);
+
+		r.st.st_mode = S_IFDIR;
+		r.st.st_ino = PROC_ROOT;
+		res = dev_append_elem(r, "..", res);
+		return res;
+	} else if (from.st.st_ino >= PROC_PID_BASE && (from.st.st_ino - PROC_PID_BASE) % PROC_PID_NODES == PROC_PID_DIR) {
+		int pid = (from.st.st_ino - PROC_PID_BASE) / PROC_PID_NODES;
+		if (get_process(pid) == NULL) {
+			errno = ENOENT;
+			return NULL;
+		}
+		vfs_dir_list_t* res = NULL;
+		inode_t r;
+		r.st.st_mode = S_IFREG | S_IRUSR | S_IROTH | S_IRGRP;
+		r.st.st_size = 69;
+		r.sb = from.sb;
+		r.op = &proc_inode_operations;
+
+		r.st.st_ino = PROC_PID_INODE(pid, PROC_PID_STATUS);
+		res = dev_append_elem(r, "status", res);
+
+		r.st.st_ino = PROC_PID_INODE(pid, PROC_PID_STAT);
+		res = dev_append_elem(r, "stat", res);
+
+		r.st.st_mode = S_IFDIR;
+		r.st.st_ino = from.st.st_ino;
+		res = dev_append_elem(r, ".", res);
+
+		r.st.st_mode = S_IFDIR;
+		r.st.st_ino = PROC_ROOT;
+		res = dev_append_elem(r, "..", res);
+		return res;
 	} else {
 		errno = ENOENT;
 		return NULL;
 	}
 }
 
+/**	\fn int proc_copy(char* data, int n, char* buf, int size, int pos)
+ *	\brief Copy a part of a generated file content.
+ *	\param data Content of the file.
+ *	\param n Size of the content.
+ *	\param buf Destination buffer.
+ *	\param size Size buffer.
+ *	\param pos Offset.
+ *	\return The number of bytes copied.
+ */
+static int proc_copy(char* data, int n, char* buf, int size, int pos) {
+	if (pos < n) {
+		strncpy(buf, data+pos, size);
+		return min(n-pos,size);
+	} else {
+		return 0;
+	}
+}
+
+/**	\fn char proc_state(process* p)
+ *	\brief One letter status of a process: R(unning), S(leeping) or Z(ombie).
+ */
+static char proc_state(process* p) {
+	switch (p->status) {
+		case status_active:
+			return 'R';
+		case status_zombie:
+			return 'Z';
+		default:
+			return 'S';
+	}
+}
+
+/**	\fn int proc_stat(process* p, char* data)
+ *	\brief Generate the content of /proc/<pid>/stat.
+ *	\param p The process.
+ *	\param data Destination buffer.
+ *	\return The size of the content.
+ *
+ *	A single line of space separated fields:
+ *	pid (name) state ppid tgid utime stime cutime cstime nvcsw nivcsw faults
+ *	syscalls threads rss. Times are in milliseconds, rss is in kilobytes.
+ */
+static int proc_stat(process* p, char* data) {
+	unsigned rss = (p->group->brk_page + 2) * (PAGE_SECTION / 1024); // Code, stack and heap sections.
+	return sprintf(data, "%d (%s) %c %d %d %lu %lu %lu %lu %lu %lu %lu %lu %d %u\n",
+				   p->asid,
+				   p->name,
+				   proc_state(p),
+				   p->parent_id,
+				   p->tgid,
+				   (unsigned long)(p->utime / 1000),
+				   (unsigned long)(p->stime / 1000),
+				   (unsigned long)(p->group->cutime / 1000),
+				   (unsigned long)(p->group->cstime / 1000),
+				   (unsigned long)p->nvcsw,
+				   (unsigned long)p->nivcsw,
+				   (unsigned long)p->faults,
+				   (unsigned long)p->syscalls,
+				   p->group->threads,
+				   rss);
+}
+
+/**	\fn int proc_global_stat(char* data)
+ *	\brief Generate the content of /proc/stat.
+ *	\param data Destination buffer.
+ *	\return The size of the content.
+ *
+ *	CPU time spent in user mode, in the kernel and idle (milliseconds), number
+ *	of hardware interrupts, uptime (milliseconds) and length of the run queue.
+ */
+static int proc_global_stat(char* data) {
+	uint64_t user, system, idle;
+	account_get_totals(&user, &system, &idle);
+
+	int running, blocked;
+	scheduler_run_queue(&running, &blocked);
+
+	return sprintf(data, "cpu %lu %lu %lu\nintr %lu\nuptime %lu\nprocs_running %d\nprocs_blocked %d\n",
+				   (unsigned long)(user / 1000),
+				   (unsigned long)(system / 1000),
+				   (unsigned long)(idle / 1000),
+				   (unsigned long)interrupts_count(),
+				   (unsigned long)(Timer_GetTime64() / 1000),
+				   running,
+				   blocked);
+}
+
+/**	\fn int proc_loadavg(char* data)
+ *	\brief Generate the content of /proc/loadavg.
+ *	\param data Destination buffer.
+ *	\return The size of the content.
+ *
+ *	As on Linux: the load averages over 1, 5 and 15 minutes, the runnable and
+ *	total numbers of processes, and the last PID given. A last field gives the
+ *	number of processes blocked on a device.
+ */
+static int proc_loadavg(char* data) {
+	uint32_t load[3];
+	scheduler_get_loadavg(load);
+	int running, blocked;
+	scheduler_run_queue(&running, &blocked);
+	return sprintf(data, "%u.%02u %u.%02u %u.%02u %d/%d %d %d\n",
+				   (unsigned)load[0] / 100, (unsigned)load[0] % 100,
+				   (unsigned)load[1] / 100, (unsigned)load[1] % 100,
+				   (unsigned)load[2] / 100, (unsigned)load[2] % 100,
+				   running,
+				   get_number_processes(),
+				   pidmap_last_pid(),
+				   blocked);
+}
+
+/**	\fn int proc_meminfo(char* data)
+ *	\brief Generate the content of /proc/meminfo, sizes in kilobytes.
+ */
+static int proc_meminfo(char* data) {
+	unsigned total 	= paging_total_pages() * (PAGE_SECTION / 1024);
+	unsigned used 	= paging_used_pages() * (PAGE_SECTION / 1024);
+	return sprintf(data, "MemTotal: %u kB\nMemFree: %u kB\nMemUsed: %u kB\n",
+				   total,
+				   total - used,
+				   used);
+}
+
+/**	\fn char* proc_syscalls(int* n)
+ *	\brief Generate the content of /proc/syscalls.
+ *	\param n Where to store the size of the content.
+ *	\return The content, to be freed by the caller, NULL if it could not be
+ *	allocated.
+ *
+ *	One line per service call: number, name, times called and thousands of
+ *	CPU cycles spent in the kernel for it.
+ */
+static char* proc_syscalls(int* n) {
+	int count = 0;
+	for (int i=0;i<SVC_TABLE_SIZE;i++) {
+		if (svc_lookup(i) != NULL) {
+			count++;
+		}
+	}
+	char* data = malloc(64 + count * 64);
+	if (data == NULL) {
+		return NULL;
+	}
+	int len = sprintf(data, "  NR NAME                 CALLS        KCYCLES\n");
+	for (int i=0;i<SVC_TABLE_SIZE;i++) {
+		svc_entry_t* svc = svc_lookup(i);
+		if (svc != NULL) {
+			len += sprintf(data+len, "%4d %-16s %9lu %14lu\n",
+						   i,
+						   svc->name,
+						   (unsigned long)svc->calls,
+						   (unsigned long)(svc->cycles / 1000));
+		}
+	}
+	*n = len;
+	return data;
+}
+
+/**	\fn char* proc_sched_latency(int* n)
+ *	\brief Generate the content of /proc/sched_latency.
+ *	\param n Where to store the size of the content.
+ *	\return The content, to be freed by the caller, NULL if it could not be
+ *	allocated.
+ *
+ *	The worst latency seen, with the call chain which gave the CPU to the
+ *	process and the scheduler events before, then one line per process: the
+ *	number of latencies measured, their mean and maximum, and their histogram.
+ *	Latencies and times are in microseconds.
+ */
+static char* proc_sched_latency(int* n) {
+	static const char* event_names[] = {"wakeup", "preempt", "switch", "exit"};
+	char* data = malloc(2048 + get_number_processes() * (48 + 8 * SCHED_LAT_BUCKETS));
+	if (data == NULL) {
+		return NULL;
+	}
+
+	const sched_latency_max_t* worst = sched_trace_max();
+	int len = sprintf(data, "max: %lu pid %d at %lu woken by %#lx\npath:",
+					  (unsigned long)worst->latency,
+					  worst->pid,
+					  (unsigned long)worst->time,
+					  (unsigned long)worst->woken_by);
+	for (int i=0;i<worst->depth;i++) {
+		len += sprintf(data+len, " %#lx", (unsigned long)worst->path[i]);
+	}
+	len += sprintf(data+len, "\n");
+	for (int i=0;i<worst->trail_length;i++) {
+		const sched_event_t* e = &worst->trail[i];
+		len += sprintf(data+len, "%10lu %-7s %5d %8lu %#lx\n",
+					   (unsigned long)e->time,
+					   event_names[e->type],
+					   e->pid,
+					   (unsigned long)e->latency,
+					   (unsigned long)e->site);
+	}
+
+	len += sprintf(data+len, "\n  PID    COUNT      AVG      MAX");
+	for (int i=0;i<SCHED_LAT_BUCKETS;i++) {
+		char label[12];
+		if (i < SCHED_LAT_BUCKETS-1) {
+			sprintf(label, "<%u", 16u << i);
+		} else {
+			sprintf(label, ">=%u", 16u << (i-1));
+		}
+		len += sprintf(data+len, " %7s", label);
+	}
+	len += sprintf(data+len, "\n");
+
+	process* p;
+	for_each_process(p) {
+		sched_latency_t* l = &p->latency;
+		len += sprintf(data+len, "%5d %8lu %8lu %8lu",
+					   p->asid,
+					   (unsigned long)l->count,
+					   (unsigned long)(l->count > 0 ? l->total / l->count : 0),
+					   (unsigned long)l->max);
+		for (int i=0;i<SCHED_LAT_BUCKETS;i++) {
+			len += sprintf(data+len, " %7lu", (unsigned long)l->hist[i]);
+		}
+		len += sprintf(data+len, "\n");
+	}
+	*n = len;
+	return data;
+}
+
 /**	\fn int proc_fread(inode_t from, char* buf, int size, int pos)
  *	\brief Read process data.
  *	\param from Inode representing a process.
@@ -71,45 +364,61 @@ vfs_dir_list_t* proc_lsdir(inode_t from) {
  *	\param pos Offset.
  */
 int proc_fread(inode_t from, char* buf, int size, int pos) {
-    if (from.st.st_ino == 2) {
+	char data_buffer[1024];
+	int n;
+
+    if (from.st.st_ino == PROC_ROOT || from.st.st_ino == PROC_SYS) {
 		errno = EISDIR;
 		return -1;
+	} else if (from.st.st_ino == PROC_SYS_QUANTUM_INTERACTIVE) {
+		n = sprintf(data_buffer, "%u\n", (unsigned)scheduler_get_quantum(sched_class_interactive));
+		return proc_copy(data_buffer, n, buf, size, pos);
+	} else if (from.st.st_ino == PROC_SYS_QUANTUM_BATCH) {
+		n = sprintf(data_buffer, "%u\n", (unsigned)scheduler_get_quantum(sched_class_batch));
+		return proc_copy(data_buffer, n, buf, size, pos);
+	} else if (from.st.st_ino == PROC_STAT) {
+		n = proc_global_stat(data_buffer);
+		return proc_copy(data_buffer, n, buf, size, pos);
+	} else if (from.st.st_ino == PROC_MEMINFO) {
+		n = proc_meminfo(data_buffer);
+		return proc_copy(data_buffer, n, buf, size, pos);
+	} else if (from.st.st_ino == PROC_LOADAVG) {
+		n = proc_loadavg(data_buffer);
+		return proc_copy(data_buffer, n, buf, size, pos);
+	} else if (from.st.st_ino == PROC_SCHED_LATENCY || from.st.st_ino == PROC_SYSCALLS) {
+		char* data = from.st.st_ino == PROC_SYSCALLS ? proc_syscalls(&n) : proc_sched_latency(&n);
+		if (data == NULL) {
+			errno = ENOMEM;
+			return -1;
+		}
+		int res = proc_copy(data, n, buf, size, pos);
+		free(data);
+		return res;
 	} else {
-		int pid = from.st.st_ino - 3;
-		if (pid < 0 || pid >= MAX_PROCESSES) {
+		int pid 	= (from.st.st_ino - PROC_PID_BASE) / PROC_PID_NODES;
+		int node 	= (from.st.st_ino - PROC_PID_BASE) % PROC_PID_NODES;
+		if (from.st.st_ino < PROC_PID_BASE || pid >= PID_MAX) {
 			errno = ENOENT;
 			return -1;
+		} else if (node == PROC_PID_DIR) {
+			errno = EISDIR;
+			return -1;
 		} else {
-			process** list = get_process_list();
-			process* p = list[pid];
+			process* p = get_process(pid);
 			if (p != NULL) {
-				char data_buffer[1024];
-				data_buffer[0] = 0;
 				char str_state[2];
+				str_state[0] = proc_state(p);
 				str_state[1] = 0;
-				switch (p->status) {
-					case status_active:
-						str_state[0] = 'R';
-						break;
-					case status_blocked_svc:
-					case status_wait:
-						str_state[0] = 'S';
-						break;
-					case status_zombie:
-						str_state[0] = 'Z';
-						break;
-				}
-				int n = sprintf(data_buffer, "Name: % -32s\nState:  %s\nPID: % 4d\nPPID: % 3d\n",
-							p->name,
-							str_state,
-							p->asid,
-							p->parent_id);
-				if (pos < n) {
-					strncpy(buf, data_buffer+pos, size);
-					return min(n-pos,size);
+				if (node == PROC_PID_STATUS) {
+					n = sprintf(data_buffer, "Name: % -32s\nState:  %s\nPID: % 4d\nPPID: % 3d\n",
+								p->name,
+								str_state,
+								p->asid,
+								p->parent_id);
 				} else {
-					return 0;
+					n = proc_stat(p, data_buffer);
 				}
+				return proc_copy(data_buffer, n, buf, size, pos);
 			} else {
 				errno = ENOENT;
 				return -1;
@@ -117,3 +426,45 @@ int proc_fread(inode_t from, char* buf, int size, int pos) {
 		}
 	}
 }
+
+/**	\fn int proc_fwrite(inode_t from, char* buf, int size, int pos)
+ *	\brief Write a kernel parameter.
+ *	\param from Inode representing a /proc/sys file.
+ *	\param buf Source buffer, holding the new value in decimal.
+ *	\param size Size buffer.
+ *	\param pos Offset (ignored, the whole value is always written).
+ *	\return The number of bytes written on success, -1 on fail with errno set.
+ */
+int proc_fwrite(inode_t from, char* buf, int size, int pos) {
+	(void) pos;
+	char value[16];
+	if (size <= 0 || size >= (int)sizeof(value)) {
+		errno = EINVAL;
+		return -1;
+	}
+	memcpy(value, buf, size);
+	value[size] = 0;
+
+	char* end;
+	long quantum = strtol(value, &end, 10);
+	if (end == value || (*end != 0 && *end != '\n')) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	sched_class_t cls;
+	if (from.st.st_ino == PROC_SYS_QUANTUM_INTERACTIVE) {
+		cls = sched_class_interactive;
+	} else if (from.st.st_ino == PROC_SYS_QUANTUM_BATCH) {
+		cls = sched_class_batch;
+	} else {
+		errno = EACCES;
+		return -1;
+	}
+
+	if (quantum < 0 || !scheduler_set_quantum(cls, quantum)) {
+		errno = EINVAL;
+		return -1;
+	}
+	return size;
+}
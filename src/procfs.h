@@ -1,9 +1,38 @@
 #include "process.h"
 #include "scheduler.h"
 #include "dev.h"
+#include "interrupts.h"
+#include "memalloc.h"
+#include "pidmap.h"
+#include "timer.h"
+#include "schedtrace.h"
+#include "svctable.h"
 #include <stdio.h>
 #include <errno.h>
 
+/**
+ * Inode numbers of the process filesystem.
+ * The inodes of /proc/<pid> and of its files are given by PROC_PID_INODE.
+ */
+#define PROC_ROOT 						2
+#define PROC_SYS 						3
+#define PROC_SYS_QUANTUM_INTERACTIVE 	4
+#define PROC_SYS_QUANTUM_BATCH 			5
+#define PROC_STAT 						6
+#define PROC_MEMINFO 					7
+#define PROC_SCHED_LATENCY 				8
+#define PROC_LOADAVG 					9
+#define PROC_SYSCALLS 					10
+#define PROC_PID_BASE 					16
+
+#define PROC_PID_DIR 					0 ///< /proc/<pid>
+#define PROC_PID_STATUS 				1 ///< /proc/<pid>/status
+#define PROC_PID_STAT 					2 ///< /proc/<pid>/stat
+#define PROC_PID_NODES 					4
+
+#define PROC_PID_INODE(pid, node) 		(PROC_PID_BASE + (pid)*PROC_PID_NODES + (node))
+
 superblock_t* proc_initialize(int id);
 vfs_dir_list_t* proc_lsdir(inode_t from);
 int proc_fread(inode_t from, char* buf, int size, int pos);
+int proc_fwrite(inode_t from, char* buf, int size, int pos);
@@ -0,0 +1,175 @@
+#include "schedtrace.h"
+#include <string.h>
+#include "timer.h"
+
+/** \file schedtrace.c
+ *  \brief Scheduler latency tracer.
+ *
+ *  The scheduler reports when a process becomes runnable, loses the CPU while
+ *  still runnable, gets the CPU or dies. These events go to a ring buffer, and
+ *  the time between becoming runnable and getting the CPU is added to the
+ *  latency histogram of the process.
+ *
+ *  Events are only recorded from the kernel, which runs with interrupts
+ *  masked on a single core: a writer is never interrupted by another one, so
+ *  the ring needs no lock. It is never emptied, the oldest events are simply
+ *  overwritten.
+ *
+ *  When a process waits longer than any before, the call chain which gave it
+ *  the CPU and the last events are saved. The kernel keeps frame pointers, so
+ *  the chain is read by following the saved fp and lr of each frame.
+ */
+
+/** \var sched_event_t sched_events[SCHED_TRACE_SIZE]
+ *  \brief The trace ring.
+ */
+static sched_event_t sched_events[SCHED_TRACE_SIZE];
+
+/** \var uint32_t sched_events_head
+ *  \brief Number of events recorded so far, the next goes at head & MASK.
+ */
+static uint32_t sched_events_head;
+
+/** \var sched_latency_max_t sched_max
+ *  \brief The worst latency seen.
+ */
+static sched_latency_max_t sched_max;
+
+/** \fn static void sched_trace_record(process* p, sched_event_type_t type, uint64_t time, uint32_t latency, uintptr_t site)
+ *  \brief Add an event to the ring.
+ */
+static void sched_trace_record(process* p, sched_event_type_t type, uint64_t time, uint32_t latency, uintptr_t site) {
+	sched_event_t* e = &sched_events[sched_events_head & SCHED_TRACE_MASK];
+	e->time 	= time;
+	e->pid 		= p->asid;
+	e->type 	= type;
+	e->latency 	= latency;
+	e->site 	= site;
+	sched_events_head++;
+}
+
+/** \fn static int sched_trace_last(sched_event_t* events, int count)
+ *  \brief Copy the last events of the ring, oldest first.
+ *  \return The number of events copied, at most count.
+ */
+static int sched_trace_last(sched_event_t* events, int count) {
+	if ((uint32_t)count > sched_events_head) {
+		count = sched_events_head;
+	}
+	if (count > SCHED_TRACE_SIZE) {
+		count = SCHED_TRACE_SIZE;
+	}
+	for (int i=0;i<count;i++) {
+		events[i] = sched_events[(sched_events_head - count + i) & SCHED_TRACE_MASK];
+	}
+	return count;
+}
+
+/** \fn static int sched_trace_backtrace(uintptr_t* fp, uintptr_t* path, int max)
+ *  \brief Walk the kernel stack from a frame.
+ *  \param fp Frame pointer of a function which is not a leaf.
+ *  \param path Where to store the return addresses, innermost first.
+ *  \return The number of addresses stored.
+ *
+ *  An ARM frame keeps the return address at fp and the frame pointer of the
+ *  caller at fp-4. The exception entry does not set up a frame, so the walk
+ *  stops at the first pointer which does not lead up the same stack.
+ */
+static int sched_trace_backtrace(uintptr_t* fp, uintptr_t* path, int max) {
+	uintptr_t start = (uintptr_t)fp;
+	int n = 0;
+	while (n < max) {
+		path[n++] = fp[0];
+		uintptr_t* caller = (uintptr_t*)fp[-1];
+		if (caller <= fp || (uintptr_t)caller - start >= SCHED_TRACE_STACK_SPAN || ((uintptr_t)caller & 3)) {
+			break;
+		}
+		fp = caller;
+	}
+	return n;
+}
+
+/** \fn static int sched_trace_bucket(uint32_t latency)
+ *  \brief Histogram bucket of a latency, in microseconds.
+ */
+static int sched_trace_bucket(uint32_t latency) {
+	int bucket = 0;
+	latency >>= 4;
+	while (latency > 0 && bucket < SCHED_LAT_BUCKETS - 1) {
+		latency >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+/** \fn void sched_trace_wakeup(process* p, uintptr_t site)
+ *  \brief A process was put in the active list.
+ *  \param p The process.
+ *  \param site The code which made it runnable.
+ */
+void sched_trace_wakeup(process* p, uintptr_t site) {
+	uint64_t now = Timer_GetTime64();
+	p->latency.ready_since 	= now;
+	p->latency.woken_by 	= site;
+	sched_trace_record(p, sched_event_wakeup, now, 0, site);
+}
+
+/** \fn void sched_trace_preempt(process* p, uintptr_t site)
+ *  \brief A runnable process lost the CPU: it waits from now on.
+ *  \param p The process.
+ *  \param site The code which gave the CPU to another process.
+ */
+void sched_trace_preempt(process* p, uintptr_t site) {
+	uint64_t now = Timer_GetTime64();
+	p->latency.ready_since 	= now;
+	p->latency.woken_by 	= site;
+	sched_trace_record(p, sched_event_preempt, now, 0, site);
+}
+
+/** \fn void sched_trace_switch(process* p)
+ *  \brief A process gets the CPU, measure how long it waited for it.
+ *  \param p The process.
+ */
+void sched_trace_switch(process* p) {
+	if (p->latency.ready_since == 0) {
+		return; // It was already running.
+	}
+	uint64_t now = Timer_GetTime64();
+	uint64_t waited = now - p->latency.ready_since;
+	uint32_t latency = waited > UINT32_MAX ? UINT32_MAX : (uint32_t)waited;
+	uintptr_t site = (uintptr_t)__builtin_return_address(0);
+
+	p->latency.ready_since = 0;
+	p->latency.count++;
+	p->latency.total += latency;
+	p->latency.hist[sched_trace_bucket(latency)]++;
+	if (latency > p->latency.max) {
+		p->latency.max = latency;
+	}
+	sched_trace_record(p, sched_event_switch, now, latency, site);
+
+	if (latency > sched_max.latency) {
+		sched_max.latency 		= latency;
+		sched_max.pid 			= p->asid;
+		sched_max.time 			= now;
+		sched_max.woken_by 		= p->latency.woken_by;
+		sched_max.depth 		= sched_trace_backtrace(__builtin_frame_address(0), sched_max.path, SCHED_TRACE_DEPTH);
+		sched_max.trail_length 	= sched_trace_last(sched_max.trail, SCHED_TRACE_TRAIL);
+	}
+}
+
+/** \fn void sched_trace_exit(process* p, uintptr_t site)
+ *  \brief A process (or thread) died.
+ *  \param p The process.
+ *  \param site The code which killed it.
+ */
+void sched_trace_exit(process* p, uintptr_t site) {
+	sched_trace_record(p, sched_event_exit, Timer_GetTime64(), 0, site);
+}
+
+/** \fn const sched_latency_max_t* sched_trace_max()
+ *  \brief The worst latency seen since boot.
+ */
+const sched_latency_max_t* sched_trace_max() {
+	return &sched_max;
+}
@@ -0,0 +1,70 @@
+#ifndef SCHEDTRACE_H
+#define SCHEDTRACE_H
+
+#include <stdint.h>
+#include "process.h"
+
+/** \def SCHED_TRACE_BITS
+ *  \brief log2 of the number of events kept in the trace ring.
+ */
+#define SCHED_TRACE_BITS 	8
+#define SCHED_TRACE_SIZE 	(1 << SCHED_TRACE_BITS)
+#define SCHED_TRACE_MASK 	(SCHED_TRACE_SIZE - 1)
+
+/** \def SCHED_TRACE_TRAIL
+ *  \brief Number of events saved with the worst latency.
+ */
+#define SCHED_TRACE_TRAIL 	16
+
+/** \def SCHED_TRACE_DEPTH
+ *  \brief Maximum number of return addresses saved with the worst latency.
+ */
+#define SCHED_TRACE_DEPTH 	8
+
+/** \def SCHED_TRACE_STACK_SPAN
+ *  \brief The stack walk stops at frames further than this from its start.
+ */
+#define SCHED_TRACE_STACK_SPAN 0x1000
+
+/** \enum sched_event_type_t
+ *  \brief What happened to a process.
+ */
+typedef enum {
+	sched_event_wakeup, ///< It became runnable.
+	sched_event_preempt, ///< It lost the CPU while runnable.
+	sched_event_switch, ///< It got the CPU.
+	sched_event_exit, ///< It died.
+} sched_event_type_t;
+
+/** \struct sched_event_t
+ *  \brief An entry of the trace ring.
+ */
+typedef struct {
+	uint64_t time; ///< Timer_GetTime64 when it happened.
+	pid_t pid;
+	sched_event_type_t type;
+	uint32_t latency; ///< For a switch, the time waited for the CPU in microseconds.
+	uintptr_t site; ///< Code responsible for the event.
+} sched_event_t;
+
+/** \struct sched_latency_max_t
+ *  \brief The worst latency seen, and how the process got there.
+ */
+typedef struct {
+	uint32_t latency; ///< In microseconds, 0 if none was measured.
+	pid_t pid;
+	uint64_t time; ///< When the process got the CPU.
+	uintptr_t woken_by; ///< Code which made the process runnable.
+	int depth; ///< Number of return addresses in path.
+	uintptr_t path[SCHED_TRACE_DEPTH]; ///< Call chain which gave it the CPU, innermost first.
+	int trail_length; ///< Number of events in trail.
+	sched_event_t trail[SCHED_TRACE_TRAIL]; ///< Last events before the switch, oldest first.
+} sched_latency_max_t;
+
+void sched_trace_wakeup(process* p, uintptr_t site);
+void sched_trace_preempt(process* p, uintptr_t site);
+void sched_trace_switch(process* p);
+void sched_trace_exit(process* p, uintptr_t site);
+const sched_latency_max_t* sched_trace_max();
+
+#endif //SCHEDTRACE_H
@@ -7,61 +7,151 @@
 #include "debug.h"
 #include "string.h"
 #include "fdsyscalls.h"
+#include "arm.h"
+#include "timer.h"
+#include "futex.h"
+#include "pidmap.h"
+#include "schedtrace.h"
+#include "uring.h"
+#include "poll.h"
+#include "uaccess.h"
+
+/** \def IDLE_STACK_SIZE
+ *	\brief Size (in words) of the stack used by the idle context.
+ */
+#define IDLE_STACK_SIZE 256
 
-/** \var process* process_list[MAX_PROCESSES]
- *	\brief List of possible processes (not all are active)
+/** \def SCHED_MIN_QUANTUM
+ *	\brief Shortest allowed time slice, in microseconds.
  */
-static process* process_list[MAX_PROCESSES];
+#define SCHED_MIN_QUANTUM 10
 
-/** \var int active_processes[MAX_PROCESSES]
- *	\brief List of active processes (only the first number_active_processes)
+/** \def LOAD_FREQ
+ *	\brief Time between two samples of the run queue for the load averages,
+ *	in microseconds.
+ */
+#define LOAD_FREQ 5000000
+
+/** \def LOAD_SHIFT
+ *	\brief Load averages are fixed point numbers with this many fractional bits.
+ */
+#define LOAD_SHIFT 11
+#define LOAD_ONE (1 << LOAD_SHIFT)
+
+/** \def SCHED_MIN_CAPACITY
+ *	\brief Initial size of the active and zombie lists, which never shrink
+ *	below it.
  */
-static int active_processes[MAX_PROCESSES];
+#define SCHED_MIN_CAPACITY 16
 
-/** \var int free_processes[MAX_PROCESSES];
- * 	\brief List of free processes (only the first number_free_processes)
+/** \var int* active_processes
+ *	\brief List of active processes (only the first number_active_processes)
  */
-static int free_processes[MAX_PROCESSES];
+static int* active_processes;
 
-/** \var int zombie_processes[MAX_PROCESSES];
+/** \var int* zombie_processes
  * 	\brief List of zombie processes (only the first number_zombie_processes)
  */
-static int zombie_processes[MAX_PROCESSES];
+static int* zombie_processes;
+
+/** \var int process_capacity
+ * 	\brief Size of the active and zombie lists, at least the number of
+ * 	processes so that they never overflow.
+ */
+static int process_capacity;
 
 /** \var int current_process_id
  * 	\brief Index of current process in active_processes.
  */
 static int current_process_id;
 
+/** \var pid_t running_pid
+ * 	\brief Process last given the CPU by get_next_process, -1 if none.
+ */
+static pid_t running_pid;
+
 /** \var int number_active_processes
  * 	\brief Active processes count.
  */
 static int number_active_processes;
 
-/** \var int number_free_processes
- * 	\brief Free processes count.
- */
-static int number_free_processes;
-
 /** \var int number_zombie_processes
  * 	\brief Zombie processes count.
  */
 static int number_zombie_processes;
 
 
+/** \var uint32_t sched_quantum[N_SCHED_CLASSES]
+ * 	\brief Time slice length of each scheduling class, in microseconds.
+ */
+static uint32_t sched_quantum[N_SCHED_CLASSES];
+
+/** \var bool idle
+ * 	\brief True when no process is running and the CPU waits in the idle context.
+ */
+static bool idle;
+
+/** \var user_context_t idle_ctx
+ * 	\brief Context restored when no process is runnable.
+ */
+static user_context_t idle_ctx;
+
+/** \var uint32_t idle_stack[IDLE_STACK_SIZE]
+ * 	\brief Stack of the idle context.
+ */
+static uint32_t idle_stack[IDLE_STACK_SIZE];
+
 /** \fn void setup_scheduler()
  *	\brief Initialize scheduler global variables.
  */
 void setup_scheduler() {
     kernel_printf("[SHED] Scheduler set up!\n");
     current_process_id = -1;
+    running_pid = -1;
+    idle = false;
+    for (int i=0;i<N_SCHED_CLASSES;i++) {
+        sched_quantum[i] = TIMER_LOAD;
+    }
     number_active_processes = 0;
 	number_zombie_processes = 0;
-    number_free_processes = MAX_PROCESSES;
-    for(int i = 0; i<MAX_PROCESSES; i++) {
-        process_list[i] = NULL;
-        free_processes[i] = MAX_PROCESSES-i-1;
-    }
+	process_capacity = SCHED_MIN_CAPACITY;
+	active_processes = malloc(process_capacity * sizeof(int));
+	zombie_processes = malloc(process_capacity * sizeof(int));
+}
+
+/** \fn static bool resize_lists(int capacity)
+ *	\brief Change the size of the active and zombie lists.
+ *	\return false if the memory could not be allocated, the lists are then
+ *	unchanged.
+ */
+static bool resize_lists(int capacity) {
+	int* active = realloc(active_processes, capacity * sizeof(int));
+	if (active == NULL) {
+		return false;
+	}
+	active_processes = active;
+	int* zombie = realloc(zombie_processes, capacity * sizeof(int));
+	if (zombie == NULL) {
+		process_capacity = min(capacity, process_capacity); // Size of the smaller list.
+		return false;
+	}
+	zombie_processes = zombie;
+	process_capacity = capacity;
+	return true;
+}
+
+/** \fn static void release_process(int const process_id)
+ *	\brief Remove a process from the process table, after it left the active
+ *	and zombie lists.
+ *
+ *	The lists shrink when they are mostly unused, so that memory follows the
+ *	number of processes.
+ */
+static void release_process(int const process_id) {
+	pidmap_remove(process_id);
+	if (process_capacity > SCHED_MIN_CAPACITY && pidmap_count() < process_capacity / 4) {
+		resize_lists(process_capacity / 2);
+	}
 }
 
 /** \fn process* get_next_process()
@@ -70,8 +160,11 @@ void setup_scheduler() {
  */
 process* get_next_process() {
     if(number_active_processes == 0) {
+        idle = true;
+        running_pid = -1;
         return NULL;
     }
+    idle = false;
 
     if(current_process_id < 0) {
         current_process_id = 0;
@@ -82,10 +175,79 @@ process* get_next_process() {
     if(current_process_id >= number_active_processes) {
         current_process_id = 0;
     }
-	process_list[active_processes[current_process_id]]->dummy++;
+	process* p = pidmap_get(active_processes[current_process_id]);
+	p->dummy++;
+
+	process* prev = pidmap_get(running_pid);
+	if (prev != NULL && prev != p && (prev->status == status_active || prev->status == status_blocked_svc)) {
+		sched_trace_preempt(prev, (uintptr_t)__builtin_return_address(0));
+	}
+	sched_trace_switch(p);
+	running_pid = p->asid;
 
 //kernel_printf("\033[s\033[%d;%dH%d\033[u", 1, 1, active_processes[current_process_id]);
-    return process_list[active_processes[current_process_id]];
+    return p;
+}
+
+/** \fn uint32_t scheduler_get_quantum(sched_class_t cls)
+ *	\brief Get the time slice length of a scheduling class.
+ *	\param cls The scheduling class.
+ *	\return The slice length in microseconds.
+ */
+uint32_t scheduler_get_quantum(sched_class_t cls) {
+	return sched_quantum[cls];
+}
+
+/** \fn bool scheduler_set_quantum(sched_class_t cls, uint32_t quantum)
+ *	\brief Change the time slice length of a scheduling class.
+ *	\param cls The scheduling class.
+ *	\param quantum The slice length in microseconds.
+ *	\return true on success, false if the length is out of bounds.
+ *
+ *	Running processes keep their current slice, the new length applies to the
+ *	next slices.
+ */
+bool scheduler_set_quantum(sched_class_t cls, uint32_t quantum) {
+	if (quantum < SCHED_MIN_QUANTUM || quantum > TIMER_MAX_LOAD) {
+		return false;
+	}
+	sched_quantum[cls] = quantum;
+	return true;
+}
+
+/** \fn void idle_loop()
+ *	\brief Body of the idle context: sleep until the next interrupt.
+ */
+static void idle_loop() {
+	while(1) {
+		wait_for_interrupt();
+	}
+}
+
+/** \fn user_context_t* scheduler_enter_idle()
+ *	\brief Put the CPU in the idle context, as no process can run.
+ *	\return The context to restore.
+ *
+ *	The idle context runs in system mode with interrupts enabled, so that the
+ *	next IRQ (UART, timer) brings the control back to interrupt_vector().
+ *	Until get_next_process() is called, there is no current process.
+ */
+user_context_t* scheduler_enter_idle() {
+	idle = true;
+	idle_ctx.cpsr 	= 0x11F; // System mode, IRQ enabled.
+	idle_ctx.pc 	= (uintptr_t)idle_loop;
+	for (int i=0;i<15;i++) {
+		idle_ctx.r[i] = 0;
+	}
+	idle_ctx.r[13] 	= (uintptr_t)&idle_stack[IDLE_STACK_SIZE];
+	return &idle_ctx;
+}
+
+/** \fn bool scheduler_is_idle()
+ *	\brief Tells if the CPU is currently in the idle context.
+ */
+bool scheduler_is_idle() {
+	return idle;
 }
 
 extern uint32_t __ram_size;
@@ -93,31 +255,277 @@ extern uint32_t __ram_size;
 /**	\fn void free_process_data (process* p)
  *	\param p The process data to free.
  *	\brief Free all the allocated memory of a process.
+ *
+ *	The resources shared by the threads of the process are only released with
+ *	the last of them.
  */
 void free_process_data(process* p) {
-	// Free program break.
-	int n_allocated_pages = p->brk_page;
-	for (int i=n_allocated_pages;i>0;i--) {
-		int phy_page = mmu_vir2phy_ttb(i*PAGE_SECTION, p->ttb_address) / PAGE_SECTION; // let's hope GCC optimizes this
-		paging_free(1,phy_page);
-	}
+	if (--p->group->threads == 0) {
+		// Free program break.
+		int n_allocated_pages = p->group->brk_page;
+		for (int i=n_allocated_pages;i>0;i--) {
+			int phy_page = mmu_vir2phy_ttb(i*PAGE_SECTION, p->ttb_address) / PAGE_SECTION; // let's hope GCC optimizes this
+			paging_free(1,phy_page);
+		}
 
-	// free stack and program code
-	paging_free(1,mmu_vir2phy_ttb(0, p->ttb_address)/PAGE_SECTION);
-	paging_free(1,mmu_vir2phy_ttb(__ram_size-PAGE_SECTION, p->ttb_address)/PAGE_SECTION);
+		// free stack and program code
+		paging_free(1,mmu_vir2phy_ttb(0, p->ttb_address)/PAGE_SECTION);
+		paging_free(1,mmu_vir2phy_ttb(__ram_size-PAGE_SECTION, p->ttb_address)/PAGE_SECTION);
 
-	for (int i=0;i<64;i++) {
-		if (p->fd[i].position >= 0) {
-			free_vfs_dir_list(p->fd[i].dir_entry);
-			unload_inode(p->fd[i].inode);
-		}
+		fd_table_free(p->group);
+
+		free((void*)p->ttb_address);
+		free(p->group);
 	}
 
+	process_signal_free(p);
+	uring_release(p);
+	vfp_release(p);
 	free(p->name);
-	free((void*)p->ttb_address);
 	free(p);
 }
 
+/** \var uint64_t account_mark
+ *	\brief Time of the last transition between user mode and the kernel.
+ */
+static uint64_t account_mark;
+
+/** \var int account_tid
+ *	\brief Process running in user mode since account_mark, -1 if idle.
+ */
+static int account_tid = -1;
+
+/** \var uint64_t account_totals[3]
+ *	\brief Time spent by the CPU in user mode, in the kernel and idle.
+ */
+static uint64_t account_totals[3];
+
+/** \var bool account_in_kernel
+ *	\brief The kernel is handling an exception (nested entries are ignored).
+ */
+static bool account_in_kernel;
+
+/** \fn void account_trap_entry()
+ *	\brief Charge the time since the last return to user mode to the process
+ *	that was running.
+ *
+ *	Called when an exception interrupts user mode.
+ */
+void account_trap_entry() {
+	if (account_in_kernel) {
+		return;
+	}
+	account_in_kernel = true;
+	uint64_t now = Timer_GetTime64();
+	process* p = pidmap_get(account_tid);
+	if (p != NULL) {
+		p->utime += now - account_mark;
+	}
+	account_totals[account_tid >= 0 ? 0 : 2] += now - account_mark;
+	account_mark = now;
+}
+
+/** \fn void account_trap_exit()
+ *	\brief Charge the time spent in the kernel to the interrupted process.
+ *
+ *	Called when returning to user mode, or going idle. If the process died in
+ *	the meantime, the time is lost.
+ */
+void account_trap_exit() {
+	uint64_t now = Timer_GetTime64();
+	process* p = pidmap_get(account_tid);
+	if (p != NULL) {
+		p->stime += now - account_mark;
+	}
+	account_totals[1] += now - account_mark;
+	account_mark = now;
+	account_tid = get_current_process_id();
+	account_in_kernel = false;
+}
+
+/** \fn void account_get_totals(uint64_t* user, uint64_t* system, uint64_t* idle)
+ *	\brief CPU time spent since boot, in microseconds.
+ */
+void account_get_totals(uint64_t* user, uint64_t* system, uint64_t* idle) {
+	*user 	= account_totals[0];
+	*system = account_totals[1];
+	*idle 	= account_totals[2];
+}
+
+/** \var uint32_t load_avg[3]
+ *	\brief Load averages over 1, 5 and 15 minutes (fixed point, see LOAD_SHIFT).
+ */
+static uint32_t load_avg[3];
+
+/** \var const uint32_t load_exp[3]
+ *	\brief Decay of each load average between two samples: exp(-5s/period),
+ *	in fixed point.
+ */
+static const uint32_t load_exp[3] = {1884, 2014, 2037};
+
+/** \var timerHandler load_timer
+ *	\brief Samples the run queue every LOAD_FREQ.
+ */
+static timerHandler load_timer;
+
+/** \fn void scheduler_run_queue(int* running, int* blocked)
+ *	\brief Count the processes of the active list.
+ *	\param running Where to store the number of runnable processes.
+ *	\param blocked Where to store the number of processes retrying a blocked
+ *	service call, which wait for a device.
+ */
+void scheduler_run_queue(int* running, int* blocked) {
+	int n = 0;
+	for (int i=0;i<number_active_processes;i++) {
+		if (pidmap_get(active_processes[i])->status == status_blocked_svc) {
+			n++;
+		}
+	}
+	*running = number_active_processes - n;
+	*blocked = n;
+}
+
+/** \fn static void load_sample(timerHandler* handler, void* param, void* context)
+ *	\brief Timer handler updating the load averages.
+ *
+ *	As in other Unix systems, the load is the number of processes which are
+ *	runnable or wait for a device, decayed exponentially.
+ */
+static void load_sample(timerHandler* handler, void* param, void* context) {
+	(void) param;
+	(void) context;
+	uint64_t active = (uint64_t)number_active_processes * LOAD_ONE;
+	for (int i=0;i<3;i++) {
+		uint64_t load = (uint64_t)load_avg[i] * load_exp[i] + active * (LOAD_ONE - load_exp[i]);
+		if (active >= load_avg[i]) {
+			load += LOAD_ONE - 1; // Round up, so that a constant load is reached.
+		}
+		load_avg[i] = load >> LOAD_SHIFT;
+	}
+	Timer_addHandler(&load_timer, handler->deadline + LOAD_FREQ, load_sample, NULL, NULL);
+}
+
+/** \fn void setup_loadavg()
+ *	\brief Start sampling the load, once the timer is set up.
+ */
+void setup_loadavg() {
+	Timer_addHandler(&load_timer, Timer_GetTime64() + LOAD_FREQ, load_sample, NULL, NULL);
+}
+
+/** \fn void scheduler_get_loadavg(uint32_t load[3])
+ *	\brief Load averages over 1, 5 and 15 minutes, in hundredths.
+ */
+void scheduler_get_loadavg(uint32_t load[3]) {
+	for (int i=0;i<3;i++) {
+		load[i] = ((uint64_t)load_avg[i] * 100 + LOAD_ONE / 2) >> LOAD_SHIFT;
+	}
+}
+
+/** \fn static void account_reap(process* parent, process* child)
+ *	\brief Add the CPU time of a dead child and of its own children to the
+ *	parent.
+ */
+static void account_reap(process* parent, process* child) {
+	parent->group->cutime += child->utime + child->group->cutime;
+	parent->group->cstime += child->stime + child->group->cstime;
+}
+
+/** \fn static void remove_active(int const process_id)
+ *	\brief Remove a process from the active list.
+ *	\param process_id The process to remove.
+ *
+ *	The following processes are shifted down, so the round robin order is
+ *	kept: the cursor moves back with them, and the process after the removed
+ *	one is the next to run.
+ */
+static void remove_active(int const process_id) {
+	int i=0;
+	while (i < number_active_processes && active_processes[i] != process_id) {
+		i++;
+	}
+	if (i == number_active_processes) {
+		kdebug(D_PROCESS, 5, "Process %d is not active.\n", process_id);
+		return;
+	}
+	if (i <= current_process_id) {
+		current_process_id--;
+	}
+	for (;i < number_active_processes-1;i++) {
+		active_processes[i] = active_processes[i+1];
+	}
+	number_active_processes--;
+}
+
+/** \fn void suspend_process(int const process_id, status_process status)
+ *	\brief Take a running process out of the active list.
+ *	\param process_id The process to suspend.
+ *	\param status Its new status, telling what it waits for.
+ */
+void suspend_process(int const process_id, status_process status) {
+	remove_active(process_id);
+	pidmap_get(process_id)->status = status;
+}
+
+/** \fn void resume_process(int const process_id)
+ *	\brief Put a suspended process back in the active list.
+ *	\param process_id The process to resume.
+ */
+void resume_process(int const process_id) {
+	process* p = pidmap_get(process_id);
+	p->status = status_active;
+	sched_trace_wakeup(p, (uintptr_t)__builtin_return_address(0));
+	active_processes[number_active_processes] = process_id;
+	number_active_processes++;
+}
+
+/** \fn int exit_thread(int const thread_id)
+ *	\brief Terminate a single thread of a process.
+ *	\param thread_id The thread to terminate, which must not lead its group.
+ *	\return 0 on success, -1 on failure.
+ *
+ *	A thread has no exit status: its slot is released immediately. If it was
+ *	created with a clear_tid address, the word is cleared and the waiters on
+ *	that futex are woken, which is what thread joins rely on.
+ */
+int exit_thread(int const thread_id) {
+	process* t = pidmap_get(thread_id);
+	if (t == NULL || t->tgid == thread_id) {
+		return -1;
+	}
+
+	Timer_cancelHandler(&t->sleep_timer);
+	if (t->status == status_futex) {
+		futex_cancel(t);
+	} else if (t->status == status_poll) {
+		poll_release(t);
+	} else if (t->status == status_active || t->status == status_blocked_svc) {
+		remove_active(thread_id);
+	}
+	sched_trace_exit(t, (uintptr_t)__builtin_return_address(0));
+
+	process* q;
+	for_each_process(q) {
+		if (q->parent_id == thread_id) {
+			q->parent_id = 0;
+		}
+	}
+
+	if (t->clear_tid != NULL) {
+		int zero = 0;
+		copy_to_process(t, t->clear_tid, &zero, sizeof(int));
+		futex_wake(futex_key(t, t->clear_tid), 1);
+	}
+
+	// The process keeps the time of its dead threads.
+	process* leader = pidmap_get(t->tgid);
+	leader->utime += t->utime;
+	leader->stime += t->stime;
+
+	free_process_data(t);
+	release_process(thread_id);
+	return 0;
+}
+
 /** \fn int kill_process(int const process_id, int wstatus)
  *	\brief Kill a process.
  *	\param process_id PID to kill.
@@ -130,41 +538,34 @@ void free_process_data(process* p) {
  *	- if the parent isn't, the process is put in zombie mode.
  */
 int kill_process(int const process_id, int wstatus) {
-	if (process_id >= MAX_PROCESSES || process_id < 0 || process_list[process_id] == NULL) {
+	process* child = pidmap_get(process_id);
+	if (child == NULL) {
 		return -1;
 	}
+	if (child->tgid != process_id) {
+		return kill_process(child->tgid, wstatus);
+	}
 
-	process* child  = process_list[process_id];
-	bool was_active = (child->status == status_active) || (child->status == status_blocked_svc);
-	process* parent = process_list[child->parent_id];
-	for (int i=0;i<MAX_PROCESSES;i++) {
-		if ((process_list[i] != NULL) && (process_list[i]->parent_id == process_id)) {
-			process_list[i]->parent_id = 0;
-
-/*			if (process_list[i]->status == status_zombie &&  (process_list[0]->wait.pid == -1 || process_list[0]->wait.pid == process_list[i]->asid)) {
-				kernel_printf("Reaped by init.\n");
-				process_list[0]->status 		= status_active;
-				process_list[0]->ctx.r[0] 		= process_list[i]->asid;
-				if (process_list[0]->wait.wstatus != NULL) {
-					int* phy_addr = (int*)(0x80000000+mmu_vir2phy_ttb((intptr_t)process_list[0]->wait.wstatus, process_list[0]->ttb_address));
-					*phy_addr = wstatus;
-				}
-
-				int j=0;
-				for(;zombie_processes[j] != i;j++) {}
-
-				zombie_processes[j] = zombie_processes[number_zombie_processes-1];
-				number_zombie_processes--;
-
-				active_processes[number_active_processes] = 0;
-				number_active_processes++;
-
-				free_processes[number_free_processes] = process_list[i]->asid; // add it into the free list
-				number_free_processes++;
+	// The other threads go first, the leader then dies for the whole process.
+	process* q;
+	for_each_process(q) {
+		if ((q->asid != process_id) && (q->tgid == process_id)) {
+			exit_thread(q->asid);
+		}
+	}
 
-				free_process_data(process_list[i]);
-				process_list[process_list[i]->asid] = NULL;
-			}*/
+	Timer_cancelHandler(&child->sleep_timer);
+	if (child->status == status_futex) {
+		futex_cancel(child);
+	} else if (child->status == status_poll) {
+		poll_release(child);
+	}
+	bool was_active = (child->status == status_active) || (child->status == status_blocked_svc);
+	sched_trace_exit(child, (uintptr_t)__builtin_return_address(0));
+	process* parent = pidmap_get(child->parent_id);
+	for_each_process(q) {
+		if (q->parent_id == process_id) {
+			q->parent_id = 0;
 		}
 	}
 
@@ -173,18 +574,16 @@ int kill_process(int const process_id, int wstatus) {
 		parent->status 		= status_active;
 		parent->ctx.r[0] 	= process_id;
 		if (parent->wait.wstatus != NULL) {
-			int* phy_addr = (int*)(0x80000000+mmu_vir2phy_ttb((intptr_t)parent->wait.wstatus, parent->ttb_address));
-			*phy_addr = wstatus;
+			copy_to_process(parent, parent->wait.wstatus, &wstatus, sizeof(int));
 		}
 
 		active_processes[number_active_processes] = child->parent_id;
 		number_active_processes++;
+		sched_trace_wakeup(parent, (uintptr_t)__builtin_return_address(0));
 
-		free_processes[number_free_processes] = process_id; // add it into the free list
-		number_free_processes++;
-
+		account_reap(parent, child);
 		free_process_data(child);
-		process_list[process_id] = NULL;
+		release_process(process_id);
 	} else {
 		// parent doesn't care, so let's put the child into zombie mode.
 		child->status = status_zombie;
@@ -193,15 +592,8 @@ int kill_process(int const process_id, int wstatus) {
 		zombie_processes[number_zombie_processes] = process_id;
 		number_zombie_processes++;
 	}
-	int i=0;
-
 	if (was_active) {
-		for (;active_processes[i] != process_id;i++) {} // Danger
-		if (current_process_id == number_active_processes-1) {
-			current_process_id = i; // Follow the swap.
-		}
-		active_processes[i] = active_processes[number_active_processes-1];
-		number_active_processes--;
+		remove_active(process_id);
 	}
 
     return 0;
@@ -218,46 +610,48 @@ int kill_process(int const process_id, int wstatus) {
  *	- if not, put the parent in wait status.
  */
 int wait_process(int const process_id, int target_pid, int* wstatus, int options) {
-	if (process_id >= MAX_PROCESSES || process_id < 0 || process_list[process_id] == NULL) {
+	process* parent = pidmap_get(process_id);
+	if (parent == NULL) {
 		return -1;
 	}
 
-	process* parent = process_list[process_id];
-	int* phy_addr = (int*)(0x80000000+mmu_vir2phy_ttb((intptr_t)wstatus, parent->ttb_address));
-
 	if (target_pid == -1) { // Reap a zombie children.
 		for (int i=0;i<number_zombie_processes;i++) {
-			process* child = process_list[zombie_processes[i]];
+			process* child = pidmap_get(zombie_processes[i]);
 			if (child->parent_id == process_id) {
 				// we found one.
 				int child_pid = child->asid;
 				zombie_processes[i] = zombie_processes[number_zombie_processes-1];
 				number_zombie_processes--;
-				free_processes[number_free_processes] = child_pid;
-				number_free_processes++;
-				process_list[child_pid] = 0;
-				if (wstatus != NULL)
-					*phy_addr = (int)child->wait.wstatus;
+				if (wstatus != NULL) {
+					int status = (int)child->wait.wstatus;
+					copy_to_process(parent, wstatus, &status, sizeof(int));
+				}
 
+				account_reap(parent, child);
 				free_process_data(child);
+				release_process(child_pid);
 				return child_pid;
 			}
 		}
 	} else { // TODO: more control.
-		process* child  = process_list[target_pid];
-		if (child->status == status_zombie && child->parent_id == process_id) {
-			int i=0;
-			for (;zombie_processes[i] != target_pid;i++) {} // Danger
-
-			zombie_processes[i] = zombie_processes[number_zombie_processes-1];
-			number_zombie_processes--;
-			free_processes[number_free_processes] = target_pid;
-			number_free_processes++;
-			process_list[target_pid] = 0;
-
-			if (wstatus != NULL)
-				*phy_addr = (int)child->wait.wstatus;
+		process* child  = pidmap_get(target_pid);
+		if (child != NULL && child->status == status_zombie && child->parent_id == process_id) {
+			for (int i=0;i < number_zombie_processes;i++) {
+				if (zombie_processes[i] == target_pid) {
+					zombie_processes[i] = zombie_processes[number_zombie_processes-1];
+					number_zombie_processes--;
+					break;
+				}
+			}
+
+			if (wstatus != NULL) {
+				int status = (int)child->wait.wstatus;
+				copy_to_process(parent, wstatus, &status, sizeof(int));
+			}
+			account_reap(parent, child);
 			free_process_data(child);
+			release_process(target_pid);
 			return target_pid;
 		}
 	}
@@ -266,10 +660,7 @@ int wait_process(int const process_id, int target_pid, int* wstatus, int options
 	if (options == 1) { // WNOHANG
 		return 0;
 	} else {
-		int i=0;
-		for (;active_processes[i] != process_id;i++) {} // Danger
-		active_processes[i] = active_processes[number_active_processes-1];
-		number_active_processes--;
+		remove_active(process_id);
 		parent->status 		 = status_wait;
 		parent->wait.pid 	 = target_pid;
 		parent->wait.wstatus = wstatus;
@@ -278,40 +669,102 @@ int wait_process(int const process_id, int target_pid, int* wstatus, int options
 	}
 }
 
+/** \fn void sleep_timeout(timerHandler* handler, void* param, void* context)
+ *	\brief Timer handler waking a sleeping process up.
+ *	\param param The process id.
+ */
+static void sleep_timeout(timerHandler* handler, void* param, void* context) {
+	(void) handler;
+	(void) context;
+	wake_process((int)(intptr_t)param);
+}
+
+/** \fn void sleep_process(int const process_id, uint64_t deadline)
+ *	\brief Put a process in sleep status until a given time.
+ *	\param process_id The sleeping process.
+ *	\param deadline When to wake it up (see Timer_GetTime64).
+ *
+ *	The process leaves the active list, so it costs nothing to the scheduler
+ *	until a timer handler puts it back.
+ */
+void sleep_process(int const process_id, uint64_t deadline) {
+	process* p = pidmap_get(process_id);
+	suspend_process(process_id, status_sleep);
+	Timer_addHandler(&p->sleep_timer, deadline, sleep_timeout, (void*)(intptr_t)process_id, NULL);
+}
+
+/** \fn void wake_process(int const process_id)
+ *	\brief Put a sleeping process back in the active list.
+ *	\param process_id The process to wake up.
+ */
+void wake_process(int const process_id) {
+	process* p = pidmap_get(process_id);
+	if (p == NULL || p->status != status_sleep) {
+		return;
+	}
+	Timer_cancelHandler(&p->sleep_timer);
+	resume_process(process_id);
+}
+
 /** \fn int sheduler_add_process(process* p)
  *  \brief Put a process in the scheduling structure.
  *	\param p The process to add.
  *	\return The id given to this process.
  */
 int sheduler_add_process(process* p) {
-    if (number_free_processes == 0) {
+    int new_process_id = pidmap_alloc();
+    if (new_process_id == -1) {
+        return -1;
+    }
+    if (pidmap_count() == process_capacity && !resize_lists(process_capacity * 2)) {
+        return -1;
+    }
+    if (!pidmap_set(new_process_id, p)) {
         return -1;
     }
-    int new_process_id = free_processes[number_free_processes-1];
-    number_free_processes--;
     active_processes[number_active_processes] = new_process_id;
     number_active_processes++;
-    process_list[new_process_id] = p;
     p->asid = new_process_id;
+    p->tgid = new_process_id;
+    sched_trace_wakeup(p, (uintptr_t)__builtin_return_address(0));
 
     return new_process_id;
 }
 
+/** \fn void scheduler_replace_process(process* p)
+ *	\brief Put a new process structure in place of the one with the same PID.
+ *	\param p The new structure, whose asid is set.
+ */
+void scheduler_replace_process(process* p) {
+	pidmap_set(p->asid, p);
+}
+
 int get_number_active_processes() {
     return number_active_processes;
 }
 
-process** get_process_list() {
-    return process_list;
+/** \fn process* get_process(pid_t pid)
+ *	\brief Find a process (or thread) by its id.
+ *	\return The process, NULL if there is none.
+ */
+process* get_process(pid_t pid) {
+	return pidmap_get(pid);
 }
 
+/** \fn process* get_process_from(pid_t pid)
+ *	\brief Find the process with the lowest id greater or equal to pid.
+ *	\return The process, NULL if there is none.
+ */
+process* get_process_from(pid_t pid) {
+	return pidmap_next(pid);
+}
 
 int* get_active_processes() {
     return active_processes;
 }
 
-int get_number_free_processes() {
-	return number_free_processes;
+int get_number_processes() {
+	return pidmap_count();
 }
 
 int get_number_zombie_processes() {
@@ -319,14 +772,14 @@ int get_number_zombie_processes() {
 }
 
 process* get_current_process() {
-    if(current_process_id< 0) {
+    if(current_process_id< 0 || idle) {
         return NULL;
     }
-    return process_list[active_processes[current_process_id]];
+    return pidmap_get(active_processes[current_process_id]);
 }
 
 int get_current_process_id() {
-    if(current_process_id < 0) {
+    if(current_process_id < 0 || idle) {
         return -1;
     }
     return active_processes[current_process_id];
@@ -3,15 +3,41 @@
 
 #include "process.h"
 
+/** \def for_each_process(p)
+ *	\brief Walk the processes and threads in id order. The body may remove p, or
+ *	any other process.
+ */
+#define for_each_process(p) \
+	for (pid_t p##_next = 0; ((p) = get_process_from(p##_next)) != NULL && ((p##_next = (p)->asid + 1), true);)
 
 
 void setup_scheduler();
 int sheduler_add_process(process* p);
 process* get_next_process();
+user_context_t* scheduler_enter_idle();
+bool scheduler_is_idle();
+uint32_t scheduler_get_quantum(sched_class_t cls);
+bool scheduler_set_quantum(sched_class_t cls, uint32_t quantum);
+void account_trap_entry();
+void account_trap_exit();
+void account_get_totals(uint64_t* user, uint64_t* system, uint64_t* idle);
+void setup_loadavg();
+void scheduler_get_loadavg(uint32_t load[3]);
+void scheduler_run_queue(int* running, int* blocked);
 int kill_process(int const process_id, int wstatus);
+int exit_thread(int const thread_id);
+void free_process_data(process* p);
+void suspend_process(int const process_id, status_process status);
+void resume_process(int const process_id);
 int wait_process(int const process_id, int target_pid, int* wstatus, int options);
+void sleep_process(int const process_id, uint64_t deadline);
+void wake_process(int const process_id);
 int get_number_active_processes();
-process** get_process_list();
+int get_number_processes();
+int get_number_zombie_processes();
+process* get_process(pid_t pid);
+process* get_process_from(pid_t pid);
+void scheduler_replace_process(process* p);
 int* get_active_processes();
 process* get_current_process();
 int get_current_process_id();
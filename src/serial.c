@@ -5,6 +5,8 @@
 #include "serial.h"
 #include "string.h"
 #include "debug.h"
+#include "interrupts.h"
+#include "dev.h"
 
 static aux_t* auxiliary = (aux_t*)AUX_BASE;
 
@@ -88,6 +90,10 @@ void serial_init() {
 	/* Disable flow control,enable transmitter and receiver! */
 	auxiliary->MU_CNTL = AUX_MUCNTL_TX_ENABLE | AUX_MUCNTL_RX_ENABLE ;
 
+	/* Received data raises an interrupt, so that an idle CPU wakes up */
+	auxiliary->MU_IER = AUX_MUIER_RX_IRQ;
+	RPI_GetIRQController()->Enable_IRQs_1 = (1 << RPI_IRQ_AUX);
+
 	kdebug(D_SERIAL, 1, "Serial port is hopefully set up!\n");
 	mode = 1;
 }
@@ -162,8 +168,10 @@ void serial_setmode(int arg) {
  *	of the RX FIFO.
  */
 void serial_irq() {
+	bool received = false;
 	//kernel_printf("fifo: %d\n", (auxiliary->MU_STAT & 0x000F0000) >> 16);
 	while(auxiliary->MU_LSR & AUX_MULSR_DATA_READY) {
+		received = true;
 		//kernel_printf("serial1 IRQ\n");
 		char c = auxiliary->MU_IO;
 		//kernel_printf("\ndata ready: %c\n", c);
@@ -183,28 +191,29 @@ void serial_irq() {
 		}
 
 		if (c == 4) { // Ctrl-D
-			process** list = get_process_list();
+			process* p;
 			kernel_printf("\n");
-			kernel_printf("%d %d %d\n", get_number_active_processes(), get_number_free_processes(), get_number_zombie_processes());
-			for (int i = 0;i<MAX_PROCESSES;i++) {
-				if (list[i] != NULL) {
-					char* sstr;
-					switch (list[i]->status) {
-						case status_active:
-							sstr = "R";
-							break;
-						case status_zombie:
-							sstr = "Z";
-							break;
-						case status_blocked_svc:
-							sstr = "BS";
-							break;
-						case status_wait:
-							sstr = "S";
-							break;
-					}
-					kernel_printf("[%d] %2s %d %s | %x\n", i, sstr, list[i]->parent_id, list[i]->name, list[i]->ctx.pc);
+			kernel_printf("%d %d %d\n", get_number_active_processes(), get_number_processes(), get_number_zombie_processes());
+			for_each_process(p) {
+				char* sstr;
+				switch (p->status) {
+					case status_active:
+						sstr = "R";
+						break;
+					case status_zombie:
+						sstr = "Z";
+						break;
+					case status_blocked_svc:
+						sstr = "BS";
+						break;
+					case status_wait:
+					case status_sleep:
+					case status_futex:
+					case status_poll:
+						sstr = "S";
+						break;
 				}
+				kernel_printf("[%d] %2s %d %s | %x\n", p->asid, sstr, p->parent_id, p->name, p->ctx.pc);
 			}
 		}
 
@@ -241,9 +250,29 @@ void serial_irq() {
 
 		dmb();
 	}
+	if (received) {
+		dev_wake(DEV_SERIAL);
+	}
 	//kernel_printf("fifo>: %d\n", (auxiliary->MU_STAT & 0x000F0000) >> 16);
 }
 
+/** \fn int serial_readable()
+ *	\brief Tell whether serial_readline would return something.
+ *	\return 1 if a read would not return zero.
+ */
+int serial_readable() {
+	serial_irq();
+	if (mode == 0) {
+		return read_buffer_index > 0;
+	}
+	for (int i=0;i<read_buffer_index;i++) {
+		if (read_buffer[i] == '\r') {
+			return 1;
+		}
+	}
+	return 0;
+}
+
 /** \fn int serial_readline(char* buffer, int buffer_size)
  *	\brief Read serial buffer.
  *	\param buffer The output buffer
@@ -91,6 +91,7 @@ unsigned char serial_readc();
 int serial_readline(char* buffer, int buffer_size);
 
 void serial_irq();
+int serial_readable();
 
 
 /**
@@ -105,6 +106,8 @@ void serial_irq();
 #define AUX_IRQ_SPI1                ( 1 << 1 )
 #define AUX_IRQ_MU                  ( 1 << 0 )
 
+#define AUX_MUIER_RX_IRQ            ( 5 << 0 )  /* See errata for this value */
+
 #define AUX_MULCR_8BIT_MODE         ( 3 << 0 )  /* See errata for this value */
 #define AUX_MULCR_BREAK             ( 1 << 6 )
 #define AUX_MULCR_DLAB_ACCESS       ( 1 << 7 )
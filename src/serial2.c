@@ -2,6 +2,8 @@
 #include "string.h"
 #include "process.h"
 #include "scheduler.h"
+#include "interrupts.h"
+#include "dev.h"
 
 static volatile rpi_uart_controller_t* UARTController =
   (rpi_uart_controller_t*) UART0_BASE;
@@ -42,13 +44,12 @@ void serial2_init() {
 	// FIFO
   getUARTController()->LCR_H = (1 << 4) | (1 << 5) | (1 << 6);
 
-	// Mask interrupts
-  // Étrange, seuls les 4 premiers bits sont utiles selon la doc.
-  getUARTController()->IMSC = (1 << 1) | (1 << 4) | (1 << 5) | (1 << 6) |
-	                       (1 << 7) | (1 << 8) | (1 << 9) | (1 << 10);
+	// Only received data raises an interrupt, so that an idle CPU wakes up.
+  getUARTController()->IMSC = IMSC_RXIM | IMSC_RTIM;
 
 	//ram_write(UART_CR, (1 << 0) | (1 << 8) | (1 << 9));
   getUARTController()->CR = CR_UARTEN | CR_TXE | CR_RXE;
+  RPI_GetIRQController()->Enable_IRQs_2 = (1 << (RPI_IRQ_UART0 - 32));
 }
 
 void serial2_putc(unsigned char data) {
@@ -94,8 +95,10 @@ void serial2_setmode(int arg) {
 
 
 void serial2_irq() {
+   bool received = false;
    //kernel_printf("fifo: %d\n", (auxiliary->MU_STAT & 0x000F0000) >> 16);
    while(!(getUARTController()->FR & FR_RXFE)) {
+	   received = true;
 	//s   kernel_printf("serial2 IRQ\n");
 	   char c = getUARTController()->DR;
 	   //kernel_printf("data ready: %c\n", c);
@@ -114,28 +117,29 @@ void serial2_irq() {
 	   }
 
 	   if (c == 4) { // Ctrl-D
-		   process** list = get_process_list();
+		   process* p;
 		   kernel_printf("\n");
-		   kernel_printf("%d %d %d\n", get_number_active_processes(), get_number_free_processes(), get_number_zombie_processes());
-		   for (int i = 0;i<MAX_PROCESSES;i++) {
-			   if (list[i] != NULL) {
-				   char* sstr;
-				   switch (list[i]->status) {
-					   case status_active:
-						   sstr = "R";
-						   break;
-					   case status_zombie:
-						   sstr = "Z";
-						   break;
-					   case status_blocked_svc:
-						   sstr = "BS";
-						   break;
-					   case status_wait:
-						   sstr = "S";
-						   break;
-				   }
-				   kernel_printf("[%d] %2s %d %s | %x\n", i, sstr, list[i]->parent_id, list[i]->name, list[i]->ctx.pc);
+		   kernel_printf("%d %d %d\n", get_number_active_processes(), get_number_processes(), get_number_zombie_processes());
+		   for_each_process(p) {
+			   char* sstr;
+			   switch (p->status) {
+				   case status_active:
+					   sstr = "R";
+					   break;
+				   case status_zombie:
+					   sstr = "Z";
+					   break;
+				   case status_blocked_svc:
+					   sstr = "BS";
+					   break;
+				   case status_wait:
+				   case status_sleep:
+				   case status_futex:
+				   case status_poll:
+					   sstr = "S";
+					   break;
 			   }
+			   kernel_printf("[%d] %2s %d %s | %x\n", p->asid, sstr, p->parent_id, p->name, p->ctx.pc);
 		   }
 	   }
 
@@ -172,9 +176,27 @@ void serial2_irq() {
 
 	   dmb();
    }
+   // The FIFO is empty: acknowledge the receive and receive timeout interrupts.
+   getUARTController()->ICR = IMSC_RXIM | IMSC_RTIM;
+   if (received) {
+	   dev_wake(DEV_SERIAL2);
+   }
    //kernel_printf("fifo>: %d\n", (auxiliary->MU_STAT & 0x000F0000) >> 16);
 }
 
+int serial2_readable() {
+	serial2_irq();
+	if (mode_2 == 0) {
+		return read_buffer_index_2 > 0;
+	}
+	for (int i=0;i<read_buffer_index_2;i++) {
+		if (read_buffer_2[i] == '\r') {
+			return 1;
+		}
+	}
+	return 0;
+}
+
 int serial2_readline(char* buffer, int buffer_size) {
 	serial2_irq();
 	if (read_buffer_index_2 == 0) {
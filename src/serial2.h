@@ -13,6 +13,7 @@ void serial2_putc(unsigned char data);
 void serial2_write(char* str);
 unsigned char serial2_readc();
 int serial2_readline(char* buffer, int buffer_size);
+int serial2_readable();
 void serial2_setmode(int arg);
 void serial2_init();
 void serial2_irq();
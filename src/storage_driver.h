@@ -11,6 +11,7 @@
 typedef struct {
   int (*read)   (uint32_t, void *, uint32_t); 	///< Read from the device (address, buffer, size), returns the number of byte read.
   int (*write)  (uint32_t, void *, uint32_t);	///< Write to the device (address, buffer, size), returns the number of byte written.
+  void* (*map)  (uint32_t);						///< Pointer to the device data at an address, if it lies in memory. May be NULL.
 } storage_driver;
 
 
@@ -0,0 +1,274 @@
+#include "svctable.h"
+#include "interrupts.h"
+#include "uring.h"
+#include "poll.h"
+#include "epoll.h"
+
+/** \file svctable.c
+ *  \brief Service call table.
+ *
+ *  The table is indexed by the service call number (r7), and each entry holds
+ *  a function decoding the arguments from the caller's registers, flags
+ *  telling how the call returns to user mode, and statistics.
+ */
+
+/*
+ * Argument decoding, one function per service call.
+ */
+
+static uint32_t sys_exit(user_context_t* ctx) {
+	return svc_exit(ctx->r[0]);
+}
+
+static uint32_t sys_fork(user_context_t* ctx) {
+	(void) ctx;
+	return svc_fork();
+}
+
+static uint32_t sys_read(user_context_t* ctx) {
+	return svc_read(ctx->r[0], (char*)ctx->r[1], ctx->r[2]);
+}
+
+static uint32_t sys_write(user_context_t* ctx) {
+	return svc_write(ctx->r[0], (char*)ctx->r[1], ctx->r[2]);
+}
+
+static uint32_t sys_readv(user_context_t* ctx) {
+	return svc_readv(ctx->r[0], (const struct iovec*)ctx->r[1], ctx->r[2]);
+}
+
+static uint32_t sys_writev(user_context_t* ctx) {
+	return svc_writev(ctx->r[0], (const struct iovec*)ctx->r[1], ctx->r[2]);
+}
+
+static uint32_t sys_pread(user_context_t* ctx) {
+	return svc_pread(ctx->r[0], (char*)ctx->r[1], ctx->r[2], ctx->r[3]);
+}
+
+static uint32_t sys_pwrite(user_context_t* ctx) {
+	return svc_pwrite(ctx->r[0], (char*)ctx->r[1], ctx->r[2], ctx->r[3]);
+}
+
+static uint32_t sys_sendfile(user_context_t* ctx) {
+	return svc_sendfile(ctx->r[0], ctx->r[1], (off_t*)ctx->r[2], ctx->r[3]);
+}
+
+static uint32_t sys_close(user_context_t* ctx) {
+	return svc_close(ctx->r[0]);
+}
+
+static uint32_t sys_waitpid(user_context_t* ctx) {
+	return svc_waitpid(ctx->r[0], (int*)ctx->r[1], ctx->r[2]);
+}
+
+static uint32_t sys_execve(user_context_t* ctx) {
+	return svc_execve((char*)ctx->r[0], (const char**)ctx->r[1], (const char**)ctx->r[2]);
+}
+
+static uint32_t sys_chdir(user_context_t* ctx) {
+	return svc_chdir((char*)ctx->r[0]);
+}
+
+static uint32_t sys_time(user_context_t* ctx) {
+	return svc_time((time_t*)ctx->r[0]);
+}
+
+static uint32_t sys_lseek(user_context_t* ctx) {
+	return svc_lseek(ctx->r[0], ctx->r[1], ctx->r[2]);
+}
+
+static uint32_t sys_getpid(user_context_t* ctx) {
+	(void) ctx;
+	return get_current_process()->tgid;
+}
+
+static uint32_t sys_fstat(user_context_t* ctx) {
+	return svc_fstat(ctx->r[0], (struct stat*)ctx->r[1]);
+}
+
+static uint32_t sys_kill(user_context_t* ctx) {
+	return svc_kill(ctx->r[0], ctx->r[1]);
+}
+
+static uint32_t sys_dup(user_context_t* ctx) {
+	return svc_dup(ctx->r[0]);
+}
+
+static uint32_t sys_pipe(user_context_t* ctx) {
+	return svc_pipe((int*)ctx->r[0]);
+}
+
+static uint32_t sys_sbrk(user_context_t* ctx) {
+	return svc_sbrk(ctx->r[0]);
+}
+
+static uint32_t sys_ioctl(user_context_t* ctx) {
+	return svc_ioctl(ctx->r[0], ctx->r[1], ctx->r[2]);
+}
+
+static uint32_t sys_dup2(user_context_t* ctx) {
+	return svc_dup2(ctx->r[0], ctx->r[1]);
+}
+
+static uint32_t sys_sigaction(user_context_t* ctx) {
+	return svc_sigaction(ctx->r[0], (void (*)(int))ctx->r[1], (siginfo_t*)ctx->r[2], (void (*)(void))ctx->r[3]);
+}
+
+static uint32_t sys_sigpending(user_context_t* ctx) {
+	return svc_sigpending((uint32_t*)ctx->r[0]);
+}
+
+static uint32_t sys_getrusage(user_context_t* ctx) {
+	return svc_getrusage(ctx->r[0], (struct rusage*)ctx->r[1]);
+}
+
+static uint32_t sys_getdents(user_context_t* ctx) {
+	return svc_getdents(ctx->r[0], (struct dirent*)ctx->r[1]);
+}
+
+static uint32_t sys_sigreturn(user_context_t* ctx) {
+	(void) ctx;
+	svc_sigreturn();
+	return 0;
+}
+
+static uint32_t sys_clone(user_context_t* ctx) {
+	return svc_clone(ctx->r[0], (void*)ctx->r[1], (pid_t*)ctx->r[2], (int*)ctx->r[3]);
+}
+
+static uint32_t sys_sigprocmask(user_context_t* ctx) {
+	return svc_sigprocmask(ctx->r[0], (const uint32_t*)ctx->r[1], (uint32_t*)ctx->r[2]);
+}
+
+static uint32_t sys_nanosleep(user_context_t* ctx) {
+	return svc_nanosleep((const struct timespec*)ctx->r[0], (struct timespec*)ctx->r[1]);
+}
+
+static uint32_t sys_poll(user_context_t* ctx) {
+	return svc_poll((struct pollfd*)ctx->r[0], ctx->r[1], ctx->r[2]);
+}
+
+static uint32_t sys_sigqueue(user_context_t* ctx) {
+	return svc_sigqueue(ctx->r[0], ctx->r[1], ctx->r[2]);
+}
+
+static uint32_t sys_getcwd(user_context_t* ctx) {
+	return (uint32_t)svc_getcwd((char*)ctx->r[0], ctx->r[1]);
+}
+
+static uint32_t sys_getdents64(user_context_t* ctx) {
+	return svc_getdents64(ctx->r[0], (struct dirent64*)ctx->r[1], ctx->r[2]);
+}
+
+static uint32_t sys_gettid(user_context_t* ctx) {
+	(void) ctx;
+	return get_current_process()->asid;
+}
+
+static uint32_t sys_futex(user_context_t* ctx) {
+	return svc_futex((int*)ctx->r[0], ctx->r[1], ctx->r[2], (const struct timespec*)ctx->r[3]);
+}
+
+static uint32_t sys_exit_group(user_context_t* ctx) {
+	return svc_exit_group(ctx->r[0]);
+}
+
+static uint32_t sys_epoll_create(user_context_t* ctx) {
+	return svc_epoll_create(ctx->r[0]);
+}
+
+static uint32_t sys_epoll_ctl(user_context_t* ctx) {
+	return svc_epoll_ctl(ctx->r[0], ctx->r[1], ctx->r[2], (struct epoll_event*)ctx->r[3]);
+}
+
+static uint32_t sys_epoll_wait(user_context_t* ctx) {
+	return svc_epoll_wait(ctx->r[0], (struct epoll_event*)ctx->r[1], ctx->r[2], ctx->r[3]);
+}
+
+static uint32_t sys_clock_gettime(user_context_t* ctx) {
+	return svc_clock_gettime(ctx->r[0], (struct timespec*)ctx->r[1]);
+}
+
+static uint32_t sys_clock_nanosleep(user_context_t* ctx) {
+	return svc_clock_nanosleep(ctx->r[0], ctx->r[1], (const struct timespec*)ctx->r[2], (struct timespec*)ctx->r[3]);
+}
+
+static uint32_t sys_openat(user_context_t* ctx) {
+	return svc_openat(ctx->r[0], (char*)ctx->r[1], ctx->r[2]);
+}
+
+static uint32_t sys_mknodat(user_context_t* ctx) {
+	return svc_mknodat(ctx->r[0], (char*)ctx->r[1], ctx->r[2], ctx->r[3]);
+}
+
+static uint32_t sys_unlinkat(user_context_t* ctx) {
+	return svc_unlinkat(ctx->r[0], (char*)ctx->r[1], ctx->r[2]);
+}
+
+static uint32_t sys_uring_enter(user_context_t* ctx) {
+	return svc_uring_enter((uring_t*)ctx->r[0], ctx->r[1]);
+}
+
+/** \var svc_entry_t svc_table[SVC_TABLE_SIZE]
+ *  \brief Service calls, indexed by number.
+ */
+static svc_entry_t svc_table[SVC_TABLE_SIZE] = {
+	[SVC_EXIT]            = {sys_exit, "exit", SVC_F_SWITCH},
+	[SVC_FORK]            = {sys_fork, "fork", SVC_F_RESULT},
+	[SVC_READ]            = {sys_read, "read", SVC_F_RESULT | SVC_F_BLOCK},
+	[SVC_WRITE]           = {sys_write, "write", SVC_F_RESULT},
+	[SVC_CLOSE]           = {sys_close, "close", SVC_F_RESULT},
+	[SVC_WAITPID]         = {sys_waitpid, "waitpid", SVC_F_RESULT | SVC_F_BLOCK},
+	[SVC_EXECVE]          = {sys_execve, "execve", SVC_F_SWITCH},
+	[SVC_CHDIR]           = {sys_chdir, "chdir", SVC_F_RESULT},
+	[SVC_TIME]            = {sys_time, "time", SVC_F_RESULT},
+	[SVC_LSEEK]           = {sys_lseek, "lseek", SVC_F_RESULT},
+	[SVC_GETPID]          = {sys_getpid, "getpid", SVC_F_RESULT},
+	[SVC_FSTAT]           = {sys_fstat, "fstat", SVC_F_RESULT},
+	[SVC_KILL]            = {sys_kill, "kill", SVC_F_SWITCH},
+	[SVC_DUP]             = {sys_dup, "dup", SVC_F_RESULT},
+	[SVC_PIPE]            = {sys_pipe, "pipe", SVC_F_RESULT},
+	[SVC_SBRK]            = {sys_sbrk, "sbrk", SVC_F_RESULT},
+	[SVC_IOCTL]           = {sys_ioctl, "ioctl", SVC_F_RESULT},
+	[SVC_DUP2]            = {sys_dup2, "dup2", SVC_F_RESULT},
+	[SVC_SIGACTION]       = {sys_sigaction, "sigaction", SVC_F_RESULT},
+	[SVC_SIGPENDING]      = {sys_sigpending, "sigpending", SVC_F_RESULT},
+	[SVC_GETRUSAGE]       = {sys_getrusage, "getrusage", SVC_F_RESULT},
+	[SVC_GETDENTS]        = {sys_getdents, "getdents", SVC_F_RESULT},
+	[SVC_SIGRETURN]       = {sys_sigreturn, "sigreturn", SVC_F_SWITCH},
+	[SVC_CLONE]           = {sys_clone, "clone", SVC_F_RESULT},
+	[SVC_SIGPROCMASK]     = {sys_sigprocmask, "sigprocmask", SVC_F_RESULT},
+	[SVC_READV]           = {sys_readv, "readv", SVC_F_RESULT | SVC_F_BLOCK},
+	[SVC_WRITEV]          = {sys_writev, "writev", SVC_F_RESULT},
+	[SVC_NANOSLEEP]       = {sys_nanosleep, "nanosleep", SVC_F_RESULT | SVC_F_BLOCK},
+	[SVC_POLL]            = {sys_poll, "poll", SVC_F_RESULT | SVC_F_BLOCK},
+	[SVC_SIGQUEUE]        = {sys_sigqueue, "sigqueue", SVC_F_SWITCH},
+	[SVC_PREAD]           = {sys_pread, "pread", SVC_F_RESULT},
+	[SVC_PWRITE]          = {sys_pwrite, "pwrite", SVC_F_RESULT},
+	[SVC_GETCWD]          = {sys_getcwd, "getcwd", SVC_F_RESULT},
+	[SVC_SENDFILE]        = {sys_sendfile, "sendfile", SVC_F_RESULT},
+	[SVC_GETDENTS64]      = {sys_getdents64, "getdents64", SVC_F_RESULT},
+	[SVC_GETTID]          = {sys_gettid, "gettid", SVC_F_RESULT},
+	[SVC_FUTEX]           = {sys_futex, "futex", SVC_F_RESULT | SVC_F_BLOCK},
+	[SVC_EXIT_GROUP]      = {sys_exit_group, "exit_group", SVC_F_SWITCH},
+	[SVC_EPOLL_CREATE]    = {sys_epoll_create, "epoll_create", SVC_F_RESULT},
+	[SVC_EPOLL_CTL]       = {sys_epoll_ctl, "epoll_ctl", SVC_F_RESULT},
+	[SVC_EPOLL_WAIT]      = {sys_epoll_wait, "epoll_wait", SVC_F_RESULT | SVC_F_BLOCK},
+	[SVC_CLOCK_GETTIME]   = {sys_clock_gettime, "clock_gettime", SVC_F_RESULT},
+	[SVC_CLOCK_NANOSLEEP] = {sys_clock_nanosleep, "clock_nanosleep", SVC_F_RESULT | SVC_F_BLOCK},
+	[SVC_OPENAT]          = {sys_openat, "openat", SVC_F_RESULT},
+	[SVC_MKNODAT]         = {sys_mknodat, "mknodat", SVC_F_RESULT},
+	[SVC_UNLINKAT]        = {sys_unlinkat, "unlinkat", SVC_F_RESULT},
+	[SVC_URING_ENTER]     = {sys_uring_enter, "uring_enter", SVC_F_RESULT | SVC_F_BLOCK},
+};
+
+/** \fn svc_entry_t* svc_lookup(uint32_t number)
+ *  \brief Find a service call.
+ *  \return Its entry, NULL if there is no service call with this number.
+ */
+svc_entry_t* svc_lookup(uint32_t number) {
+	if (number >= SVC_TABLE_SIZE || svc_table[number].function == NULL) {
+		return NULL;
+	}
+	return &svc_table[number];
+}
@@ -0,0 +1,39 @@
+#ifndef SVCTABLE_H
+#define SVCTABLE_H
+
+#include <stdint.h>
+#include "process.h"
+
+/** \def SVC_TABLE_SIZE
+ *  \brief Service call numbers are below this bound.
+ */
+#define SVC_TABLE_SIZE 	0x1b0
+
+/**
+ * Flags of a service call, telling software_interrupt_vector what to do once
+ * it returns.
+ */
+#define SVC_F_RESULT 	(1 << 0) ///< The result goes in r0.
+#define SVC_F_BLOCK 	(1 << 1) ///< May leave the caller blocked, or waiting.
+#define SVC_F_SWITCH 	(1 << 2) ///< Always followed by a process switch, the caller may be gone.
+
+/** \var uint32_t svc_function_t(user_context_t* ctx)
+ *  \brief Decode the arguments of a service call and run it.
+ *  \param ctx Context of the caller, arguments in r0-r3.
+ */
+typedef uint32_t svc_function_t(user_context_t* ctx);
+
+/** \struct svc_entry_t
+ *  \brief Entry of the service call table.
+ */
+typedef struct {
+	svc_function_t* function; ///< NULL if the number is not a service call.
+	const char* name;
+	uint32_t flags;
+	uint32_t calls; ///< Times it was called (retries of a blocked call excluded).
+	uint64_t cycles; ///< CPU cycles spent in it.
+} svc_entry_t;
+
+svc_entry_t* svc_lookup(uint32_t number);
+
+#endif //SVCTABLE_H
@@ -8,27 +8,16 @@
 
 #include "syscalls.h"
 #include "errno.h"
+#include "vdso.h"
+#include "futex.h"
+#include "uring.h"
+#include "fdsyscalls.h"
+#include "uaccess.h"
 #include <sys/types.h>
 #include <unistd.h>
 #include <fcntl.h>
 
-extern unsigned int __ram_size;
-
-/** \fn bool his_own(process *p, void* pointer)
- * 	\brief Check if the pointer effectively points to the process' allowed userspace.
- *	\param p Checked process.
- *	\param pointer Checked pointer.
- *	\return True if this pointer refers to process' userspace, false otherwise.
- *
- *	\warning This is not fully implemented.
- *	\bug If the pointer is on a boundary, illegal access could be made as the size isn't checked.
- */
-bool his_own(process *p, void* pointer) {
-    (void)p;
-	return (((uintptr_t)pointer) < __ram_size) && (pointer != NULL); // no further check.
-}
-
-uint32_t svc_exit(int code) {
+uint32_t svc_exit_group(int code) {
     int current_process_id = get_current_process_id();
 	kdebug(D_SYSCALL, 2, "Program %d wants to quit (switch him to zombie state)\n", current_process_id);
 
@@ -36,41 +25,80 @@ uint32_t svc_exit(int code) {
 	kill_process(current_process_id, wstatus);
     process* p = get_next_process();
 	if (p == NULL) {
-		kdebug(D_SYSCALL, 10, "The last process has died. The end is near.\n");
-		while(1) {}
+		kdebug(D_SYSCALL, 2, "No process can run, going idle.\n");
 	}
 	kdebug(D_SYSCALL, 2, "Next process: %d\n", get_current_process_id());
 	return current_process_id;
 }
 
+/*
+ * Only terminate the calling thread. The first thread of a process can't leave
+ * without the others, so it terminates the whole process.
+ */
+uint32_t svc_exit(int code) {
+    process* p = get_current_process();
+	if (p->tgid == p->asid) {
+		return svc_exit_group(code);
+	}
+
+	kdebug(D_SYSCALL, 2, "Thread %d of %d exits\n", p->asid, p->tgid);
+	int tid = p->asid;
+	exit_thread(tid);
+	get_next_process();
+	return tid;
+}
+
 
 
 
 /*
  * Transform current process into process designed by path.
  */
-uint32_t svc_execve(char* path, const char** argv, const char** envp) {
+uint32_t svc_execve(char* path_c, const char** argv_c, const char** envp_c) {
 	process* p = get_current_process();
 
-	kdebug(D_SYSCALL, 2, "EXECVE => %s\n", path);
+	if (p->tgid != p->asid) { // Only the first thread can replace the process.
+		p->ctx.r[0] = -EINVAL;
+		return p->asid;
+	}
 
-	if ((!(his_own(p, path) && path != NULL))
-	|| (!(his_own(p, argv) && argv != NULL))
-	|| (!(his_own(p, envp) && envp != NULL))) {
-		p->ctx.r[0] = -EFAULT;
+	// The new program is loaded from copies: the caller's memory goes away.
+	int err = -EFAULT;
+	char* path 	= NULL;
+	char** argv = NULL;
+	char** envp = NULL;
+	if (argv_c == NULL || envp_c == NULL
+	|| (path = strndup_from_user(path_c, USER_PATH_MAX, &err)) == NULL
+	|| (argv = strv_dup_from_user(argv_c, &err)) == NULL
+	|| (envp = strv_dup_from_user(envp_c, &err)) == NULL) {
+		free(path);
+		strv_free(argv);
+		p->ctx.r[0] = err;
 		return p->asid;
 	}
+	kdebug(D_SYSCALL, 2, "EXECVE => %s\n", path);
 
 	errno = 0;
-	process* new_p 		= process_load(path, p->cwd, argv, envp);
+	process* new_p 		= process_load(path, p->cwd, (const char**)argv, (const char**)envp);
+	free(path);
+	strv_free(argv);
+	strv_free(envp);
 	if (new_p == NULL) {
 		p->ctx.r[0] = -errno;
 		return p->asid;
 	}
 
+	// The other threads don't survive the new program.
+	process* t;
+	for_each_process(t) {
+		if (t != p && t->tgid == p->asid) {
+			exit_thread(t->asid);
+		}
+	}
+
 
 	// Free program break.
-	int n_allocated_pages = p->brk_page;
+	int n_allocated_pages = p->group->brk_page;
 	for (int i=n_allocated_pages;i>0;i--) {
 		int phy_page = mmu_vir2phy_ttb(i*PAGE_SECTION, p->ttb_address) / PAGE_SECTION; // let's hope GCC optimizes this
 		paging_free(1,phy_page);
@@ -80,39 +108,49 @@ uint32_t svc_execve(char* path, const char** argv, const char** envp) {
 	paging_free(1,mmu_vir2phy_ttb(0, p->ttb_address)/PAGE_SECTION);
 
 
-	for (int i=0;i<64;i++) {
-		new_p->fd[i].position = -1;
-		new_p->fd[i].dir_entry = NULL;
-	}
-
 	new_p->asid 			= p->asid;
+	new_p->tgid 			= p->asid;
 	new_p->parent_id 		= p->parent_id;
 
-	for (int i=0;i<64;i++) {
-		new_p->fd[i].position = p->fd[i].position;
-		if( new_p->fd[i].position >= 0) {
-			new_p->fd[i].inode = p->fd[i].inode;
-			new_p->fd[i].dir_entry = NULL;
-			new_p->fd[i].flags = p->fd[i].flags;
-		} else {
-			new_p->fd[i].dir_entry = NULL;
-			new_p->fd[i].inode = NULL;
-		}
-	}
+	// The signal mask and pending signals are kept.
+	new_p->sig_blocked 		= p->sig_blocked;
+	new_p->sig_pending 		= p->sig_pending;
+	new_p->sig_queue 		= p->sig_queue;
+	new_p->sig_queued 		= p->sig_queued;
+
+	// Accounting goes on with the new program.
+	new_p->utime 			= p->utime;
+	new_p->stime 			= p->stime;
+	new_p->nvcsw 			= p->nvcsw;
+	new_p->nivcsw 			= p->nivcsw;
+	new_p->faults 			= p->faults;
+	new_p->syscalls 		= p->syscalls;
+	new_p->latency 			= p->latency;
+	new_p->group->cutime 	= p->group->cutime;
+	new_p->group->cstime 	= p->group->cstime;
+
+	// The open file descriptions, with their offsets, go to the new program.
+	fd_table_free(new_p->group);
+	new_p->group->fd 		= p->group->fd;
+	new_p->group->fd_map 	= p->group->fd_map;
+	new_p->group->fd_size 	= p->group->fd_size;
 
 
 	for (int i=0;i<32;i++) {
-		if ((new_p->sighandlers[i].handler != SIG_DFL) && (new_p->sighandlers[i].handler != SIG_IGN)) {
-			new_p->sighandlers[i].handler = SIG_DFL;
+		if ((new_p->group->sighandlers[i].handler != SIG_DFL) && (new_p->group->sighandlers[i].handler != SIG_IGN)) {
+			new_p->group->sighandlers[i].handler = SIG_DFL;
 		} else {
-			new_p->sighandlers[i] = p->sighandlers[i];
+			new_p->group->sighandlers[i] = p->group->sighandlers[i];
 		}
 	}
 
-	get_process_list()[new_p->asid] = new_p;
+	scheduler_replace_process(new_p);
 
 	kdebug(D_SYSCALL, 2, "Program loaded! Freeing shit %p %p\n", p->ttb_address, p);
 	free((void*)p->ttb_address);
+	free(p->group);
+	vfp_release(p);
+	uring_release(p);
 	free(p);
 	new_p->dummy = 0;
 	kdebug(D_SYSCALL, 2, "EXECVE: Done\n");
@@ -122,20 +160,23 @@ uint32_t svc_execve(char* path, const char** argv, const char** envp) {
 char* svc_getcwd(char* buf, size_t cnt) {
 	kdebug(D_SYSCALL, 2, "GETCWD\n");
     process* p = get_current_process();
-	if (!his_own(p, buf)) {
+	if (!access_ok(p, buf, cnt)) {
 		return (char*)-EFAULT;
 	}
 	return vfs_inode_to_path(p->cwd, buf, cnt);
 }
 
-uint32_t svc_chdir(char* path) {
-	kdebug(D_SYSCALL, 2, "CHDIR %s\n", path);
+uint32_t svc_chdir(char* path_c) {
     process* p = get_current_process();
-	if (!his_own(p, path)) {
-		return -EFAULT;
+	int err;
+	char* path = strndup_from_user(path_c, USER_PATH_MAX, &err);
+	if (path == NULL) {
+		return err;
 	}
+	kdebug(D_SYSCALL, 2, "CHDIR %s\n", path);
 	errno = 0;
 	inode_t res = vfs_path_to_inode(&p->cwd, path);
+	free(path);
 
 	if (errno > 0) {
 		return -errno;
@@ -150,7 +191,7 @@ uint32_t svc_chdir(char* path) {
 uint32_t svc_sbrk(uint32_t ofs) {
 	kdebug(D_SYSCALL, 2, "SBRK %d\n", ofs);
     process* p = get_current_process();
-	int old_brk         = p->brk;
+	int old_brk         = p->group->brk;
 
 	int current_brk     = old_brk+ofs;
 	int pages_needed    = (current_brk - 1) / (PAGE_SECTION); // As the base brk is PAGE_SECTION (should be moved though)
@@ -158,28 +199,28 @@ uint32_t svc_sbrk(uint32_t ofs) {
 		return -EINVAL;
 	}
 
-	if (pages_needed > p->brk_page) {
-		page_list_t* pages = paging_allocate(pages_needed - p->brk_page);
+	if (pages_needed > p->group->brk_page) {
+		page_list_t* pages = paging_allocate(pages_needed - p->group->brk_page);
 		while (pages != NULL) {
 			while (pages->size > 0) {
-				mmu_add_section(p->ttb_address,(p->brk_page+1)*PAGE_SECTION,pages->address*PAGE_SECTION,ENABLE_CACHE|ENABLE_WRITE_BUFFER,0,AP_PRW_URW); // TODO: setup flags
+				mmu_add_section(p->ttb_address,(p->group->brk_page+1)*PAGE_SECTION,pages->address*PAGE_SECTION,ENABLE_CACHE|ENABLE_WRITE_BUFFER,0,AP_PRW_URW); // TODO: setup flags
 				pages->size--;
 				pages->address++;
-				p->brk_page++;
+				p->group->brk_page++;
 			}
 			page_list_t* bef;
 			bef = pages;
 			pages = pages->next;
 			free(bef);
 		}
-		if (pages_needed != p->brk_page) {
-			kdebug(D_SYSCALL, 10, "SBRK: ENOMEM %d %d\n", pages_needed, p->brk_page);
+		if (pages_needed != p->group->brk_page) {
+			kdebug(D_SYSCALL, 10, "SBRK: ENOMEM %d %d\n", pages_needed, p->group->brk_page);
 			return -ENOMEM;
 		}
-	} else if (pages_needed < p->brk_page) {
+	} else if (pages_needed < p->group->brk_page) {
 		// should free pages.
 	}
-	p->brk = p->brk + ofs;
+	p->group->brk = p->group->brk + ofs;
 	kdebug(D_SYSCALL, 2, "SBRK => %#010x\n", old_brk);
 	return old_brk;
 }
@@ -190,16 +231,27 @@ uint32_t svc_fork() {
 	kdebug(D_PROCESS, 2, "FORK\n");
 	process* p = get_current_process();
 	process* copy 		= malloc(sizeof(process));
-
+	process_group_t* group = malloc(sizeof(process_group_t));
 	uint32_t table_size = 16*1024 >> TTBCR_ALIGN;
-	copy->ttb_address 	= (uintptr_t)memalign(table_size, table_size);
-
-	int pages_needed = 2+p->brk_page;
+	uintptr_t ttb_address = (uintptr_t)memalign(table_size, table_size);
+	int pages_needed = 2+p->group->brk_page;
 	page_list_t* res = paging_allocate(pages_needed);
-	if (res == NULL || copy->ttb_address == (uintptr_t)NULL) {
+	if (copy == NULL || group == NULL || ttb_address == (uintptr_t)NULL || res == NULL) {
 		kdebug(D_PROCESS, 10, "Can't fork: page allocation failed.\n");
+		while (res != NULL) {
+			page_list_t* next = res->next;
+			paging_free(res->size, res->address);
+			free(res);
+			res = next;
+		}
+		free((void*)ttb_address);
+		free(group);
+		free(copy);
 		return -ENOMEM;
 	}
+	copy->group 		= group;
+	copy->group->threads = 1;
+	copy->ttb_address 	= ttb_address;
 
 	page_list_t* prev = res;
 	for (int i=0;i<pages_needed-1;i++) {
@@ -222,41 +274,55 @@ uint32_t svc_fork() {
 		free(prev);
 	}
 	free(res);
+	vdso_map(copy->ttb_address);
 
 	// Now all the data is copied..
-	copy->brk 		= p->brk;
-	copy->brk_page 	= p->brk_page;
-	for (int i=0;i<64;i++) {
-		copy->fd[i].position = p->fd[i].position;
-		if( copy->fd[i].position >= 0) {
-			copy->fd[i].inode = p->fd[i].inode;
-			copy->fd[i].inode->ref_count++;
-
-			copy->fd[i].dir_entry = NULL;
-			copy->fd[i].flags = p->fd[i].flags;
-		} else {
-			copy->fd[i].dir_entry = NULL;
-			copy->fd[i].inode = NULL;
-		}
-	}
+	copy->group->brk 		= p->group->brk;
+	copy->group->brk_page 	= p->group->brk_page;
 
 	copy->ctx 		= p->ctx;
 	copy->ctx.r[0] 	= 0;
 	copy->status 	= p->status;
 	copy->cwd 		= p->cwd;
 	copy->dummy 	= 0;
+	copy->sched_class = p->sched_class;
+	copy->slice_left = 0;
 	copy->name		= malloc(strlen(p->name)+1);
 	copy->allocated_framebuffer = false;
+	copy->sleep_timer.pending = false;
+	copy->clear_tid = NULL;
+	copy->futex_next = NULL;
+	copy->vfp = vfp_copy(p);
+	copy->sig_blocked = p->sig_blocked;
+	copy->sig_pending = 0;
+	copy->sig_queue = NULL;
+	copy->sig_queued = 0;
+	copy->sig_frame = p->sig_frame; // Same stack, so same handler frames.
+	copy->uring_ops = NULL;
+	copy->poll_entries = NULL;
+	copy->poll_count = 0;
+	process_reset_stats(copy);
+	copy->group->cutime = 0;
+	copy->group->cstime = 0;
 	strcpy(copy->name, p->name);
 
 	for (int i=0;i<32;i++) {
-		copy->sighandlers[i] = p->sighandlers[i];
+		copy->group->sighandlers[i] = p->group->sighandlers[i];
+	}
+
+	// The child shares the open file descriptions, and so their offsets.
+	// Copied last: on failure, free_process_data releases all of the above.
+	if (!fd_table_copy(copy->group, p->group)) {
+		kdebug(D_SYSCALL, 5, "FORK FAILED, out of memory\n");
+		free_process_data(copy);
+		return -ENOMEM;
 	}
 
 	int pid 		= sheduler_add_process(copy);
 	copy->parent_id = p->asid;
 	if (pid == -1) {
 		kdebug(D_SYSCALL, 5, "FORK FAILED, out of process\n");
+		free_process_data(copy);
 		return -ECHILD;
 	} else {
 		kdebug(D_SYSCALL, 2, "FORK => %d\n", pid);
@@ -264,10 +330,108 @@ uint32_t svc_fork() {
 	return pid;
 }
 
+/*
+ * Only creates threads: the new process shares everything with the caller but
+ * its stack. Use fork for separate processes.
+ */
+int svc_clone(int flags, void* stack, pid_t* ptid, int* ctid) {
+	kdebug(D_PROCESS, 2, "CLONE\n");
+	process* p = get_current_process();
+
+	if ((flags & CLONE_THREAD_FLAGS) != CLONE_THREAD_FLAGS) {
+		return -EINVAL;
+	}
+	if (!access_ok(p, (char*)stack - sizeof(int), sizeof(int)) // The stack grows down from there.
+	|| ((flags & CLONE_PARENT_SETTID) && !access_ok(p, ptid, sizeof(int)))
+	|| ((flags & CLONE_CHILD_CLEARTID) && !access_ok(p, ctid, sizeof(int)))) {
+		return -EFAULT;
+	}
+
+	process* thread = malloc(sizeof(process));
+	if (thread == NULL) {
+		return -ENOMEM;
+	}
+	*thread = *p; // Same translation table, group and working directory.
+
+	thread->ctx.r[0] 	= 0;
+	thread->ctx.r[13] 	= (uintptr_t)stack;
+	thread->status 		= status_active;
+	thread->dummy 		= 0;
+	thread->slice_left 	= 0;
+	thread->name		= malloc(strlen(p->name)+1);
+	thread->allocated_framebuffer = false;
+	thread->sleep_timer.pending = false;
+	thread->clear_tid 	= (flags & CLONE_CHILD_CLEARTID) ? ctid : NULL;
+	thread->futex_next 	= NULL;
+	thread->vfp 		= vfp_copy(p);
+	thread->sig_pending = 0;
+	thread->sig_queue 	= NULL;
+	thread->sig_queued 	= 0;
+	thread->sig_frame 	= 0;
+	thread->uring_ops 	= NULL;
+	thread->poll_entries = NULL;
+	thread->poll_count 	= 0;
+	process_reset_stats(thread);
+	strcpy(thread->name, p->name);
+
+	int tid = sheduler_add_process(thread);
+	if (tid == -1) {
+		kdebug(D_SYSCALL, 5, "CLONE FAILED, out of process\n");
+		vfp_release(thread);
+		free(thread->name);
+		free(thread);
+		return -EAGAIN;
+	}
+	thread->tgid = p->tgid;
+	p->group->threads++;
+
+	if (flags & CLONE_PARENT_SETTID) {
+		copy_to_user(ptid, &tid, sizeof(pid_t)); // Checked above, it can only fault.
+	}
+	kdebug(D_SYSCALL, 2, "CLONE => %d\n", tid);
+	return tid;
+}
+
+/*
+ * Futexes are keyed on physical addresses, so FUTEX_PRIVATE_FLAG is accepted
+ * and ignored. The FUTEX_WAIT timeout is relative, on CLOCK_MONOTONIC.
+ */
+int svc_futex(int* uaddr, int op, int val, const struct timespec* timeout) {
+	process* p = get_current_process();
+	if (!access_ok(p, uaddr, sizeof(int)) || ((uintptr_t)uaddr & 3)) {
+		return -EFAULT;
+	}
+
+	switch (op & ~FUTEX_PRIVATE_FLAG) {
+		case FUTEX_WAIT: {
+			uint64_t deadline = 0;
+			if (timeout != NULL) {
+				struct timespec ts;
+				if (copy_from_user(&ts, timeout, sizeof(struct timespec)) < 0) {
+					return -EFAULT;
+				}
+				if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= 1000000000) {
+					return -EINVAL;
+				}
+				deadline = Timer_GetTime64() + (uint64_t)ts.tv_sec * 1000000 + (ts.tv_nsec + 999) / 1000;
+			}
+			int res = futex_wait(p, uaddr, val, deadline);
+			if (res == 0) {
+				get_next_process();
+			}
+			return res;
+		}
+		case FUTEX_WAKE:
+			return futex_wake(futex_key(p, uaddr), val);
+		default:
+			return -ENOSYS;
+	}
+}
+
 pid_t svc_waitpid(pid_t pid, int* wstatus, int options) {
     (void)options;
 	kdebug(D_SYSCALL, 2, "WAITPID\n");
-	if (!his_own(get_current_process(), wstatus) && wstatus != NULL) {
+	if (wstatus != NULL && !access_ok(get_current_process(), wstatus, sizeof(int))) {
 		return -EFAULT;
 	}
 
@@ -280,58 +444,143 @@ pid_t svc_waitpid(pid_t pid, int* wstatus, int options) {
 
 uint32_t svc_time(time_t *tloc) {
 	kdebug(D_SYSCALL, 1, "TIME\n");
-	process* p = get_current_process();
-	/*if (!his_own(p, tloc)) {
+	time_t now = Timer_GetTime64();
+	if (tloc != NULL && copy_to_user(tloc, &now, sizeof(time_t)) < 0) {
 		return -EFAULT;
-	}*/
+	}
+	return now;
+}
 
-	if (tloc == NULL) {
-		return Timer_GetTime();
+/*
+ * Read the 64-bit system timer. The board has no real time clock, so
+ * CLOCK_REALTIME counts from boot as CLOCK_MONOTONIC does.
+ */
+int svc_clock_gettime(clockid_t clock, struct timespec* tp) {
+	kdebug(D_SYSCALL, 1, "CLOCK_GETTIME\n");
+	if (clock != CLOCK_MONOTONIC && clock != CLOCK_REALTIME) {
+		return -EINVAL;
+	}
+	uint64_t now = Timer_GetTime64();
+	struct timespec ts;
+	ts.tv_sec 	= now / 1000000;
+	ts.tv_nsec 	= (now % 1000000) * 1000;
+	return copy_to_user(tp, &ts, sizeof(struct timespec));
+}
+
+/*
+ * RUSAGE_SELF sums the threads of the process, which include the time of
+ * its dead threads. RUSAGE_CHILDREN covers the reaped children only.
+ */
+int svc_getrusage(int who, struct rusage* usage) {
+	process* p = get_current_process();
+	uint64_t utime = 0;
+	uint64_t stime = 0;
+	if (who == RUSAGE_SELF) {
+		process* t;
+		for_each_process(t) {
+			if (t->tgid == p->tgid) {
+				utime += t->utime;
+				stime += t->stime;
+			}
+		}
+	} else if (who == RUSAGE_CHILDREN) {
+		utime = p->group->cutime;
+		stime = p->group->cstime;
 	} else {
-		*tloc = Timer_GetTime();
-		return *tloc;
+		return -EINVAL;
 	}
+
+	struct rusage ru;
+	memset(&ru, 0, sizeof(struct rusage));
+	ru.ru_utime.tv_sec 	= utime / 1000000;
+	ru.ru_utime.tv_usec = utime % 1000000;
+	ru.ru_stime.tv_sec 	= stime / 1000000;
+	ru.ru_stime.tv_usec = stime % 1000000;
+	return copy_to_user(usage, &ru, sizeof(struct rusage));
 }
 
-int svc_kill(pid_t pid, int sig) {
+/*
+ * Block the current process until the clock reaches the requested time.
+ * Errors are returned as positive numbers, as clock_nanosleep does.
+ */
+int svc_clock_nanosleep(clockid_t clock, int flags, const struct timespec* req, struct timespec* rem) {
+	kdebug(D_SYSCALL, 1, "CLOCK_NANOSLEEP\n");
 	process* p = get_current_process();
-	int own_pid = p->asid;
-	bool autokill = false;
+	struct timespec ts;
+	if (copy_from_user(&ts, req, sizeof(struct timespec)) < 0
+	|| (rem != NULL && !access_ok(p, rem, sizeof(struct timespec)))) {
+		return EFAULT;
+	}
+	if (clock != CLOCK_MONOTONIC && clock != CLOCK_REALTIME) {
+		return EINVAL;
+	}
+	if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= 1000000000) {
+		return EINVAL;
+	}
 
-	if (!(sig == SIGTERM || sig == SIGKILL || sig == SIGSEGV)) {
-		p->ctx.r[0] = -EINVAL;
+	uint64_t delay 	= (uint64_t)ts.tv_sec * 1000000 + (ts.tv_nsec + 999) / 1000;
+	uint64_t now 	= Timer_GetTime64();
+	uint64_t deadline;
+	if (flags & TIMER_ABSTIME) {
+		deadline 	= delay;
+		rem 		= NULL;
+	} else {
+		deadline 	= now + delay;
+	}
+	if (deadline <= now) {
 		return 0;
 	}
 
-	process** lst = get_process_list();
+	p->ctx.r[0] 	= 0; // Returned on wake up.
+	p->sleep_rem 	= rem;
+	sleep_process(p->asid, deadline);
+	get_next_process();
+	return 0;
+}
 
-	siginfo_t signal;
-	signal.si_signo = sig;
-	signal.si_pid = own_pid;
+int svc_nanosleep(const struct timespec* req, struct timespec* rem) {
+	kdebug(D_SYSCALL, 1, "NANOSLEEP\n");
+	return -svc_clock_nanosleep(CLOCK_MONOTONIC, 0, req, rem);
+}
+
+/*
+ * Send a signal to a process, or to every process but init for pid -1. The
+ * result is written in the caller's context, as the caller may be killed.
+ */
+static void signal_send(pid_t pid, siginfo_t signal) {
+	process* p = get_current_process();
+	int own_tid = p->asid;
+
+	int sig = signal.si_signo;
+	if (sig < 0 || sig >= N_SIGNALS) {
+		p->ctx.r[0] = -EINVAL;
+		return;
+	}
 
 	int wstatus = (sig << 8) | 1;
 
 	if (pid > 0) {
-		if (lst[pid] != NULL && lst[pid]->status != status_zombie) {
-			p->ctx.r[0] = 0;
-			if (process_signal(lst[pid], signal)) {
-				kill_process(pid, wstatus);
-				if (pid == own_pid) {
-					autokill = true;
-				}
+		process* target = get_process(pid);
+		if (target != NULL) {
+			target = get_process(target->tgid); // Signals go to the first thread.
+		}
+		if (target != NULL && target->status != status_zombie) {
+			int res = sig == 0 ? 0 : process_signal(target, signal);
+			p->ctx.r[0] = min(res, 0);
+			if (res == 1) {
+				kill_process(target->asid, wstatus);
 			}
 		} else {
-			p->ctx.r[0] = -EINVAL;
+			p->ctx.r[0] = -ESRCH;
 		}
 	} else if (pid == -1) {
 		p->ctx.r[0] = 0;
-		for (int i=1;i<MAX_PROCESSES;i++) {
-			if (lst[i] != NULL && lst[i]->status != status_zombie) {
-				if (process_signal(lst[i], signal)) {
-					kill_process(i, wstatus);
-					if (i == own_pid) {
-						autokill = true;
-					}
+		process* target;
+		for_each_process(target) {
+			// Signals go to processes, so only to the first thread of each.
+			if (target->asid != 0 && target->tgid == target->asid && target->status != status_zombie && sig != 0) {
+				if (process_signal(target, signal) == 1) {
+					kill_process(target->asid, wstatus);
 				}
 			}
 		}
@@ -339,26 +588,89 @@ int svc_kill(pid_t pid, int sig) {
 		p->ctx.r[0] = -ESRCH;
 	}
 
-	if (autokill) {
+	if (get_process(own_tid) != p) { // The caller was killed with its process.
 		get_next_process();
 	}
+}
+
+int svc_kill(pid_t pid, int sig) {
+	siginfo_t signal;
+	signal.si_signo = sig;
+	signal.si_pid 	= get_current_process()->tgid;
+	signal.si_code 	= SI_USER;
+	signal.si_value.sival_int = 0;
+	signal_send(pid, signal);
 	return 0;
 }
 
-int svc_sigaction(int signum, void (*handler)(int), siginfo_t* siginfo) {
-	process* p = get_current_process();
-	if (signum == SIGKILL) {
-		return -EINVAL;
-	} else if (signum == SIGSEGV || signum == SIGTERM) {
-		p->sighandlers[signum].handler = handler;
-		p->sighandlers[signum].user_siginfo = siginfo;
+/*
+ * Unlike kill, each signal sent is queued and carries a value. Fails with
+ * EAGAIN when too many are pending.
+ */
+int svc_sigqueue(pid_t pid, int sig, int value) {
+	siginfo_t signal;
+	signal.si_signo = sig;
+	signal.si_pid 	= get_current_process()->tgid;
+	signal.si_code 	= SI_QUEUE;
+	signal.si_value.sival_int = value;
+	if (pid <= 0) {
+		get_current_process()->ctx.r[0] = -EINVAL;
 		return 0;
-	} else {
+	}
+	signal_send(pid, signal);
+	return 0;
+}
+
+int svc_sigaction(int signum, void (*handler)(int), siginfo_t* siginfo, void (*restorer)(void)) {
+	process* p = get_current_process();
+	if (signum <= 0 || signum >= N_SIGNALS || signum == SIGKILL) {
 		return -EINVAL;
 	}
+	p->group->sighandlers[signum].handler = handler;
+	p->group->sighandlers[signum].user_siginfo = siginfo;
+	p->group->sighandlers[signum].restorer = restorer;
+	if (handler == SIG_IGN || (handler == SIG_DFL && !(SIG_FATAL & (1 << signum)))) {
+		process_signal_discard(p, signum);
+	}
+	return 0;
+}
+
+int svc_sigprocmask(int how, const uint32_t* set, uint32_t* oldset) {
+	process* p = get_current_process();
+	uint32_t mask;
+	if (set != NULL && copy_from_user(&mask, set, sizeof(uint32_t)) < 0) {
+		return -EFAULT;
+	}
+	if (oldset != NULL && copy_to_user(oldset, &p->sig_blocked, sizeof(uint32_t)) < 0) {
+		return -EFAULT;
+	}
+	if (set != NULL) {
+		switch (how) {
+			case SIG_BLOCK:
+				p->sig_blocked |= mask;
+				break;
+			case SIG_UNBLOCK:
+				p->sig_blocked &= ~mask;
+				break;
+			case SIG_SETMASK:
+				p->sig_blocked = mask;
+				break;
+			default:
+				return -EINVAL;
+		}
+		p->sig_blocked &= ~SIG_UNBLOCKABLE;
+	}
+	return 0; // The signals unblocked are delivered on return.
+}
+
+int svc_sigpending(uint32_t* set) {
+	process* p = get_current_process();
+	return copy_to_user(set, &p->sig_pending, sizeof(uint32_t));
 }
 
 void svc_sigreturn() {
 	process* p = get_current_process();
-	p->ctx = p->old_ctx;
+	if (!process_signal_return(p)) {
+		p->ctx.r[0] = -EINVAL;
+	}
 }
@@ -18,23 +18,35 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <signal.h>
+#include <sys/resource.h>
 
 #include "../include/dirent.h"
 #include "../include/signals.h"
+#include "../include/clocks.h"
+#include "../include/threads.h"
 
-bool 	 his_own(process* p, void* pointer);
 
 uint32_t svc_exit(int code);
+uint32_t svc_exit_group(int code);
 uint32_t svc_sbrk(uint32_t ofs);
 uint32_t svc_fork();
+int 	 svc_clone(int flags, void* stack, pid_t* ptid, int* ctid);
+int 	 svc_futex(int* uaddr, int op, int val, const struct timespec* timeout);
 uint32_t svc_time(time_t* tloc);
 uint32_t svc_execve(char* path, const char** argv, const char** env);
 pid_t 	 svc_waitpid(pid_t pid, int* wstatus, int options);
 char* 	 svc_getcwd(char* buf, size_t cnt);
 uint32_t svc_chdir(char* path);
+int 	 svc_clock_gettime(clockid_t clock, struct timespec* tp);
+int 	 svc_getrusage(int who, struct rusage* usage);
+int 	 svc_nanosleep(const struct timespec* req, struct timespec* rem);
+int 	 svc_clock_nanosleep(clockid_t clock, int flags, const struct timespec* req, struct timespec* rem);
 
 
 int 	 svc_kill(pid_t pid, int sig);
-int 	 svc_sigaction(int signum, void (*handler)(int), siginfo_t* siginfo);
+int 	 svc_sigqueue(pid_t pid, int sig, int value);
+int 	 svc_sigaction(int signum, void (*handler)(int), siginfo_t* siginfo, void (*restorer)(void));
+int 	 svc_sigprocmask(int how, const uint32_t* set, uint32_t* oldset);
+int 	 svc_sigpending(uint32_t* set);
 void  	 svc_sigreturn();
 #endif
@@ -40,6 +40,29 @@ void Timer_Disable() {
 }
 
 
+/** \fn void Timer_Disable_Interrupts()
+ *  \brief Stop the timer interrupts, the freerunning counter keeps going
+ */
+void Timer_Disable_Interrupts() {
+  dmb();
+  rpiArmTimer->control &= ~TIMER_CTRL_INTERRUPT_BIT;
+  dmb();
+}
+
+
+/** \fn void Timer_Enable_Interrupts()
+ *  \brief Restart the timer interrupts
+ *
+ *  A tick that expired while the interrupts were off is dropped.
+ */
+void Timer_Enable_Interrupts() {
+  dmb();
+  rpiArmTimer->irq_clear = 1;
+  rpiArmTimer->control |= TIMER_CTRL_INTERRUPT_BIT;
+  dmb();
+}
+
+
 /** \fn void Timer_SetLoad(uint32_t value)
  *  \brief Set the timer period
  *  \param value The approximate period in microseconds (with our setup)
@@ -69,156 +92,246 @@ void Timer_ClearInterrupt() {
 }
 
 
-#define TIMER_MAX_HANDLERS 128
-/** \var timerHandler timerHandlers[TIMER_AUX_HANDLERS]
- *  \brief Contains the delayed function call
+/** \var timerHandler* timerWheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE]
+ *  \brief The hierarchical timing wheel holding the pending handlers
+ *
+ *  A slot of level l covers 64^l microseconds. A handler sits in the lowest
+ *  level whose slot index (deadline >> (6*l)) is less than 64 slots away from
+ *  the wheel time, and is moved down a level (cascaded) when the wheel time
+ *  reaches the beginning of its slot.
  */
-static timerHandler timerHandlers[TIMER_MAX_HANDLERS];
+static timerHandler* timerWheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
 
 
-/** \var uint32_t nextHandlerTrigger
- *  \brief The time when the next handler will be called
+/** \var uint64_t timerWheelUsed[TIMER_WHEEL_LEVELS]
+ *  \brief Bitmap of the non-empty slots of each level
  */
-static uint32_t nextHandlerTrigger;
+static uint64_t timerWheelUsed[TIMER_WHEEL_LEVELS];
 
 
-/** \var uint32_t nextHandlerOverflow
- *  \brief The number of overflow needed before the next handler will be called (an overflow of the timer freerunning counter = one hour approximately)
+/** \var uint64_t timerWheelTime
+ *  \brief The first microsecond the wheel has not processed yet
  */
-static uint32_t nextHandlerOverflow;
+static uint64_t timerWheelTime;
 
 
-/** \var uint32_t lastTimeCheckedHandlers
- *  \brief Last time we checked for handlers (used to know when there is an overflow of the freerunning counter)
+/** \var timerHandler* timerExpiring
+ *  \brief The handlers being called by Timer_wheelProcess (their level is
+ *  TIMER_WHEEL_LEVELS), so that they can still be cancelled
  */
-static uint32_t lastTimeCheckedHandlers;
+static timerHandler* timerExpiring;
 
 
-/** \fn int Timer_addHandler(uint32_t millis, timerFunction* function, void* param, void* context)
- *  \brief Delay the call of a function
- *  \param millis The delay in milliseconds
- *  \param function The function pointer
- *  \param param The second parameter of the function
- *  \param context The third parameter of the function
- *  \return The index of the function handler (-1 if there is no left)
- *  \warning This function expect the timer to run at 1MHz
+/** \fn void Timer_wheelInsert(timerHandler* handler)
+ *  \brief Put a handler in the slot matching its deadline
+ *  \param handler The handler, with its deadline set
  */
-int Timer_addHandler(uint32_t millis, timerFunction* function, void* param, void* context) {
-    uint64_t micro = (uint64_t)millis * (uint64_t)1000 + (uint64_t)Timer_GetTime();
+static void Timer_wheelInsert(timerHandler* handler) {
+    uint64_t deadline = handler->deadline;
+    if(deadline < timerWheelTime) {
+        deadline = timerWheelTime;
+    }
 
-    int i = Timer_getFreeHandler();
-    if(i == -1) {
-        kdebug(4,9,"No free handlers left");
-        return -1; //No free handlers (this will probably result in a bug)
+    int level;
+    uint32_t slot = 0;
+    for(level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        int shift = level * TIMER_WHEEL_BITS;
+        if((deadline >> shift) - (timerWheelTime >> shift) < TIMER_WHEEL_SIZE) {
+            slot = (deadline >> shift) & TIMER_WHEEL_MASK;
+            break;
+        }
     }
-    timerHandlers[i].function = function;
-    timerHandlers[i].param = param;
-    timerHandlers[i].context = context;
-    timerHandlers[i].overflowTime = (uint32_t)(micro >> 32);
-    timerHandlers[i].triggerTime = (uint32_t)(micro & 0xFFFFFFFF);
-
-    if(timerHandlers[i].overflowTime < nextHandlerOverflow ||
-       (timerHandlers[i].overflowTime == nextHandlerOverflow &&
-        timerHandlers[i].triggerTime < nextHandlerTrigger)) {
-        nextHandlerOverflow = timerHandlers[i].overflowTime;
-        nextHandlerTrigger = timerHandlers[i].triggerTime;
+    if(level == TIMER_WHEEL_LEVELS) {
+        // Too far away: park it in the last slot of the top level, it will be
+        // put back in the right place when this slot is cascaded.
+        level = TIMER_WHEEL_LEVELS - 1;
+        slot = ((timerWheelTime >> (level * TIMER_WHEEL_BITS)) + TIMER_WHEEL_MASK)
+                & TIMER_WHEEL_MASK;
     }
-    return i;
+
+    handler->level = level;
+    handler->slot = slot;
+    handler->prev = NULL;
+    handler->next = timerWheel[level][slot];
+    if(handler->next != NULL) {
+        handler->next->prev = handler;
+    }
+    timerWheel[level][slot] = handler;
+    timerWheelUsed[level] |= (uint64_t)1 << slot;
 }
 
 
-/** \fn void Timer_callHandlingFunction(unsigned int id)
- *  \brief Call a function that has been delayed
- *  \param id The id of the function handler
+/** \fn void Timer_wheelRemove(timerHandler* handler)
+ *  \brief Unlink a handler from its slot
+ *  \param handler The handler, which must be in the wheel
  */
-void Timer_callHandlingFunction(unsigned int id) {
-    if(timerHandlers[id].function != NULL) {
-        timerHandlers[id].function(id,timerHandlers[id].param,
-                                   timerHandlers[id].context);
-        timerHandlers[id].function = NULL;
+static void Timer_wheelRemove(timerHandler* handler) {
+    if(handler->prev != NULL) {
+        handler->prev->next = handler->next;
+    } else if(handler->level == TIMER_WHEEL_LEVELS) {
+        timerExpiring = handler->next;
+    } else {
+        timerWheel[handler->level][handler->slot] = handler->next;
+        if(handler->next == NULL) {
+            timerWheelUsed[handler->level] &= ~((uint64_t)1 << handler->slot);
+        }
     }
-    else {
-        kdebug(4,8,"Trying to call a undefined handler");
+    if(handler->next != NULL) {
+        handler->next->prev = handler->prev;
     }
 }
 
 
-/** \fn void Timer_updateNextHandler()
- *  \brief Compute the values of nextHandlerTrigger and nextHandlerOverflow
+/** \fn timerHandler* Timer_wheelDetach(int level, int slot)
+ *  \brief Empty a slot of the wheel
+ *  \return The list of the handlers the slot contained
  */
-void Timer_updateNextHandler() {
-    nextHandlerOverflow = 0xFFFFFFFF;
-    nextHandlerTrigger = 0xFFFFFFFF;
-    for(int i = 0; i<TIMER_MAX_HANDLERS; i++) {
-        if(timerHandlers[i].function != NULL) {
-            if (timerHandlers[i].overflowTime < nextHandlerOverflow
-                || (timerHandlers[i].overflowTime == nextHandlerOverflow
-                    && timerHandlers[i].triggerTime < nextHandlerTrigger)) {
-                nextHandlerOverflow = timerHandlers[i].overflowTime;
-                nextHandlerTrigger = timerHandlers[i].triggerTime;
-            }
+static timerHandler* Timer_wheelDetach(int level, int slot) {
+    timerHandler* list = timerWheel[level][slot];
+    timerWheel[level][slot] = NULL;
+    timerWheelUsed[level] &= ~((uint64_t)1 << slot);
+    return list;
+}
+
+
+/** \fn uint64_t Timer_wheelNextEvent()
+ *  \brief Compute the first time at which the wheel has work to do
+ *  \return The time of the next expiry or cascade (0xFFFFFFFFFFFFFFFF if the
+ *  wheel is empty)
+ *
+ *  This is a lower bound of the next deadline: a cascade may only move
+ *  handlers down without calling any of them.
+ */
+static uint64_t Timer_wheelNextEvent() {
+    uint64_t next = 0xFFFFFFFFFFFFFFFFULL;
+    for(int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        if(timerWheelUsed[level] == 0) {
+            continue;
+        }
+        int shift = level * TIMER_WHEEL_BITS;
+        // First slot starting at or after the wheel time.
+        uint64_t first = (timerWheelTime + ((uint64_t)1 << shift) - 1) >> shift;
+        int rot = first & TIMER_WHEEL_MASK;
+        uint64_t used = timerWheelUsed[level];
+        if(rot != 0) {
+            used = (used >> rot) | (used << (TIMER_WHEEL_SIZE - rot));
+        }
+        uint64_t event = (first + __builtin_ctzll(used)) << shift;
+        if(event < next) {
+            next = event;
         }
     }
+    return next;
 }
 
 
-/** \fn void Timer_callHandlers()
- *  \brief call needed function that has been delayed
+/** \fn void Timer_wheelProcess(uint64_t time)
+ *  \brief Cascade the slots starting at time and call the handlers due
+ *  \param time A time returned by Timer_wheelNextEvent
  */
-void Timer_callHandlers() {
-    bool needCheck = false;
-    //If the freerunning counter has overflowed
-    if(lastTimeCheckedHandlers > Timer_GetTime()) {
-        for(int i = 0; i<TIMER_MAX_HANDLERS; i++) {
-            if(timerHandlers[i].overflowTime > 0) {
-                timerHandlers[i].overflowTime--;
-            }
-            else if(timerHandlers[i].overflowTime == 0 &&
-                    timerHandlers[i].function != NULL) {
-                Timer_callHandlingFunction(i);
-                needCheck = true;
-            }
+static void Timer_wheelProcess(uint64_t time) {
+    timerWheelTime = time;
+    for(int level = TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+        int shift = level * TIMER_WHEEL_BITS;
+        if((time & (((uint64_t)1 << shift) - 1)) != 0) {
+            continue;
         }
-        if(nextHandlerTrigger != 0) {
-            nextHandlerTrigger--;
+        timerHandler* list = Timer_wheelDetach(level, (time >> shift) & TIMER_WHEEL_MASK);
+        while(list != NULL) {
+            timerHandler* next = list->next;
+            Timer_wheelInsert(list);
+            list = next;
         }
     }
 
-    lastTimeCheckedHandlers = Timer_GetTime();
-    //We check the function only if necessary
-    if((nextHandlerOverflow == 0 && nextHandlerTrigger <= lastTimeCheckedHandlers) || needCheck) {
-        for(int i = 0; i<TIMER_MAX_HANDLERS; i++) {
-            if(timerHandlers[i].overflowTime == 0 &&
-               timerHandlers[i].triggerTime < lastTimeCheckedHandlers &&
-               timerHandlers[i].function != NULL) {
-                Timer_callHandlingFunction(i);
-            }
-        }
-        Timer_updateNextHandler();
+    // Handlers added by the called functions go at least one tick later.
+    timerWheelTime = time + 1;
+    timerExpiring = Timer_wheelDetach(0, time & TIMER_WHEEL_MASK);
+    for(timerHandler* h = timerExpiring; h != NULL; h = h->next) {
+        h->level = TIMER_WHEEL_LEVELS;
+    }
+    while(timerExpiring != NULL) {
+        timerHandler* h = timerExpiring;
+        Timer_wheelRemove(h);
+        h->pending = false;
+        h->function(h, h->param, h->context);
     }
 }
 
 
-/** \fn int Timer_getFreeHandler()
- *  \brief get the index of a free handler (to delay functions)
- *  \return The indef of a free handler (or -1 if there is no free handlers)
+/** \fn void Timer_addHandler(timerHandler* handler, uint64_t deadline, timerFunction* function, void* param, void* context)
+ *  \brief Delay the call of a function
+ *  \param handler Storage for the handler, owned by the caller until the
+ *  function is called or the handler is cancelled
+ *  \param deadline When to call the function, in microseconds (see
+ *  Timer_GetTime64)
+ *  \param function The function pointer
+ *  \param param The second parameter of the function
+ *  \param context The third parameter of the function
+ *
+ *  Re-adding a pending handler moves it to the new deadline.
  */
-int Timer_getFreeHandler() {
-    for(int i = 0; i<TIMER_MAX_HANDLERS; i++) {
-        if(timerHandlers[i].function == NULL) {
-            return i;
-        }
+void Timer_addHandler(timerHandler* handler, uint64_t deadline, timerFunction* function, void* param, void* context) {
+    Timer_cancelHandler(handler);
+    handler->function = function;
+    handler->param = param;
+    handler->context = context;
+    handler->deadline = deadline;
+    handler->pending = true;
+    Timer_wheelInsert(handler);
+}
+
+
+/** \fn bool Timer_cancelHandler(timerHandler* handler)
+ *  \brief Delete the call of a delayed function
+ *  \param handler The handler given to Timer_addHandler
+ *  \return true if the function was still waiting to be called
+ */
+bool Timer_cancelHandler(timerHandler* handler) {
+    if(!handler->pending) {
+        return false;
+    }
+    Timer_wheelRemove(handler);
+    handler->pending = false;
+    return true;
+}
+
+
+/** \fn uint32_t Timer_nextHandlerDelay()
+ *  \brief Compute when the next delayed function has to be called
+ *  \return The delay in microseconds (0 if already late, 0xFFFFFFFF if there
+ *  is no delayed function)
+ */
+uint32_t Timer_nextHandlerDelay() {
+    uint64_t next = Timer_wheelNextEvent();
+    if(next == 0xFFFFFFFFFFFFFFFFULL) {
+        return 0xFFFFFFFF;
+    }
+    uint64_t now = Timer_GetTime64();
+    if(next <= now) {
+        return 0;
+    }
+    if(next - now >= 0xFFFFFFFF) {
+        return 0xFFFFFFFE;
     }
-    return -1;
+    return next - now;
 }
 
 
-/** \fn void Timer_deleteHandler(unsigned id)
- *  \brief Delete the call a delayed function
- *  \param id The id of the delayed function
+/** \fn void Timer_callHandlers()
+ *  \brief call needed function that has been delayed
  */
-void Timer_deleteHandler(unsigned id) {
-    timerHandlers[id].function = NULL;
+void Timer_callHandlers() {
+    uint64_t now = Timer_GetTime64();
+    while(timerWheelTime <= now) {
+        uint64_t next = Timer_wheelNextEvent();
+        if(next > now) {
+            // Nothing happens before now: jump over the empty slots.
+            timerWheelTime = now + 1;
+            break;
+        }
+        Timer_wheelProcess(next);
+    }
 }
 
 
@@ -233,6 +346,35 @@ uint32_t Timer_GetTime() {
 }
 
 
+/** \fn uint64_t Timer_GetTime64()
+ *  \brief Get the system timer counter
+ *  \return The number of microseconds since boot, on 64 bits
+ */
+uint64_t Timer_GetTime64() {
+  uint32_t hi = rpiSystemTimer->counter_hi;
+  uint32_t lo = rpiSystemTimer->counter_lo;
+  uint32_t hi2 = rpiSystemTimer->counter_hi;
+  if(hi != hi2) {
+    // The low word wrapped between the two reads.
+    lo = rpiSystemTimer->counter_lo;
+    hi = hi2;
+  }
+  dmb();
+  return ((uint64_t)hi << 32) | lo;
+}
+
+
+/** \fn uint32_t Timer_GetValue()
+ *  \brief Get the countdown value of the timer
+ *  \return The time left before the next timer interrupt, in microseconds
+ */
+uint32_t Timer_GetValue() {
+  uint32_t res = rpiArmTimer->value;
+  dmb();
+  return res;
+}
+
+
 /** \fn void Timer_WaitMicroSeconds(uint32_t time)
  *  \brief Wait for a certain amount of time (in microseconds)
  *  \param time The time to wait in microseconds
@@ -274,9 +416,7 @@ void Timer_Setup() {
     RPI_GetIRQController()->Enable_Basic_IRQs |= RPI_BASIC_ARM_TIMER_IRQ;
     dmb();
 
-    nextHandlerTrigger = 0xFFFFFFFF;
-    nextHandlerOverflow = 0xFFFFFFFF;
-    lastTimeCheckedHandlers = Timer_GetTime();
+    timerWheelTime = Timer_GetTime64();
 }
 
 
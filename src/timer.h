@@ -68,6 +68,11 @@ typedef struct {
 #define TIMER_CTRL_HALT_STOP (1 << 8) // Timer halted if ARM is in debug halt mode
 #define TIMER_CTRL_FREERUNNING_COUNTER (1 << 9)
 
+/** \def TIMER_MAX_LOAD
+ *  \brief Longest period (in microseconds) the ARM timer can be loaded with.
+ */
+#define TIMER_MAX_LOAD 0x7FFFFF
+
 /**
  * Setup the timer
  */
@@ -85,6 +90,11 @@ void Timer_Enable();
  */
 void Timer_Disable_Interrupts();
 
+/**
+ * Enable the interrupts (after a call to Timer_Disable_Interrupts)
+ */
+void Timer_Enable_Interrupts();
+
 /**
  * Disable the timer
  */
@@ -107,37 +117,59 @@ void Timer_SetReload(uint32_t value);
  */
 void Timer_ClearInterrupt();
 
+typedef struct timerHandler timerHandler;
+
 /**
  * the functions called by the timer
- * params are id,param and context
+ * params are handler,param and context
+ */
+typedef void timerFunction (timerHandler*,void*,void*);
+
+/** \def TIMER_WHEEL_BITS
+ *  \brief log2 of the number of slots per level of the timing wheel
+ */
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SIZE (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
+
+/** \def TIMER_WHEEL_LEVELS
+ *  \brief Number of levels of the timing wheel (6 levels cover 2^36us, about
+ *  19 hours; later deadlines wait in the top level)
  */
-typedef void timerFunction (unsigned,void*,void*);
+#define TIMER_WHEEL_LEVELS 6
 
 /** \st timerHandler
  *  \brief Represent a function handler for delayed function call
+ *
+ *  The storage is provided by the caller (usually embedded in a bigger
+ *  structure), so adding and cancelling a handler never allocates.
  */
-typedef struct timerHandler {
+struct timerHandler {
     timerFunction* function;    ///< The address of the function
     void* param;                ///< Its second parameter
     void* context;              ///< Its third parameter
-    uint32_t triggerTime;       ///< When to execute it (Timer_GetTime
-    uint32_t overflowTime;      ///< How many overflow of Timer_GetTime before executing it
-} timerHandler;
+    uint64_t deadline;          ///< When to execute it (Timer_GetTime64)
+    timerHandler* next;         ///< Next handler in the same wheel slot
+    timerHandler* prev;         ///< Previous handler in the same wheel slot
+    uint8_t level;              ///< Level of the wheel the handler is in
+    uint8_t slot;               ///< Slot of the level the handler is in
+    bool pending;               ///< The function has not been called yet
+};
 
 /**
  * Delay the call of a function
  */
-int Timer_addHandler(uint32_t millis, timerFunction* function, void* param, void* context);
+void Timer_addHandler(timerHandler* handler, uint64_t deadline, timerFunction* function, void* param, void* context);
 
 /**
- * Calculate the next time a handler needs to be called
+ * Cancel a delayed function call
  */
-void Timer_updateNextHandler();
+bool Timer_cancelHandler(timerHandler* handler);
 
 /**
- * Call a handling function and delete it
+ * Return the delay before the next handler has to be called
  */
-void Timer_callHandlingFunction(unsigned int i);
+uint32_t Timer_nextHandlerDelay();
 
 /**
  * Call necessary handlers
@@ -145,19 +177,19 @@ void Timer_callHandlingFunction(unsigned int i);
 void Timer_callHandlers();
 
 /**
- * Get a free timer handler
+ * Return the time left before the next timer interrupt
  */
-int Timer_getFreeHandler();
+uint32_t Timer_GetValue();
 
 /**
- * Delete a timer handler
+ * Return the current time
  */
-void Timer_deleteHandler(unsigned id);
+uint32_t Timer_GetTime();
 
 /**
- * Return the current time
+ * Return the system timer counter (microseconds since boot)
  */
-uint32_t Timer_GetTime();
+uint64_t Timer_GetTime64();
 
 
 /**
@@ -0,0 +1,189 @@
+#include "uaccess.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mmu.h"
+
+/** \file uaccess.c
+ *  \brief Copies between the kernel and user memory.
+ *
+ *  The user half of the address space is checked against __ram_size, then
+ *  copied by the routines of uaccess_asm.S, which run at memcpy speed. Their
+ *  loads and stores are listed in the exception table: if the user page is not
+ *  mapped, data_abort_vector resumes at the fixup code, which returns -EFAULT,
+ *  instead of stopping the kernel.
+ */
+
+extern unsigned int __ram_size;
+extern uaccess_fixup_t __ex_table_start[];
+extern uaccess_fixup_t __ex_table_end[];
+
+int __copy_user(void* to, const void* from, size_t n);
+int __strncpy_user(char* dst, const char* src, size_t n);
+
+/** \fn static bool user_range(uintptr_t addr, size_t size)
+ *  \brief Tell whether a range is in the user half of the address space.
+ */
+static bool user_range(uintptr_t addr, size_t size) {
+	return addr != 0 && addr <= __ram_size && size <= __ram_size - addr;
+}
+
+/** \fn bool access_ok(process* p, const void* addr, size_t size)
+ *  \brief Check that a range of the user memory is mapped in a process, one
+ *  translation per section.
+ */
+bool access_ok(process* p, const void* addr, size_t size) {
+	uintptr_t start = (uintptr_t)addr;
+	if (!user_range(start, size)) {
+		return false;
+	}
+	if (size == 0) {
+		return true;
+	}
+	for (uintptr_t s = start & ~(PAGE_SECTION-1);s <= start + size - 1;s += PAGE_SECTION) {
+		if (mmu_vir2phy_ttb(s, p->ttb_address) == (uintptr_t)-1) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/** \fn int copy_from_user(void* to, const void* from, size_t n)
+ *  \brief Copy from the memory of the current process.
+ *  \return 0 on success, -EFAULT if the source is not mapped.
+ */
+int copy_from_user(void* to, const void* from, size_t n) {
+	if (!user_range((uintptr_t)from, n)) {
+		return -EFAULT;
+	}
+	return __copy_user(to, from, n);
+}
+
+/** \fn int copy_to_user(void* to, const void* from, size_t n)
+ *  \brief Copy to the memory of the current process.
+ *  \return 0 on success, -EFAULT if the destination is not mapped.
+ */
+int copy_to_user(void* to, const void* from, size_t n) {
+	if (!user_range((uintptr_t)to, n)) {
+		return -EFAULT;
+	}
+	return __copy_user(to, from, n);
+}
+
+/** \fn int strncpy_from_user(char* dst, const char* src, size_t n)
+ *  \brief Copy a string from the memory of the current process.
+ *  \param n Size of dst.
+ *  \return The length of the string, n if it does not fit (dst is then not
+ *  terminated), -EFAULT if it is not mapped.
+ */
+int strncpy_from_user(char* dst, const char* src, size_t n) {
+	uintptr_t addr = (uintptr_t)src;
+	if (addr == 0 || addr >= __ram_size) {
+		return -EFAULT;
+	}
+	if (n > __ram_size - addr) {
+		n = __ram_size - addr; // The string must end in user memory.
+	}
+	return __strncpy_user(dst, src, n);
+}
+
+/** \fn char* strndup_from_user(const char* src, size_t n, int* err)
+ *  \brief Copy a string, such as a path, from the memory of the current
+ *  process to a new kernel buffer, to be freed.
+ *  \param n Largest size of the string, with its null byte.
+ *  \return The copy, NULL with -EFAULT, -ENAMETOOLONG or -ENOMEM in err.
+ */
+char* strndup_from_user(const char* src, size_t n, int* err) {
+	char* dst = malloc(n);
+	if (dst == NULL) {
+		*err = -ENOMEM;
+		return NULL;
+	}
+	int len = strncpy_from_user(dst, src, n);
+	if (len < 0 || (size_t)len == n) {
+		free(dst);
+		*err = len < 0 ? len : -ENAMETOOLONG;
+		return NULL;
+	}
+	return dst;
+}
+
+/** \fn char** strv_dup_from_user(const char* const* v, int* err)
+ *  \brief Copy a NULL-terminated array of strings, such as the arguments of
+ *  execve, from the memory of the current process. Free it with strv_free.
+ *  \return The copy, NULL with -EFAULT, -E2BIG or -ENOMEM in err.
+ */
+char** strv_dup_from_user(const char* const* v, int* err) {
+	char** copy = malloc((USER_ARGV_MAX + 1) * sizeof(char*));
+	if (copy == NULL) {
+		*err = -ENOMEM;
+		return NULL;
+	}
+	for (int n=0;;n++) {
+		const char* s;
+		int res = copy_from_user(&s, &v[n], sizeof(char*));
+		if (res == 0 && s == NULL) {
+			copy[n] = NULL;
+			return copy;
+		}
+		if (res == 0 && n == USER_ARGV_MAX) {
+			res = -E2BIG;
+		}
+		if (res == 0 && (copy[n] = strndup_from_user(s, USER_ARG_MAX, &res)) != NULL) {
+			continue;
+		}
+		copy[n] = NULL;
+		strv_free(copy);
+		*err = res == -ENAMETOOLONG ? -E2BIG : res;
+		return NULL;
+	}
+}
+
+/** \fn void strv_free(char** v)
+ *  \brief Free a copy made by strv_dup_from_user.
+ */
+void strv_free(char** v) {
+	if (v != NULL) {
+		for (int i=0;v[i] != NULL;i++) {
+			free(v[i]);
+		}
+	}
+	free(v);
+}
+
+/** \fn int copy_to_process(process* p, void* to, const void* from, size_t n)
+ *  \brief Copy to the memory of any process, through the physical mapping of
+ *  the RAM, a section at a time.
+ *  \return 0 on success, -EFAULT if the destination is not mapped.
+ */
+int copy_to_process(process* p, void* to, const void* from, size_t n) {
+	if (!access_ok(p, to, n)) {
+		return -EFAULT;
+	}
+	uintptr_t addr = (uintptr_t)to;
+	while (n > 0) {
+		size_t chunk = PAGE_SECTION - (addr & (PAGE_SECTION-1));
+		if (chunk > n) {
+			chunk = n;
+		}
+		memcpy((void*)(0x80000000 + mmu_vir2phy_ttb(addr, p->ttb_address)), from, chunk);
+		addr += chunk;
+		from = (const char*)from + chunk;
+		n -= chunk;
+	}
+	return 0;
+}
+
+/** \fn uintptr_t uaccess_fixup(uintptr_t pc)
+ *  \brief Where to resume after a kernel data abort.
+ *  \param pc Address of the faulting instruction.
+ *  \return The fixup address, 0 if the instruction does not access user memory.
+ */
+uintptr_t uaccess_fixup(uintptr_t pc) {
+	for (uaccess_fixup_t* e = __ex_table_start;e < __ex_table_end;e++) {
+		if (e->insn == pc) {
+			return e->fixup;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,44 @@
+#ifndef UACCESS_H
+#define UACCESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "process.h"
+
+/** \def USER_PATH_MAX
+ *  \brief Largest path copied from a process, with its null byte.
+ */
+#define USER_PATH_MAX 1024
+
+/** \def USER_ARG_MAX
+ *  \brief Largest argument or environment string given to execve, with its
+ *  null byte.
+ */
+#define USER_ARG_MAX 4096
+
+/** \def USER_ARGV_MAX
+ *  \brief Most arguments, or environment strings, given to execve.
+ */
+#define USER_ARGV_MAX 256
+
+/** \struct uaccess_fixup_t
+ *  \brief Entry of the exception table: an instruction accessing user memory,
+ *  and where to resume if it faults.
+ */
+typedef struct {
+	uintptr_t insn;
+	uintptr_t fixup;
+} uaccess_fixup_t;
+
+bool 		access_ok(process* p, const void* addr, size_t size);
+int 		copy_from_user(void* to, const void* from, size_t n);
+int 		copy_to_user(void* to, const void* from, size_t n);
+int 		strncpy_from_user(char* dst, const char* src, size_t n);
+char* 		strndup_from_user(const char* src, size_t n, int* err);
+char** 		strv_dup_from_user(const char* const* v, int* err);
+void 		strv_free(char** v);
+int 		copy_to_process(process* p, void* to, const void* from, size_t n);
+uintptr_t 	uaccess_fixup(uintptr_t pc);
+
+#endif //UACCESS_H
@@ -0,0 +1,221 @@
+#include "uring.h"
+#include "uaccess.h"
+#include <errno.h>
+#include "fdsyscalls.h"
+#include "syscalls.h"
+
+/** \file uring.c
+ *  \brief Batched system calls through rings shared with the program.
+ *
+ *  uring_enter takes every request queued in the submission ring, runs it and
+ *  writes its result to the completion ring, for the cost of a single trap.
+ *  A read which would block does not stop the batch: the request is kept by
+ *  the kernel and retried at each following uring_enter of the process,
+ *  including while the process waits for completions in uring_enter.
+ *
+ *  A request is only taken from the submission ring when its completion is
+ *  sure to fit in the completion ring, so completions are never lost.
+ */
+
+/** \fn static bool uring_valid(process* p, uring_t* ring)
+ *  \brief Check that a ring lies in the memory of the process.
+ */
+static bool uring_valid(process* p, uring_t* ring) {
+	if (!access_ok(p, ring, sizeof(uring_t))) {
+		return false;
+	}
+	uint32_t entries = ring->entries;
+	if (entries == 0 || entries > URING_MAX_ENTRIES || (entries & (entries - 1)) != 0) {
+		return false;
+	}
+	return access_ok(p, ring->sqes, entries * sizeof(*ring->sqes))
+		&& access_ok(p, ring->cqes, entries * sizeof(*ring->cqes));
+}
+
+/** \fn static int uring_in_flight(process* p, uring_t* ring)
+ *  \brief Number of requests of a ring kept by the kernel.
+ */
+static int uring_in_flight(process* p, uring_t* ring) {
+	int n = 0;
+	for (uring_op_t* op = p->uring_ops; op != NULL; op = op->next) {
+		if (op->ring == ring) {
+			n++;
+		}
+	}
+	return n;
+}
+
+/** \fn static bool uring_fd_busy(process* p, int fd, uring_op_t* until)
+ *  \brief A request on this file descriptor is kept by the kernel, before
+ *  until (NULL for all of them). The next requests on the file have to wait
+ *  for it, so that they run in order.
+ */
+static bool uring_fd_busy(process* p, int fd, uring_op_t* until) {
+	for (uring_op_t* op = p->uring_ops; op != until; op = op->next) {
+		if (op->sqe.fd == fd) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/** \fn static void uring_complete(uring_t* ring, uint32_t user_data, int res)
+ *  \brief Write a completion. The caller made sure there is room for it.
+ */
+static void uring_complete(uring_t* ring, uint32_t user_data, int res) {
+	uring_cqe_t* cqe = &ring->cqes[ring->cq_tail & (ring->entries - 1)];
+	cqe->user_data 	= user_data;
+	cqe->res 		= res;
+	ring->cq_tail++;
+}
+
+/** \fn static bool uring_run(process* p, const uring_sqe_t* sqe, int* res)
+ *  \brief Run a request.
+ *  \param res Where to store its result.
+ *  \return false if it would block, it is then left undone.
+ */
+static bool uring_run(process* p, const uring_sqe_t* sqe, int* res) {
+	if (sqe->flags != 0) {
+		*res = -EINVAL;
+		return true;
+	}
+	switch (sqe->opcode) {
+		case URING_OP_NOP:
+			*res = 0;
+			break;
+		case URING_OP_READ:
+			if (sqe->off != -1) {
+				*res = svc_pread(sqe->fd, (char*)sqe->addr, sqe->len, sqe->off);
+				break;
+			}
+			*res = svc_read(sqe->fd, (char*)sqe->addr, sqe->len);
+			if (p->status == status_blocked_svc) {
+				p->status = status_active;
+				return false;
+			}
+			break;
+		case URING_OP_WRITE:
+			if (sqe->off != -1) {
+				*res = svc_pwrite(sqe->fd, (char*)sqe->addr, sqe->len, sqe->off);
+			} else {
+				*res = svc_write(sqe->fd, (char*)sqe->addr, sqe->len);
+			}
+			break;
+		case URING_OP_OPENAT:
+			*res = svc_openat(sqe->fd, (char*)sqe->addr, sqe->len);
+			break;
+		case URING_OP_CLOSE:
+			*res = svc_close(sqe->fd);
+			break;
+		default:
+			*res = -EINVAL;
+	}
+	return true;
+}
+
+/** \fn static void uring_retry(process* p)
+ *  \brief Run again the requests which would have blocked.
+ *
+ *  Requests whose ring is no longer valid are dropped.
+ */
+static void uring_retry(process* p) {
+	uring_op_t** link = &p->uring_ops;
+	while (*link != NULL) {
+		uring_op_t* op = *link;
+		int res;
+		if (!uring_valid(p, op->ring)) {
+			*link = op->next;
+			free(op);
+		} else if (!uring_fd_busy(p, op->sqe.fd, op) && uring_run(p, &op->sqe, &res)) {
+			uring_complete(op->ring, op->sqe.user_data, res);
+			*link = op->next;
+			free(op);
+		} else {
+			link = &op->next;
+		}
+	}
+}
+
+/** \fn static bool uring_keep(process* p, uring_t* ring, const uring_sqe_t* sqe)
+ *  \brief Keep a request which would block, to retry it later.
+ *  \return false if there is no memory for it.
+ */
+static bool uring_keep(process* p, uring_t* ring, const uring_sqe_t* sqe) {
+	uring_op_t* op = malloc(sizeof(uring_op_t));
+	if (op == NULL) {
+		return false;
+	}
+	op->sqe 	= *sqe;
+	op->ring 	= ring;
+	op->next 	= NULL;
+	uring_op_t** link = &p->uring_ops;
+	while (*link != NULL) {
+		link = &(*link)->next;
+	}
+	*link = op;
+	return true;
+}
+
+/** \fn static void uring_submit(process* p, uring_t* ring)
+ *  \brief Take the requests of the submission ring, as long as their
+ *  completion fits.
+ */
+static void uring_submit(process* p, uring_t* ring) {
+	uint32_t in_flight = uring_in_flight(p, ring);
+	while (ring->sq_head != ring->sq_tail
+	&& (ring->cq_tail - ring->cq_head) + in_flight < ring->entries) {
+		uring_sqe_t sqe = ring->sqes[ring->sq_head & (ring->entries - 1)];
+		ring->sq_head++;
+
+		int res;
+		bool keep = sqe.opcode != URING_OP_NOP && uring_fd_busy(p, sqe.fd, NULL);
+		if (!keep && uring_run(p, &sqe, &res)) {
+			uring_complete(ring, sqe.user_data, res);
+		} else if (uring_keep(p, ring, &sqe)) {
+			in_flight++;
+		} else {
+			uring_complete(ring, sqe.user_data, -ENOMEM);
+		}
+	}
+}
+
+/** \fn int svc_uring_enter(uring_t* ring, uint32_t min_complete)
+ *  \brief Run the queued requests of a ring, and wait for completions.
+ *  \param ring The ring, in the memory of the caller.
+ *  \param min_complete Wait until this many completions are in the ring, or
+ *  until no request is left to complete.
+ *  \return The number of completions in the ring, -EFAULT or -EINVAL if the
+ *  ring is not valid.
+ *
+ *  While waiting, the caller is blocked like a read on a device, and this is
+ *  called again when its turn comes.
+ */
+int svc_uring_enter(uring_t* ring, uint32_t min_complete) {
+	process* p = get_current_process();
+	if (!access_ok(p, ring, sizeof(uring_t))) {
+		return -EFAULT;
+	}
+	if (!uring_valid(p, ring)) {
+		return -EINVAL;
+	}
+	uring_retry(p);
+	uring_submit(p, ring);
+
+	uint32_t ready = ring->cq_tail - ring->cq_head;
+	if (ready < min_complete && uring_in_flight(p, ring) > 0) {
+		p->status = status_blocked_svc;
+		return 0;
+	}
+	return ready;
+}
+
+/** \fn void uring_release(process* p)
+ *  \brief Drop the requests kept for a process which dies or changes program.
+ */
+void uring_release(process* p) {
+	while (p->uring_ops != NULL) {
+		uring_op_t* op = p->uring_ops;
+		p->uring_ops = op->next;
+		free(op);
+	}
+}
@@ -0,0 +1,11 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stdint.h>
+#include "process.h"
+#include "../include/uring.h"
+
+int svc_uring_enter(uring_t* ring, uint32_t min_complete);
+void uring_release(process* p);
+
+#endif //URING_H
@@ -0,0 +1,88 @@
+#include "vdso.h"
+#include <stdlib.h>
+#include "kernel.h"
+#include "mmu.h"
+#include "memalloc.h"
+#include "timer.h"
+#include "debug.h"
+#include "arm.h"
+
+/** \file vdso.c
+ *  \brief Kernel data shared with every process.
+ *
+ *  A section is mapped read-only at VDSO_ADDRESS in each process, so that
+ *  libc can read the time and the pid without a service call. The page holds
+ *  no time value, which would be stale between two updates, but the scale of
+ *  the ARM generic timer that processes read themselves (RPI2 only).
+ */
+
+/** \var uintptr_t vdso_section
+ *  \brief Physical address of the shared section.
+ */
+static uintptr_t vdso_section;
+
+/** \var vdso_data_t* vdso_data
+ *  \brief Kernel view of the shared data.
+ */
+static vdso_data_t* vdso_data;
+
+/** \fn static void vdso_time_init()
+ *  \brief Let processes read the generic timer, and publish how its count
+ *  maps to the system timer of the kernel (see Timer_GetTime64).
+ */
+static void vdso_time_init() {
+#ifdef RPI2
+	uint32_t freq = generic_timer_frequency();
+	if (freq <= 1000000) { // Not set by the firmware, or too slow for mult.
+		kernel_printf("[INFO] vdso: no generic timer, time is a service call\n");
+		return;
+	}
+	generic_timer_user_access();
+
+	vdso_data->seq++;
+	dmb();
+	vdso_data->time_base 	= Timer_GetTime64();
+	vdso_data->counter_base = generic_timer_count();
+	vdso_data->mult 		= (((uint64_t)1000000 << 32) + freq / 2) / freq;
+	dmb();
+	vdso_data->seq++;
+#endif
+}
+
+/** \fn void vdso_init()
+ *  \brief Allocate the shared section.
+ */
+void vdso_init() {
+	page_list_t* res = paging_allocate(1);
+	if (res == NULL) {
+		kdebug(D_KERNEL, 10, "Can't allocate the vdso section.\n");
+		while(1) {}
+	}
+	vdso_section = res->address*PAGE_SECTION;
+	free(res);
+
+	vdso_data 		= (vdso_data_t*)(0x80000000 + vdso_section);
+	vdso_data->seq 	= 0;
+	vdso_data->pid 	= -1;
+	vdso_data->mult = 0;
+	vdso_time_init();
+	kernel_printf("[INFO] vdso at %p\n", vdso_section);
+}
+
+/** \fn void vdso_map(uintptr_t ttb_address)
+ *  \brief Map the shared section in a process' translation table.
+ *  \param ttb_address The translation table (kernel address).
+ */
+void vdso_map(uintptr_t ttb_address) {
+	mmu_add_section(ttb_address, VDSO_ADDRESS, vdso_section, ENABLE_CACHE|ENABLE_WRITE_BUFFER, 0, AP_PRW_URO);
+}
+
+/** \fn void vdso_update(int pid)
+ *  \brief Publish the process about to run.
+ *  \param pid The pid of this process.
+ *
+ *  Called on every return to user mode.
+ */
+void vdso_update(int pid) {
+	vdso_data->pid = pid;
+}
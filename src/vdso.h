@@ -0,0 +1,11 @@
+#ifndef VDSO_H
+#define VDSO_H
+
+#include <stdint.h>
+#include "../include/vdso.h"
+
+void vdso_init();
+void vdso_map(uintptr_t ttb_address);
+void vdso_update(int pid);
+
+#endif //VDSO_H
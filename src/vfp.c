@@ -0,0 +1,191 @@
+#include "vfp.h"
+#include <stdlib.h>
+#include <string.h>
+#include "process.h"
+#include "arm.h"
+#include "debug.h"
+
+/** \file vfp.c
+ *  \brief Lazy switching of the VFP/NEON registers.
+ *
+ *  The FPU registers are not part of user_context_t. At most one process, the
+ *  owner, has its registers loaded in the FPU, and the FPU is only enabled
+ *  while the owner runs. Another process using it traps as an undefined
+ *  instruction: the registers are swapped, and the instruction is run again.
+ *  Processes that never use the FPU cost nothing on context switches.
+ */
+
+/** \var process* vfp_owner
+ *  \brief Process whose registers are in the FPU, NULL if none.
+ */
+static process* vfp_owner;
+
+#ifdef RPI2
+#define VFP_ARCH ".fpu neon-vfpv4\n"
+#else
+#define VFP_ARCH ".fpu vfp\n"
+#endif
+
+static inline uint32_t fpexc_read() {
+	uint32_t r;
+	asm volatile(VFP_ARCH "vmrs %0, fpexc" : "=r" (r));
+	return r;
+}
+
+static inline void fpexc_write(uint32_t r) {
+	asm volatile(VFP_ARCH "vmsr fpexc, %0" :: "r" (r) : "memory");
+}
+
+/** \fn static void vfp_save(vfp_state_t* state)
+ *  \brief Copy the FPU registers to memory (the FPU must be enabled).
+ */
+static void vfp_save(vfp_state_t* state) {
+	uint64_t* d = state->d;
+	asm volatile(VFP_ARCH
+				 "vstmia %0!, {d0-d15}\n"
+#ifdef RPI2
+				 "vstmia %0!, {d16-d31}\n"
+#endif
+				 : "+r" (d) :: "memory");
+	asm volatile(VFP_ARCH "vmrs %0, fpscr" : "=r" (state->fpscr));
+}
+
+/** \fn static void vfp_restore(vfp_state_t* state)
+ *  \brief Load the FPU registers from memory (the FPU must be enabled).
+ */
+static void vfp_restore(vfp_state_t* state) {
+	uint64_t* d = state->d;
+	asm volatile(VFP_ARCH
+				 "vldmia %0!, {d0-d15}\n"
+#ifdef RPI2
+				 "vldmia %0!, {d16-d31}\n"
+#endif
+				 : "+r" (d) :: "memory");
+	asm volatile(VFP_ARCH "vmsr fpscr, %0" :: "r" (state->fpscr));
+}
+
+/** \fn void vfp_init()
+ *  \brief Give user mode access to the FPU, which starts disabled.
+ */
+void vfp_init() {
+	uint32_t cpacr = mrc(p15, 0, c1, c0, 2);
+	cpacr |= (0xF << 20); // Full access to cp10 and cp11.
+	mcr(p15, 0, c1, c0, 2, cpacr);
+	isb();
+	fpexc_write(0);
+	vfp_owner = NULL;
+}
+
+/** \fn bool vfp_trap(process* p)
+ *  \brief Handle an undefined instruction executed by a process.
+ *  \param p The process.
+ *  \return true if the FPU was disabled: it now holds the process' registers,
+ *  and the instruction has to be run again. false for a genuinely undefined
+ *  instruction.
+ */
+bool vfp_trap(process* p) {
+	if (fpexc_read() & FPEXC_EN) {
+		return false;
+	}
+	fpexc_write(FPEXC_EN);
+	if (vfp_owner != p) {
+		if (vfp_owner != NULL) {
+			vfp_save(vfp_owner->vfp);
+		}
+		if (p->vfp == NULL) { // First use: start from cleared registers.
+			p->vfp = calloc(1, sizeof(vfp_state_t));
+			if (p->vfp == NULL) {
+				fpexc_write(0);
+				vfp_owner = NULL;
+				return false;
+			}
+			p->vfp->fpscr = FPSCR_INIT;
+			kdebug(D_PROCESS, 2, "Process %d uses the FPU.\n", p->asid);
+		}
+		vfp_restore(p->vfp);
+		vfp_owner = p;
+	}
+	return true;
+}
+
+/** \fn void vfp_switch(process* p)
+ *  \brief Enable the FPU only if the process about to run owns it.
+ *  \param p The process, NULL if none.
+ *
+ *  Called on every return to user mode.
+ */
+void vfp_switch(process* p) {
+	fpexc_write((p != NULL && p == vfp_owner) ? FPEXC_EN : 0);
+}
+
+/** \fn void vfp_flush(process* p)
+ *  \brief Write back the FPU registers of a process to its saved state.
+ *  \param p The process.
+ *
+ *  The FPU keeps the registers, so the process can go on using it.
+ */
+void vfp_flush(process* p) {
+	if (vfp_owner == p && p != NULL) {
+		uint32_t fpexc = fpexc_read();
+		fpexc_write(FPEXC_EN);
+		vfp_save(p->vfp);
+		fpexc_write(fpexc);
+	}
+}
+
+/** \fn vfp_state_t* vfp_copy(process* p)
+ *  \brief Duplicate the FPU registers of a process (for fork and clone).
+ *  \return A copy of the registers, NULL if the process never used the FPU.
+ */
+vfp_state_t* vfp_copy(process* p) {
+	if (p->vfp == NULL) {
+		return NULL;
+	}
+	vfp_flush(p);
+	vfp_state_t* res = malloc(sizeof(vfp_state_t));
+	if (res != NULL) {
+		memcpy(res, p->vfp, sizeof(vfp_state_t));
+	}
+	return res;
+}
+
+/** \fn void vfp_release(process* p)
+ *  \brief Forget the FPU registers of a dying process.
+ */
+void vfp_release(process* p) {
+	if (vfp_owner == p) {
+		vfp_owner = NULL;
+	}
+	free(p->vfp);
+	p->vfp = NULL;
+}
+
+/** \fn bool vfp_signal_enter(process* p, vfp_state_t* save)
+ *  \brief Keep the FPU registers of a process about to run a signal handler.
+ *  \param save Where to copy them, in the signal frame.
+ *  \return false if the process never used the FPU (nothing was saved).
+ */
+bool vfp_signal_enter(process* p, vfp_state_t* save) {
+	if (p->vfp == NULL) {
+		return false;
+	}
+	vfp_flush(p);
+	memcpy(save, p->vfp, sizeof(vfp_state_t));
+	return true;
+}
+
+/** \fn void vfp_signal_return(process* p, const vfp_state_t* saved)
+ *  \brief Give back the FPU registers saved by vfp_signal_enter.
+ */
+void vfp_signal_return(process* p, const vfp_state_t* saved) {
+	if (p->vfp == NULL) {
+		return;
+	}
+	memcpy(p->vfp, saved, sizeof(vfp_state_t));
+	if (vfp_owner == p) {
+		uint32_t fpexc = fpexc_read();
+		fpexc_write(FPEXC_EN);
+		vfp_restore(p->vfp);
+		fpexc_write(fpexc);
+	}
+}
@@ -0,0 +1,53 @@
+#ifndef VFP_H
+#define VFP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** \def VFP_REGISTERS
+ *  \brief Number of double precision registers of the FPU.
+ */
+#ifdef RPI2
+#define VFP_REGISTERS 32 // NEON bank: d0-d31.
+#else
+#define VFP_REGISTERS 16
+#endif
+
+/** \def FPEXC_EN
+ *  \brief FPEXC bit enabling the FPU: when cleared, VFP and NEON
+ *  instructions are undefined.
+ */
+#define FPEXC_EN (1 << 30)
+
+/** \def FPSCR_INIT
+ *  \brief FPSCR of a process' first FPU instruction. The VFP11 of the RPI1
+ *  can't handle denormals, NaN operands or underflows itself: it bounces them
+ *  to support code as undefined instructions, unless it runs in RunFast mode
+ *  (flush to zero, default NaN, no exception trap), which is set here.
+ */
+#ifdef RPI2
+#define FPSCR_INIT 0
+#else
+#define FPSCR_INIT ((1 << 25) | (1 << 24)) // DN | FZ
+#endif
+
+/** \st vfp_state_t
+ *  \brief Saved FPU registers of a process.
+ */
+typedef struct {
+	uint64_t d[VFP_REGISTERS];
+	uint32_t fpscr;
+} vfp_state_t;
+
+typedef struct process process;
+
+void vfp_init();
+bool vfp_trap(process* p);
+void vfp_switch(process* p);
+void vfp_flush(process* p);
+vfp_state_t* vfp_copy(process* p);
+void vfp_release(process* p);
+bool vfp_signal_enter(process* p, vfp_state_t* save);
+void vfp_signal_return(process* p, const vfp_state_t* saved);
+
+#endif //VFP_H
@@ -327,6 +327,108 @@ int vfs_fread(inode_t fd, char* buffer, int length, int offset) {
 	return fd.op->read(fd, buffer, length, offset);
 }
 
+/** \fn int vfs_freadv(inode_t fd, const struct iovec* iov, int iovcnt, int offset)
+ * 	\brief Read a file into several buffers, filled one after the other.
+ *	\param fd File inode.
+ *	\param iov Destination buffers.
+ *	\param iovcnt Number of buffers.
+ * 	\param offset Position in the file of the first byte read.
+ *	\return Number of bytes read on success. -1 on error with errno set, if
+ *	nothing could be read.
+ */
+int vfs_freadv(inode_t fd, const struct iovec* iov, int iovcnt, int offset) {
+	if (S_ISDIR(fd.st.st_mode)) {
+	  	errno = EISDIR;
+	  	return -1;
+	}
+
+	if (offset > fd.st.st_size) {
+	  offset = fd.st.st_size;
+	}
+	if (fd.op->read == NULL) {
+		errno = -1;
+		return -1;
+	}
+
+	int total = 0;
+	for (int i=0;i<iovcnt;i++) {
+		if (iov[i].iov_len == 0) {
+			continue;
+		}
+		int n = fd.op->read(fd, iov[i].iov_base, iov[i].iov_len, offset + total);
+		if (n < 0) {
+			return total > 0 ? total : -1;
+		}
+		total += n;
+		if (n < (int)iov[i].iov_len) { // End of file, or nothing more for now.
+			break;
+		}
+	}
+	return total;
+}
+
+/** \fn int vfs_fmap(inode_t fd, int offset, int length, char** data)
+ * 	\brief Point to the content of a file in place, to copy it without an
+ * 	intermediate buffer.
+ *	\param fd File inode.
+ * 	\param offset Position in the file.
+ *	\param length Most bytes wanted.
+ *	\param data Where to store the pointer to the content.
+ *	\return Number of bytes available at *data, 0 at the end of the file. -1
+ *	with errno set if the file cannot be mapped: it has to be read instead.
+ */
+int vfs_fmap(inode_t fd, int offset, int length, char** data) {
+	if (S_ISDIR(fd.st.st_mode)) {
+	  	errno = EISDIR;
+	  	return -1;
+	}
+	if (fd.op->map == NULL) {
+		errno = ENOSYS;
+		return -1;
+	}
+	return fd.op->map(fd, offset, length, data);
+}
+
+/** \fn int vfs_fwritev(inode_t fd, const struct iovec* iov, int iovcnt, int offset)
+ *	\brief Write several buffers to a file, one after the other.
+ *	\param fd File inode.
+ *	\param iov Buffers to write.
+ *	\param iovcnt Number of buffers.
+ *	\param offset Position in the file of the first byte written.
+ *	\return Number of bytes written on success. -1 on error with errno set, if
+ *	nothing could be written.
+ */
+int vfs_fwritev(inode_t fd, const struct iovec* iov, int iovcnt, int offset) {
+    if (S_ISDIR(fd.st.st_mode)) {
+		errno = EISDIR;
+        return -1;
+    }
+
+    if (offset > fd.st.st_size) {
+        offset = fd.st.st_size;
+    }
+	if (fd.op->write == NULL) {
+		errno = -1;
+		return -1;
+	}
+
+	int total = 0;
+	for (int i=0;i<iovcnt;i++) {
+		if (iov[i].iov_len == 0) {
+			continue;
+		}
+		int n = fd.op->write(fd, iov[i].iov_base, iov[i].iov_len, offset + total);
+		if (n < 0) {
+			return total > 0 ? total : -1;
+		}
+		total += n;
+		if (n < (int)iov[i].iov_len) {
+			break;
+		}
+	}
+	return total;
+}
+
 /** \fn vfs_dir_list_t* vfs_readdir(char* path)
  * 	\brief Read a directory.
  *	\param path Absolute position of the directory.
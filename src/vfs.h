@@ -9,6 +9,8 @@
 
 #include "sys/stat.h"
 
+#include "../include/uio.h"
+
 /** \def MAX_MNT
  *	\brief Number of mount points limit.
  */
@@ -44,6 +46,8 @@ typedef struct {
   int (*mkfile) (inode_t, char*, int); ///< Dir: Create a file.
   int (*ioctl) (inode_t, int, int); ///< File: send control commands to device.
   int (*resize) (inode_t, int); ///< File: resize file content.
+  int (*map) (inode_t, int, int, char**); ///< File: point to the content in place, without copying it.
+  int (*poll) (inode_t); ///< File: events (POLLIN, POLLOUT) which would not block. NULL if it never blocks.
 } inode_operations_t;
 
 /**	\struct inode_t
@@ -96,6 +100,9 @@ char* 		vfs_inode_to_path(inode_t inode, char* buf, size_t cnt);
 void 		vfs_mount(superblock_t* sb, char* path);
 int 		vfs_fwrite	(inode_t fd, char* buffer, int size, int position);
 int 		vfs_fread	(inode_t fd, char* buffer, int size, int position);
+int 		vfs_fwritev	(inode_t fd, const struct iovec* iov, int iovcnt, int position);
+int 		vfs_freadv	(inode_t fd, const struct iovec* iov, int iovcnt, int position);
+int 		vfs_fmap	(inode_t fd, int position, int size, char** data);
 vfs_dir_list_t* vfs_readdir(char* path);
 int 		vfs_attr	(char* path);
 int 		vfs_mkdir	(char* path, char* name, int permissions);
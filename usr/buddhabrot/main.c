@@ -70,8 +70,7 @@ int main() {
 //            }
         }
         if(!(x%10)) {
-            _write(fd,img,3*window_w*window_h);
-            _lseek(fd,0,SEEK_SET);
+            pwrite(fd,img,3*window_w*window_h,0);
         }
     }
 
@@ -122,8 +122,7 @@ int main() {
         }
 
         if(!(x%5)) {
-            _write(fd,img,3*window_w*window_h);
-            _lseek(fd,0,SEEK_SET);
+            pwrite(fd,img,3*window_w*window_h,0);
         }
     }
     _write(fd,img,3*window_w*window_h);
@@ -14,6 +14,22 @@ extern int argc;
 extern char** argv;
 extern char** environ;
 
+/** \fn void copy_content(int from, int dest)
+ *  \brief Copy a file inside the kernel, or through a buffer if it cannot.
+ */
+void copy_content(int from, int dest) {
+	int n;
+	while ((n = sendfile(dest, from, NULL, 0x10000)) > 0);
+	if (n == 0) {
+		return;
+	}
+
+	char copy_buffer[1024];
+	while ((n = _read(from, copy_buffer, 1024)) > 0) {
+		_write(dest, copy_buffer, n);
+	}
+}
+
 int copy(int fromfd, char* frompath, int destfd, char* destpath, bool recursive) {
 	struct stat fs_from;
 	struct stat fs_dest;
@@ -37,12 +53,8 @@ int copy(int fromfd, char* frompath, int destfd, char* destpath, bool recursive)
 	fstat(dest, &fs_dest);
 
 	if (S_ISREG(fs_from.st_mode) && S_ISREG(fs_dest.st_mode)) {
-		char copy_buffer[1024];
-		int n;
 		printf(">%s\n", frompath);
-		while ((n = _read(from, copy_buffer, 1024)) > 0) {
-			_write(dest, copy_buffer, n);
-		}
+		copy_content(from, dest);
 	} else if (S_ISREG(fs_from.st_mode)) {
 		int new_file;
 		printf(">%s\n", frompath);
@@ -51,12 +63,7 @@ int copy(int fromfd, char* frompath, int destfd, char* destpath, bool recursive)
 		} else {
 			new_file = _openat(dest, basename(destpath), O_CREAT | O_WRONLY);
 		}
-
-		char copy_buffer[1024];
-		int n;
-		while ((n = _read(from, copy_buffer, 1024)) > 0) {
-			_write(new_file, copy_buffer, n);
-		}
+		copy_content(from, new_file);
 		_close(new_file);
 	} else if (recursive) {
 		if (S_ISREG(fs_dest.st_mode)) {
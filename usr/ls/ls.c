@@ -12,6 +12,34 @@
 extern int argc;
 extern char** argv;
 
+// Reads every entry of a directory, as dirent64 records.
+static char* read_entries(int fd, int* len) {
+	int cap = 4096;
+	char* buf = malloc(cap);
+	*len = 0;
+	while (buf != NULL) {
+		if (cap - *len < 512) { // Room for the longest name.
+			cap *= 2;
+			char* bigger = realloc(buf, cap);
+			if (bigger == NULL) {
+				free(buf);
+				return NULL;
+			}
+			buf = bigger;
+		}
+		int n = getdents64(fd, (struct dirent64*)(buf + *len), cap - *len);
+		if (n < 0) {
+			free(buf);
+			return NULL;
+		}
+		if (n == 0) {
+			break;
+		}
+		*len += n;
+	}
+	return buf;
+}
+
 int main() {
 	int c;
 	c=80;
@@ -65,7 +93,14 @@ int main() {
 		perror("ls");
 		return 1;
 	} else {
-		struct dirent* entry = malloc(sizeof(struct dirent));
+		int len;
+		char* entries = read_entries(fd, &len);
+		if (entries == NULL) {
+			perror("ls");
+			return 1;
+		}
+		struct dirent64* entry;
+
 		int max_size 	= 0;
 		int cur_size    = 0;
 
@@ -77,8 +112,8 @@ int main() {
 		struct stat fs;
 
 		int total = 0;
-		int result;
-		while((result = _getdents(fd,entry)) == 0) {
+		for (int pos=0;pos<len;pos+=entry->d_reclen) {
+			entry = (struct dirent64*)(entries + pos);
 			if (all || entry->d_name[0] != '.') {
 				total++;
 				cur_size = strlen(entry->d_name);
@@ -106,12 +141,6 @@ int main() {
 			}
 		};
 
-		if (result != 1) {
-			perror("ls");
-		}
-
-		_lseek(fd,0,SEEK_SET);
-
 		int i_inode=1;
 		int i_fsz=1;
 		int val=1;
@@ -154,7 +183,8 @@ int main() {
 		int n_per_lines = c/fmt_size;
 		int k = 0;
 
-		while(_getdents(fd,entry) == 0) {
+		for (int pos=0;pos<len;pos+=entry->d_reclen) {
+			entry = (struct dirent64*)(entries + pos);
 			if (all || (entry->d_name[0] != '.')) {
 				if (line) {
 					int fd_child = _openat(fd, entry->d_name, O_RDONLY);
@@ -165,17 +195,17 @@ int main() {
 				char modestr[11];
 				get_permission_string(fs.st_mode, modestr);
 				char* fmt_f;
-				if (S_ISDIR(entry->d_type)) {
+				if (entry->d_type == DT_DIR) {
 					fmt_f = fmt_dir;
 				} else {
 					fmt_f = fmt;
 				}
 				if (line & inode) {
-					printf(fmt_f, entry->d_ino, modestr, fs.st_size, entry->d_name);
+					printf(fmt_f, (int)entry->d_ino, modestr, fs.st_size, entry->d_name);
 				} else if (line) {
 					printf(fmt_f, modestr, fs.st_size, entry->d_name);
 				} else if (inode) {
-					printf(fmt_f, entry->d_ino, entry->d_name);
+					printf(fmt_f, (int)entry->d_ino, entry->d_name);
 				} else {
 					printf(fmt_f, entry->d_name);
 				}
@@ -189,6 +219,7 @@ int main() {
 		if (k != 0) {
 			printf("\n");
 		}
+		free(entries);
 		return 0;
 	}
 
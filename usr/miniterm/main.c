@@ -7,6 +7,7 @@
 #include <string.h>
 
 #include <fcntl.h>
+#include <unistd.h>
 
 unsigned vspace(int fd, unsigned size, unsigned char color) {
     char line[3*1024];
@@ -54,7 +55,7 @@ char drawcharacter(unsigned char* buffer, unsigned char* font, int h, int w, int
 }
 
 
-unsigned line(char* text, int fd, unsigned char* font, int h, int w, unsigned char ctext,unsigned char cback) {
+unsigned line(char* text, int fd, off_t offset, unsigned char* font, int h, int w, unsigned char ctext,unsigned char cback) {
     unsigned drawnlines = 0;
    //drawnlines += vspace(fd,10,25);
     unsigned drawncol = 0;
@@ -66,7 +67,7 @@ unsigned line(char* text, int fd, unsigned char* font, int h, int w, unsigned ch
         drawncol += hspace(buff,h,1,drawncol,cback);
     }
     hspace(buff,h,1024-drawncol,drawncol,cback);
-    _write(fd,buff,3*1024*h);
+    pwrite(fd,buff,3*1024*h,offset);
     drawnlines += h;
    // drawnlines += vspace(fd,10,25);
     return drawnlines;
@@ -158,23 +159,28 @@ int main() {
 
 
 		term_raw_enable(true);
+		struct pollfd fds[2] = {
+			{.fd = 0, .events = POLLIN}, // Serial input.
+			{.fd = read_from_term_fd, .events = POLLIN}, // Shell output.
+		};
 		while (1) {
-			for(int i=0;i<1000000;i++);
+			// Sleep until there is something to read. The timeout is only
+			// there to notice the end of the shell.
+			poll(fds, 2, 100);
 			if (_waitpid(pid, NULL, 1) > 0) {
 				//printf("Son exited\n");
 				break;
 			}
 
-			n = _read(0, buffer, 256); // Read serial input.
+			n = (fds[0].revents & POLLIN) ? _read(0, buffer, 256) : 0;
 			if (n > 0) {
 				printf("main read %d\n", n);
 				_write(write_to_term_fd, buffer, n);
 			}
 
-			n = _read(read_from_term_fd, buffer, 256);
+			n = (fds[1].revents & POLLIN) ? _read(read_from_term_fd, buffer, 256) : 0;
 			if (n > 0) {
 				printf("Shell wrote %d chars. %d\n",n,cursor_y);
-				_lseek(fd, cursor_y*screen_width*3*height, SEEK_SET);
 				for (int i=0;i<n;i++) {
 					char c = buffer[i];
 					if (c == '\n' || c == '\r') {
@@ -231,18 +237,15 @@ int main() {
 									} else if (params[0] == 1) { // From cursor to beg
 										printf("Not implemented.\n");
 									} else if (params[0] <= 3) { // Clear screen
-										int r = _lseek(fd, 0, SEEK_SET);
-										//printf("%d\n",r);
 										printf("> clear\n");
 										for (int j=0;j<n_rows;j++) {
 											printf("%d\n",fd);
 											for (int i=0;i<n_chars-1;i++)
 												lines[j][i] = ' ';
 											lines[j][n_chars-1] = 0;
-											line(lines[j], fd, font, height, width, 255, 0);
+											line(lines[j], fd, j*screen_width*3*height, font, height, width, 255, 0);
 										}
 										printf("> cleared\n");
-										_lseek(fd, 0, SEEK_SET);
 										cursor_x = 0;
 										cursor_y = 0;
 									} else {
@@ -257,8 +260,7 @@ int main() {
 									} else if (params[0] == 2) {
 										for (int i=0;i<n_chars;i++)
 											lines[cursor_y][i] = 0;
-										_lseek(fd, cursor_y*screen_width*3*height, SEEK_SET);
-										line(lines[cursor_y], fd, font, height, width, 255, 0);
+										line(lines[cursor_y], fd, cursor_y*screen_width*3*height, font, height, width, 255, 0);
 									}
 									break;
 								case 'f':
@@ -293,8 +295,7 @@ int main() {
 					}
 
 					if (c == '\r' || c == '\n' || cursor_x == n_chars) {
-						_lseek(fd, cursor_y*screen_width*3*height, SEEK_SET);
-						line(lines[cursor_y], fd, font, height, width, 255, 0);
+						line(lines[cursor_y], fd, cursor_y*screen_width*3*height, font, height, width, 255, 0);
 
 						cursor_y++;
 						cursor_x=0;
@@ -302,23 +303,20 @@ int main() {
 
 					if (cursor_y == n_rows) {
 						cursor_y = n_rows/2;
-						_lseek(fd, 0, SEEK_SET);
 						for (int i=0;i<n_rows/2;i++) {
 							memcpy(lines[i], lines[n_rows/2+i], n_chars);
-							line(lines[i], fd, font, height, width, 255, 0);
+							line(lines[i], fd, i*screen_width*3*height, font, height, width, 255, 0);
 						}
 
 						for (int i=n_rows/2;i<n_rows;i++) {
 							memset(lines[i], ' ', n_chars);
-							line(lines[i], fd, font, height, width, 255, 0);
+							line(lines[i], fd, i*screen_width*3*height, font, height, width, 255, 0);
 						}
-						_lseek(fd, cursor_y*screen_width*3*height, SEEK_SET);
 					}
 				}
 
 				if (cursor_x > 0) {
-					_lseek(fd, cursor_y*screen_width*3*height, SEEK_SET);
-					line(lines[cursor_y], fd, font, height, width, 255, 0);
+					line(lines[cursor_y], fd, cursor_y*screen_width*3*height, font, height, width, 255, 0);
 				}
 			}
 
@@ -19,10 +19,13 @@ int main() {
 		int result;
 		printf("%-32s %4s %5s %5s\n", "Name", "State", "PID", "PPID");
 		while((result = _getdents(fd, &entry)) == 0) {
-			if (entry.d_name[0] != '.') {
-				int proc_fd = _openat(fd, entry.d_name, O_RDONLY);
+			if (entry.d_name[0] >= '0' && entry.d_name[0] <= '9') { // Process directories.
+				char path[32];
+				snprintf(path, sizeof(path), "%s/status", entry.d_name);
+				int proc_fd = _openat(fd, path, O_RDONLY);
 				char buffer[256];
-				_read(proc_fd, buffer, 256);
+				int n = _read(proc_fd, buffer, 255);
+				buffer[n > 0 ? n : 0] = 0;
 				char* token = strtok(buffer, "\n");
 				int cnt = 0;
 				while (token != NULL) {
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+
+#include "../../include/syscalls.h"
+
+extern int argc;
+extern char** argv;
+
+/** \def DEPTH
+ *	\brief Reads queued at once. The buffers of a batch are written while the
+ *	next batch is read, so twice as many buffers are used.
+ */
+#define DEPTH 8
+
+#define OP_READ 	0x10000
+#define OP_WRITE 	0x20000
+
+static char* buffers[2*DEPTH];
+static int lengths[2*DEPTH];
+static int buffer_size = 1024;
+
+/** \fn int copy_plain(int from, int to, int* calls)
+ *	\brief Copy a file with a read and a write call per buffer.
+ *	\return The number of bytes copied, -1 on error.
+ */
+static int copy_plain(int from, int to, int* calls) {
+	int total = 0;
+	int n;
+	while (true) {
+		n = _read(from, buffers[0], buffer_size);
+		(*calls)++;
+		if (n <= 0) {
+			break;
+		}
+		(*calls)++;
+		if (_write(to, buffers[0], n) != n) {
+			return -1;
+		}
+		total += n;
+	}
+	return n < 0 ? -1 : total;
+}
+
+/** \fn int copy_ring(uring_t* ring, int from, int to, int depth, int* calls)
+ *	\brief Copy a file through the ring: each uring_enter writes the previous
+ *	batch of buffers and reads the next one.
+ *	\param depth Reads per batch, 1 for a terminal or a pipe whose reads may
+ *	return less than asked.
+ *	\return The number of bytes copied, -1 on error.
+ */
+static int copy_ring(uring_t* ring, int from, int to, int depth, int* calls) {
+	int total 	= 0;
+	int set 	= 0; // Buffers read by the current batch: set*DEPTH and after.
+	int pending = 0; // Buffers of the other set waiting to be written.
+	bool eof 	= false;
+	bool error 	= false;
+
+	while (!error && (!eof || pending > 0)) {
+		int submitted = 0;
+		int written = (1-set)*DEPTH;
+		for (int i=0;i<pending;i++) {
+			uring_prep_rw(uring_get_sqe(ring), URING_OP_WRITE, to, buffers[written+i], lengths[written+i], OP_WRITE | (written+i));
+			submitted++;
+		}
+		for (int i=0;i<depth && !eof;i++) {
+			lengths[set*DEPTH+i] = 0;
+			uring_prep_rw(uring_get_sqe(ring), URING_OP_READ, from, buffers[set*DEPTH+i], buffer_size, OP_READ | (set*DEPTH+i));
+			submitted++;
+		}
+
+		if (uring_enter(ring, submitted) < 0) {
+			return -1;
+		}
+		(*calls)++;
+
+		pending = 0;
+		uring_cqe_t* cqe;
+		int done = 0;
+		while (done < submitted) {
+			if ((cqe = uring_peek_cqe(ring)) == NULL) {
+				if (uring_enter(ring, submitted - done) < 0) { // Only if the ring was full.
+					return -1;
+				}
+				(*calls)++;
+				continue;
+			}
+			int index = cqe->user_data & 0xFFFF;
+			if (cqe->res < 0) {
+				errno = -cqe->res;
+				error = true;
+			} else if (cqe->user_data & OP_READ) {
+				lengths[index] = cqe->res;
+			} else {
+				total += cqe->res;
+			}
+			uring_cqe_seen(ring);
+			done++;
+		}
+
+		// The reads of a file run in order: the data stops at the first empty one.
+		if (!eof) {
+			for (int i=0;i<depth && !eof;i++) {
+				if (lengths[set*DEPTH+i] == 0) {
+					eof = true;
+				} else {
+					pending++;
+				}
+			}
+		}
+		set = 1-set;
+	}
+	return error ? -1 : total;
+}
+
+/** \fn unsigned long elapsed_us(struct timespec* start)
+ *	\brief Microseconds since start.
+ */
+static unsigned long elapsed_us(struct timespec* start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000000 + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+/** \fn void report(const char* name, const char* method, int bytes, unsigned long us, int calls)
+ *	\brief Print the throughput of a copy.
+ */
+static void report(const char* name, const char* method, int bytes, unsigned long us, int calls) {
+	unsigned long rate = us > 0 ? (unsigned long)bytes * 1000 / us : 0; // kB/s with kB = 1000 bytes.
+	fprintf(stderr, "%s: %s %d bytes in %lu us, %lu kB/s, %d system calls\n", name, method, bytes, us, rate, calls);
+}
+
+int main() {
+	char* params[18];
+	for (int i=0;i<argc;i++) {
+		params[i] = argv[i];
+	}
+
+	char* output = NULL;
+	bool bench = false;
+	int opt;
+	while ((opt = getopt(argc, params, "o:s:b")) != -1) {
+		switch (opt) {
+			case 'o':
+				output = optarg;
+				break;
+			case 's':
+				buffer_size = atoi(optarg);
+				break;
+			case 'b':
+				bench = true;
+				break;
+			default:
+				fprintf(stderr, "Usage: ringcat [-b] [-s buffer size] [-o output] [file...]\n");
+				return 1;
+		}
+	}
+	if (buffer_size <= 0) {
+		buffer_size = 1024;
+	}
+
+	for (int i=0;i<2*DEPTH;i++) {
+		buffers[i] = malloc(buffer_size);
+		if (buffers[i] == NULL) {
+			perror("ringcat");
+			return 1;
+		}
+	}
+
+	uring_t ring;
+	if (uring_init(&ring, 4*DEPTH) < 0) {
+		perror("ringcat");
+		return 1;
+	}
+
+	int to = 1;
+	if (output != NULL) {
+		to = _open(output, O_CREAT | O_TRUNC | O_WRONLY);
+		if (to < 0) {
+			perror(output);
+			return 1;
+		}
+	}
+
+	if (optind >= argc) { // Standard input, one read at a time as it is a terminal.
+		int calls = 0;
+		if (copy_ring(&ring, 0, to, 1, &calls) < 0) {
+			perror("ringcat");
+		}
+	}
+
+	int res = 0;
+	for (int i=optind;i<argc;i++) {
+		int from = _open(params[i], O_RDONLY);
+		if (from < 0) {
+			perror(params[i]);
+			res = 1;
+			continue;
+		}
+
+		struct timespec start;
+		int calls = 0;
+		int bytes;
+		if (bench) {
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			bytes = copy_plain(from, to, &calls);
+			report(params[i], "read/write", bytes, elapsed_us(&start), calls);
+			_lseek(from, 0, SEEK_SET);
+			calls = 0;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		bytes = copy_ring(&ring, from, to, DEPTH, &calls);
+		if (bytes < 0) {
+			perror(params[i]);
+			res = 1;
+		} else if (bench) {
+			report(params[i], "ring", bytes, elapsed_us(&start), calls);
+		}
+		_close(from);
+	}
+
+	if (output != NULL) {
+		_close(to);
+	}
+	uring_free(&ring);
+	return res;
+}
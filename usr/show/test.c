@@ -12,6 +12,20 @@ extern int argc;
 extern char** argv;
 extern char** environ;
 
+/** \fn void write_lines(int fd, unsigned char* line, int size, int count)
+ *  \brief Write the same line count times, in as few calls as possible.
+ */
+void write_lines(int fd, unsigned char* line, int size, int count) {
+    struct iovec lines[IOV_MAX];
+    for(int i = 0; i<IOV_MAX && i<count; i++) {
+        lines[i].iov_base = line;
+        lines[i].iov_len = size;
+    }
+    for(int i = 0; i<count; i += IOV_MAX) {
+        writev(fd,lines,count-i < IOV_MAX ? count-i : IOV_MAX);
+    }
+}
+
 int main() {
 	/*printf("\033[2J");
 	printf("\033[10;30H");
@@ -69,21 +83,14 @@ int main() {
     int downsize = height_frame - upsize - multiply*height;
 
     //We write the up and down borders
-    for(int i = 0; i<upsize; i++) {
-        _write(fd,buffer,3*width_frame);
-    }
+    write_lines(fd,buffer,3*width_frame,upsize);
     _lseek(fd,width_frame*3*(height_frame-downsize),SEEK_SET);
-    for(int i = 0; i<downsize; i++) {
-        _write(fd,buffer,3*width_frame);
-    }
+    write_lines(fd,buffer,3*width_frame,downsize);
 
 
     for(int i = 0; i<height; i++) {
-        if(i!=0) {
-            _lseek(fd,-multiply*2*3*width_frame,SEEK_CUR);
-        } else {
-            _lseek(fd,-(multiply+downsize)*3*width_frame,SEEK_CUR);
-        }
+        // The rows of a BMP go up from the bottom of the image.
+        _lseek(fd,width_frame*3*(height_frame-downsize-(i+1)*multiply),SEEK_SET);
         fread(data,sizeof(unsigned char), row_padded,f);
         for(int j = 0; j<width; j++) {
             unsigned char r = data[3*j+2];
@@ -95,9 +102,7 @@ int main() {
                 buffer[(leftsize + j*multiply + m)*3 + 2] = b;
             }
         }
-        for(int m = 0; m<multiply; m++) {
-            _write(fd,buffer,3*width_frame);
-        }
+        write_lines(fd,buffer,3*width_frame,multiply);
     }
 
     fclose(f);
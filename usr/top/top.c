@@ -0,0 +1,235 @@
+#include "stdio.h"
+#include "stdlib.h"
+#include "../../include/dirent.h"
+#include "../../include/termfeatures.h"
+#include "../../include/syscalls.h"
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+
+extern int argc;
+extern char** argv;
+
+#define MAX_TASKS 	128
+
+#define min(a,b) ((a) < (b) ? (a) : (b))
+#define max(a,b) ((a) > (b) ? (a) : (b))
+
+/** \struct task_t
+ *	\brief One sample of /proc/<pid>/stat.
+ */
+typedef struct {
+	int pid;
+	char name[33];
+	char state;
+	int threads;
+	unsigned long time; 	///< utime + stime, in milliseconds.
+	unsigned rss; 			///< In kilobytes.
+	unsigned cpu; 			///< Tenths of percent over the last period.
+} task_t;
+
+static task_t tasks[2][MAX_TASKS];
+static int n_tasks[2];
+
+/** \fn int read_file(int dirfd, const char* path, char* buffer, int size)
+ *	\brief Read a whole (small) /proc file with a single read.
+ *	\return The size read, or -1.
+ */
+static int read_file(int dirfd, const char* path, char* buffer, int size) {
+	int fd = _openat(dirfd, (char*)path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	int n = _read(fd, buffer, size-1);
+	_close(fd);
+	buffer[n > 0 ? n : 0] = 0;
+	return n;
+}
+
+/** \fn bool parse_task(char* buffer, task_t* t)
+ *	\brief Parse the content of /proc/<pid>/stat.
+ */
+static bool parse_task(char* buffer, task_t* t) {
+	char* open 	= strchr(buffer, '(');
+	char* close = strrchr(buffer, ')');
+	if (open == NULL || close == NULL || close < open) {
+		return false;
+	}
+	int len = min(close - open - 1, 32);
+	memcpy(t->name, open+1, len);
+	t->name[len] = 0;
+	t->pid = atoi(buffer);
+
+	int ppid, tgid;
+	unsigned long utime, stime, cutime, cstime, nvcsw, nivcsw, faults, syscalls;
+	if (sscanf(close+2, "%c %d %d %lu %lu %lu %lu %lu %lu %lu %lu %d %u",
+			   &t->state, &ppid, &tgid, &utime, &stime, &cutime, &cstime,
+			   &nvcsw, &nivcsw, &faults, &syscalls, &t->threads, &t->rss) != 13) {
+		return false;
+	}
+	t->time = utime + stime;
+	t->cpu 	= 0;
+	return true;
+}
+
+/** \fn int sample_tasks(task_t* list)
+ *	\brief Read the stat file of every process.
+ *	\return The number of processes read.
+ */
+static int sample_tasks(task_t* list) {
+	int fd = _open("/proc/", O_RDONLY);
+	if (fd < 0) {
+		return 0;
+	}
+	struct dirent entry;
+	int n = 0;
+	while(n < MAX_TASKS && _getdents(fd, &entry) == 0) {
+		if (entry.d_name[0] >= '0' && entry.d_name[0] <= '9') {
+			char path[32];
+			char buffer[256];
+			snprintf(path, sizeof(path), "%s/stat", entry.d_name);
+			if (read_file(fd, path, buffer, sizeof(buffer)) > 0 && parse_task(buffer, &list[n])) {
+				n++;
+			}
+		}
+	}
+	_close(fd);
+	return n;
+}
+
+/** \fn unsigned long meminfo_field(char* buffer, const char* name)
+ *	\brief Value of a field of /proc/meminfo.
+ */
+static unsigned long meminfo_field(char* buffer, const char* name) {
+	char* field = strstr(buffer, name);
+	return field != NULL ? strtoul(field + strlen(name) + 1, NULL, 10) : 0;
+}
+
+static int compare_cpu(const void* a, const void* b) {
+	const task_t* x = a;
+	const task_t* y = b;
+	if (x->cpu != y->cpu) {
+		return x->cpu < y->cpu ? 1 : -1;
+	}
+	return x->pid - y->pid;
+}
+
+int main() {
+	char* params[18];
+	for (int i=0;i<argc;i++) {
+		params[i] = argv[i];
+	}
+
+	int iterations = -1;
+	int delay = 2;
+	int opt;
+	while ((opt = getopt(argc,params,"n:d:")) != -1) {
+		switch (opt) {
+			case 'n':
+				iterations = atoi(optarg);
+				break;
+			case 'd':
+				delay = max(1, atoi(optarg));
+				break;
+			default:
+				fprintf(stderr, "Usage: top [-n iterations] [-d delay]\n");
+				return 1;
+		}
+	}
+
+	int rows, cols;
+	term_get_size(&rows, &cols);
+
+	int proc_fd = _open("/proc/", O_RDONLY);
+	if (proc_fd < 0) {
+		perror("top");
+		return 1;
+	}
+
+	unsigned long last_user = 0, last_system = 0, last_idle = 0, last_intr = 0, last_uptime = 0;
+	int cur = 0;
+	for (int it = 0; iterations < 0 || it < iterations; it++) {
+		char buffer[256];
+		unsigned long user = 0, system = 0, idle = 0, intr = 0, uptime = 0;
+		int running = 0;
+		if (read_file(proc_fd, "stat", buffer, sizeof(buffer)) > 0) {
+			sscanf(buffer, "cpu %lu %lu %lu\nintr %lu\nuptime %lu\nprocs_running %d",
+				   &user, &system, &idle, &intr, &uptime, &running);
+		}
+
+		char meminfo[256];
+		unsigned long mem_total = 0, mem_free = 0;
+		if (read_file(proc_fd, "meminfo", meminfo, sizeof(meminfo)) > 0) {
+			mem_total 	= meminfo_field(meminfo, "MemTotal:");
+			mem_free 	= meminfo_field(meminfo, "MemFree:");
+		}
+
+		char loadavg[64];
+		if (read_file(proc_fd, "loadavg", loadavg, sizeof(loadavg)) <= 0) {
+			snprintf(loadavg, sizeof(loadavg), "%d running", running);
+		} else {
+			// Only the three averages.
+			char* end = loadavg;
+			for (int i=0;i<3 && end != NULL;i++) {
+				end = strchr(end + (i > 0), ' ');
+			}
+			if (end != NULL) {
+				*end = 0;
+			}
+		}
+
+		n_tasks[cur] = sample_tasks(tasks[cur]);
+
+		// CPU usage of each process over the period, matched by PID with the previous sample.
+		unsigned long period = uptime - last_uptime;
+		task_t* prev = tasks[1-cur];
+		for (int i=0;i<n_tasks[cur];i++) {
+			task_t* t = &tasks[cur][i];
+			for (int j=0;j<n_tasks[1-cur];j++) {
+				if (prev[j].pid == t->pid && t->time >= prev[j].time && period > 0) {
+					t->cpu = (t->time - prev[j].time) * 1000 / period;
+					break;
+				}
+			}
+		}
+		qsort(tasks[cur], n_tasks[cur], sizeof(task_t), compare_cpu);
+
+		unsigned long d_user 	= user - last_user;
+		unsigned long d_system 	= system - last_system;
+		unsigned long d_total 	= d_user + d_system + idle - last_idle;
+		unsigned pct_user 	= d_total > 0 ? d_user * 1000 / d_total : 0;
+		unsigned pct_system = d_total > 0 ? d_system * 1000 / d_total : 0;
+		unsigned long irq_rate = period > 0 ? (intr - last_intr) * 1000 / period : 0;
+
+		term_clear();
+		term_move_cursor(1, 1);
+		printf("top - up %lus, load: %s, %d tasks\n", uptime / 1000, loadavg, n_tasks[cur]);
+		printf("CPU: %u.%u%% user, %u.%u%% sys, %lu irq/s\n",
+			   pct_user / 10, pct_user % 10, pct_system / 10, pct_system % 10, irq_rate);
+		printf("Mem: %lukB total, %lukB used, %lukB free\n\n", mem_total, mem_total - mem_free, mem_free);
+		printf("%5s %-20s %1s %4s %6s %8s %9s\n", "PID", "NAME", "S", "THR", "%CPU", "RSS(kB)", "TIME(ms)");
+
+		int shown = min(n_tasks[cur], rows - 6);
+		for (int i=0;i<shown;i++) {
+			task_t* t = &tasks[cur][i];
+			printf("%5d %-20.20s %c %4d %4u.%u %8u %9lu\n",
+				   t->pid, t->name, t->state, t->threads, t->cpu / 10, t->cpu % 10, t->rss, t->time);
+		}
+		fflush(stdout);
+
+		last_user 	= user;
+		last_system = system;
+		last_idle 	= idle;
+		last_intr 	= intr;
+		last_uptime = uptime;
+		cur = 1 - cur;
+
+		if (iterations < 0 || it + 1 < iterations) {
+			sleep(delay);
+		}
+	}
+	_close(proc_fd);
+	return 0;
+}
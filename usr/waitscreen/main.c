@@ -97,8 +97,13 @@ int main() {
     for(int i = 0; i<width_frame*3; i++) {
         blackline[i] = 0;
     }
-    for(int i = 0; i<height_frame; i++) {
-        _write(fd,blackline,3*width_frame);
+    struct iovec blacklines[IOV_MAX];
+    for(int i = 0; i<IOV_MAX; i++) {
+        blacklines[i].iov_base = blackline;
+        blacklines[i].iov_len = 3*width_frame;
+    }
+    for(int i = 0; i<height_frame; i += IOV_MAX) {
+        writev(fd,blacklines,height_frame-i < IOV_MAX ? height_frame-i : IOV_MAX);
     }
 
 
@@ -131,9 +136,7 @@ int main() {
             speedy = -base_speed_y;
         }
 
-        _lseek(fd,new_posy*3*width_frame,SEEK_SET);
         int leftsize = new_posx;
-        int rightsize = width_frame - new_posx - width_bmp;
 
 		for(int i = 0; i<height_bmp; i++) {
 			for (int j = 0;j<width_bmp; j++) {
@@ -150,11 +153,7 @@ int main() {
 		}
 
         for(int i = 0; i<height_bmp; i++) {
-         //   _write(fd,blackline,3*leftsize);
-			_lseek(fd,3*leftsize,SEEK_CUR);
-            _write(fd,bmp_color+3*width_bmp*i,3*width_bmp);
-   			_lseek(fd,3*rightsize,SEEK_CUR);
-           // _write(fd,blackline,3*rightsize);
+            pwrite(fd,bmp_color+3*width_bmp*i,3*width_bmp,((new_posy+i)*width_frame+leftsize)*3);
         }
 
 		while (_time(NULL) - last_time < 2000);